@@ -0,0 +1,101 @@
+#include "arena.h"
+#include <stdlib.h>
+
+#define ARENA_MIN_BLOCK 32
+#define ARENA_MAX_BLOCK (ARENA_MIN_BLOCK << (ARENA_CLASSES - 1))
+
+struct ArenaChunk {
+    ArenaChunk *next;
+};
+
+// large blocks are kept in a doubly linked list so a single one can be freed in O(1)
+struct ArenaBig {
+    ArenaBig *prev;
+    ArenaBig *next;
+};
+
+// chunk and big-block headers are padded so blocks stay pointer-aligned
+#define CHUNK_HDR ((sizeof(ArenaChunk) + 15) & ~(size_t)15)
+#define BIG_HDR   ((sizeof(ArenaBig) + 15) & ~(size_t)15)
+
+static int size_class(size_t n) {
+    int c = 0;
+    size_t sz = ARENA_MIN_BLOCK;
+    while (sz < n) {
+        sz <<= 1;
+        c++;
+    }
+    return c;
+}
+
+void arena_init(Arena *a) {
+    a->chunks = NULL;
+    a->cur    = NULL;
+    a->left   = 0;
+    a->big    = NULL;
+    a->mallocs = 0;
+    for (int c = 0; c < ARENA_CLASSES; c++) a->free_lists[c] = NULL;
+}
+
+char *arena_alloc(Arena *a, size_t n) {
+    if (n > ARENA_MAX_BLOCK) {
+        ArenaBig *b = malloc(BIG_HDR + n);
+        if (!b) return NULL;
+        a->mallocs++;
+        b->prev = NULL;
+        b->next = a->big;
+        if (a->big) a->big->prev = b;
+        a->big = b;
+        return (char *)b + BIG_HDR;
+    }
+    int c = size_class(n);
+    size_t sz = (size_t)ARENA_MIN_BLOCK << c;
+    if (a->free_lists[c]) {
+        // reuse a block freed by arena_release
+        void *p = a->free_lists[c];
+        a->free_lists[c] = *(void **)p;
+        return p;
+    }
+    if (a->left < sz) {
+        ArenaChunk *ch = malloc(CHUNK_HDR + ARENA_CHUNK);
+        if (!ch) return NULL;
+        a->mallocs++;
+        ch->next  = a->chunks;
+        a->chunks = ch;
+        a->cur    = (char *)ch + CHUNK_HDR;
+        a->left   = ARENA_CHUNK;
+    }
+    char *p = a->cur;
+    a->cur  += sz;
+    a->left -= sz;
+    return p;
+}
+
+void arena_release(Arena *a, char *p, size_t n) {
+    if (!p) return;
+    if (n > ARENA_MAX_BLOCK) {
+        ArenaBig *b = (ArenaBig *)(p - BIG_HDR);
+        if (b->prev) b->prev->next = b->next;
+        else a->big = b->next;
+        if (b->next) b->next->prev = b->prev;
+        free(b);
+        return;
+    }
+    int c = size_class(n);
+    *(void **)p = a->free_lists[c];
+    a->free_lists[c] = p;
+}
+
+void arena_free_all(Arena *a) {
+    while (a->chunks) {
+        ArenaChunk *next = a->chunks->next;
+        free(a->chunks);
+        a->chunks = next;
+    }
+    while (a->big) {
+        ArenaBig *next = a->big->next;
+        free(a->big);
+        a->big = next;
+    }
+    arena_init(a);
+}
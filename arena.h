@@ -0,0 +1,49 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// Арена для строк info таблицы в памяти.
+// Память берётся крупными кусками (ARENA_CHUNK байт) и раздаётся
+// блоками размеров 32, 64, ..., 4096 байт. Освобождённый блок попадает
+// в список свободных своего класса и выдаётся повторно без malloc.
+// Блоки больше 4096 байт выделяются отдельно и освобождаются сразу.
+// arena_free_all отдаёт всю память целиком, не обходя строки.
+
+#define ARENA_CLASSES 8            // классы 32 << 0 ... 32 << 7
+#define ARENA_CHUNK   (64 * 1024)  // размер куска
+
+typedef struct ArenaChunk ArenaChunk;
+typedef struct ArenaBig   ArenaBig;
+
+typedef struct {
+    ArenaChunk *chunks;                  // список выделенных кусков
+    char       *cur;                     // свободное место в текущем куске
+    size_t      left;                    // байт свободно в текущем куске
+    void       *free_lists[ARENA_CLASSES]; // освобождённые блоки по классам
+    ArenaBig   *big;                     // список отдельных больших блоков
+    long        mallocs;                 // число вызовов malloc (для статистики)
+} Arena;
+
+/*
+ * Инициализация пустой арены.
+ */
+void arena_init(Arena *a);
+
+/*
+ * Выделить блок не меньше n байт. Возвращает NULL при нехватке памяти.
+ */
+char *arena_alloc(Arena *a, size_t n);
+
+/*
+ * Вернуть блок, выделенный arena_alloc(a, n), для повторного использования.
+ * n должно совпадать с размером, переданным при выделении.
+ */
+void arena_release(Arena *a, char *p, size_t n);
+
+/*
+ * Освободить всю память арены (все блоки становятся недействительными).
+ */
+void arena_free_all(Arena *a);
+
+#endif // ARENA_H
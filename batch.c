@@ -0,0 +1,84 @@
+#include "batch.h"
+#include "hash_index.h"
+#include <stdlib.h>
+
+int batch_order(const BatchRow *rows, int n, BatchExistsFn exists, void *ctx,
+                int *order, int *errs) {
+    HashIndex pos;   // key -> index of the accepted row with that key
+    int *first = malloc((n > 0 ? n : 1) * sizeof(int)); // first child inside the batch
+    int *last  = malloc((n > 0 ? n : 1) * sizeof(int)); // last child inside the batch
+    int *next  = malloc((n > 0 ? n : 1) * sizeof(int)); // next sibling inside the batch
+    if (!first || !last || !next || hi_init(&pos, n) != 0) {
+        free(first);
+        free(last);
+        free(next);
+        return -1;
+    }
+
+    // pass 1: per-row checks and key uniqueness
+    for (int i = 0; i < n; i++) {
+        first[i] = -1;
+        last[i]  = -1;
+        next[i]  = -1;
+        errs[i]  = BATCH_OK;
+        if (rows[i].key <= 0 || rows[i].par < 0 || !rows[i].info) {
+            errs[i] = BATCH_INVALID;
+        } else if (hi_find(&pos, rows[i].key) >= 0 || exists(ctx, rows[i].key)) {
+            errs[i] = BATCH_EXISTS;
+        } else if (hi_put(&pos, rows[i].key, i) != 0) {
+            hi_free(&pos);
+            free(first);
+            free(last);
+            free(next);
+            return -1;
+        }
+    }
+
+    // pass 2: rows whose parent is already in the table start the order,
+    // the rest hang off their parent row inside the batch
+    int m = 0;
+    for (int i = 0; i < n; i++) {
+        if (errs[i] != BATCH_OK) continue;
+        int par = rows[i].par;
+        if (par == 0 || exists(ctx, par)) {
+            order[m++] = i;
+            continue;
+        }
+        int j = hi_find(&pos, par);
+        if (j < 0) {
+            errs[i] = BATCH_NO_PARENT;
+            continue;
+        }
+        // appended at the tail, so siblings keep their input order
+        if (last[j] < 0) first[j] = i;
+        else next[last[j]] = i;
+        last[j] = i;
+    }
+
+    // breadth-first walk: a row is appended only after its parent,
+    // rows never reached depend on a rejected row or on a cycle
+    for (int q = 0; q < m; q++) {
+        for (int c = first[order[q]]; c >= 0; c = next[c]) order[m++] = c;
+    }
+    if (m < n) {
+        char *seen = calloc(n, 1);
+        if (!seen) {
+            hi_free(&pos);
+            free(first);
+            free(last);
+            free(next);
+            return -1;
+        }
+        for (int q = 0; q < m; q++) seen[order[q]] = 1;
+        for (int i = 0; i < n; i++) {
+            if (errs[i] == BATCH_OK && !seen[i]) errs[i] = BATCH_NO_PARENT;
+        }
+        free(seen);
+    }
+
+    hi_free(&pos);
+    free(first);
+    free(last);
+    free(next);
+    return m;
+}
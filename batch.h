@@ -0,0 +1,35 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+// Общая проверка пакетной вставки для Table и FTable.
+// Пакет проверяется целиком: родитель может быть как в таблице,
+// так и в самом пакете (в том числе ниже по списку). Допустимые
+// элементы упорядочиваются так, чтобы родитель шёл раньше потомков.
+
+// Коды результата проверки элемента пакета
+#define BATCH_OK        0  // элемент будет вставлен
+#define BATCH_INVALID   1  // key <= 0 или info == NULL
+#define BATCH_EXISTS    2  // ключ уже есть в таблице или повторяется в пакете
+#define BATCH_NO_PARENT 3  // родителя нет ни в таблице, ни среди допустимых
+                           // элементов пакета (или родители образуют цикл)
+
+// Элемент пакета вставки
+typedef struct {
+    int         key;   // ключ (> 0 и уникален)
+    int         par;   // ключ родителя: 0, ключ из таблицы или из пакета
+    const char *info;  // C-строка (не NULL)
+} BatchRow;
+
+// Проверка наличия ключа в таблице (ненулевой результат — ключ есть)
+typedef int (*BatchExistsFn)(void *ctx, int key);
+
+/*
+ * Проверить пакет rows из n элементов.
+ * errs[i] — код BATCH_* для каждого элемента,
+ * order — индексы допустимых элементов в порядке вставки.
+ * Возвращает число элементов в order или -1 при нехватке памяти.
+ */
+int batch_order(const BatchRow *rows, int n, BatchExistsFn exists, void *ctx,
+                int *order, int *errs);
+
+#endif // BATCH_H
@@ -0,0 +1,433 @@
+// Нагрузочный тест Table и FTable (отдельная программа со своим main).
+// Строит иерархии заданной формы и размера, измеряет вставку, поиск по
+// родителю, диапазоны ключей, каскадное удаление, печать и экспорт DOT
+// и выводит JSON: пропускную способность, задержки p50/p99 и пиковый RSS.
+// Каждый случай выполняется в отдельном процессе, чтобы пиковый RSS
+// относился только к нему.
+//
+//   bench [--engine=mem|file|both] [--shape=wide|deep|random|all]
+//         [--sizes=1000,100000,...] [--fanout=N] [--searches=N]
+//         [--file=path] [--threads=N] [--btree] [--wal] [--mmap] [--compress] [--seed=N]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "table_mem.h"
+#include "table_file.h"
+
+#define MAX_SIZES   16
+#define BENCH_RANGE 100 // ключей в одном запросе диапазона
+
+typedef struct {
+    int  mem, file;        // какие таблицы измерять
+    int  shapes[3];        // wide, deep, random
+    long sizes[MAX_SIZES];
+    int  nsizes;
+    int  fanout;           // потомков у узла в форме wide
+    int  searches;         // число поисков по родителю (и запросов диапазона)
+    const char *path;      // файл FTable
+    int  threads;          // tm_set_threads
+    TfOptions opt;
+    unsigned seed;
+} Config;
+
+static const char *shape_name[3] = { "wide", "deep", "random" };
+
+// Серия измерений одной операции
+typedef struct {
+    uint32_t *lat;   // задержки, нс
+    long      n;     // измерено операций
+    long      cap;
+    long      rows;  // строк обработано (поиск, удаление)
+    double    sec;   // суммарное время
+} Series;
+
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+static void series_init(Series *s, long cap) {
+    s->lat  = malloc((cap > 0 ? cap : 1) * sizeof(uint32_t));
+    s->n    = 0;
+    s->cap  = s->lat ? cap : 0;
+    s->rows = 0;
+    s->sec  = 0;
+}
+
+
+static void series_add(Series *s, double t) {
+    s->sec += t;
+    double ns = t * 1e9;
+    if (s->n < s->cap) s->lat[s->n] = ns > UINT32_MAX ? UINT32_MAX : (uint32_t)ns;
+    s->n++;
+}
+
+
+static int cmp_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+
+// Квантиль q задержек в микросекундах
+static double quantile(const Series *s, double q) {
+    long n = s->n < s->cap ? s->n : s->cap;
+    if (n == 0) return 0;
+    long i = (long)(q * (n - 1) + 0.5);
+    return s->lat[i] / 1e3;
+}
+
+
+static void series_json(Series *s, const char *name, int last) {
+    long n = s->n < s->cap ? s->n : s->cap;
+    qsort(s->lat, n, sizeof(uint32_t), cmp_u32);
+    printf("      \"%s\": {\"count\": %ld, \"rows\": %ld, \"sec\": %.6f, "
+           "\"ops_per_sec\": %.1f, \"rows_per_sec\": %.1f, "
+           "\"p50_us\": %.3f, \"p99_us\": %.3f}%s\n",
+           name, s->n, s->rows, s->sec,
+           s->sec > 0 ? s->n / s->sec : 0.0,
+           s->sec > 0 ? s->rows / s->sec : 0.0,
+           quantile(s, 0.50), quantile(s, 0.99), last ? "" : ",");
+    free(s->lat);
+}
+
+
+// Ключ родителя для ключа k (ключи вставляются по возрастанию)
+static int parent_of(int shape, int k, int fanout) {
+    if (k == 1) return 0;
+    switch (shape) {
+        case 0:  return 1 + (k - 2) / fanout;  // wide: fanout-арное дерево
+        case 1:  return k - 1;                 // deep: одна цепочка
+        default: return rand() % 100 == 0 ? 0 : 1 + rand() % (k - 1);
+    }
+}
+
+
+static void shuffle(int *a, long n) {
+    for (long i = n - 1; i > 0; i--) {
+        long j = ((long)rand() * RAND_MAX + rand()) % (i + 1);
+        int x = a[i];
+        a[i] = a[j];
+        a[j] = x;
+    }
+}
+
+
+// Вывод таблиц в stdout уходит в /dev/null, чтобы не смешиваться с JSON
+static int mute(void) {
+    fflush(stdout);
+    int saved = dup(1);
+    int null = open("/dev/null", O_WRONLY);
+    if (null >= 0) {
+        dup2(null, 1);
+        close(null);
+    }
+    return saved;
+}
+
+
+static void unmute(int saved) {
+    fflush(stdout);
+    if (saved >= 0) {
+        dup2(saved, 1);
+        close(saved);
+    }
+}
+
+
+typedef struct {
+    Table  tm;
+    FTable ft;
+    int    file;
+} Eng;
+
+
+static int eng_insert(Eng *e, int key, int par, const char *info) {
+    return e->file ? tf_insert(&e->ft, key, par, info) : tm_insert(&e->tm, key, par, info);
+}
+
+
+static int eng_remove(Eng *e, int key) {
+    return e->file ? tf_remove(&e->ft, key) : tm_remove(&e->tm, key);
+}
+
+
+// Поиск по родителю с чтением всех найденных строк; возвращает их число
+static int eng_search(Eng *e, int par) {
+    int n = 0;
+    if (e->file) {
+        TfCursor c;
+        TfRow row;
+        tf_cursor_open(&c, &e->ft, par);
+        while (tf_cursor_next(&c, &row)) n++;
+        tf_cursor_close(&c);
+    } else {
+        TmCursor c;
+        TmRow row;
+        tm_cursor_open(&c, &e->tm, par);
+        while (tm_cursor_next(&c, &row)) n++;
+    }
+    return n;
+}
+
+
+static int count_tm_row(const TmRow *row, void *ctx) {
+    (void)row;
+    ++*(int *)ctx;
+    return 0;
+}
+
+
+static int count_tf_row(const TfRow *row, void *ctx) {
+    (void)row;
+    ++*(int *)ctx;
+    return 0;
+}
+
+
+// Строки с ключами из [lo, hi] по возрастанию; возвращает их число
+static int eng_range(Eng *e, int lo, int hi) {
+    int n = 0;
+    if (e->file) tf_range(&e->ft, lo, hi, count_tf_row, &n);
+    else tm_range(&e->tm, lo, hi, count_tm_row, &n);
+    return n;
+}
+
+
+// Один случай: таблица, форма, размер. Печатает объект JSON
+static int run_case(const Config *cfg, int file, int shape, long n) {
+    Eng e;
+    e.file = file;
+    srand(cfg->seed);
+    if (file) {
+        char wal[4096];
+        snprintf(wal, sizeof(wal), "%s.wal", cfg->path);
+        remove(cfg->path);
+        remove(wal);
+        int res = tf_open_ex(&e.ft, cfg->path, &cfg->opt);
+        if (res != TMF_OK) {
+            fprintf(stderr, "bench: %s: %s\n", cfg->path, tf_errstr(res));
+            return 1;
+        }
+    } else {
+        tm_init(&e.tm, 1024);
+        tm_set_threads(&e.tm, cfg->threads);
+    }
+
+    Series ins, sea, rng, rem, prn, dot;
+    char info[64];
+    series_init(&ins, n);
+    for (int k = 1; k <= n; k++) {
+        int par = parent_of(shape, k, cfg->fanout);
+        snprintf(info, sizeof(info), "info-%d", k);
+        double t = now();
+        int res = eng_insert(&e, k, par, info);
+        series_add(&ins, now() - t);
+        if (res == TM_OK) ins.rows++;
+    }
+
+    // родитель случайного ключа: у формы wide узлов с потомками мало,
+    // и случайный ключ почти никогда не попадал бы в них
+    series_init(&sea, cfg->searches);
+    for (int i = 0; i < cfg->searches; i++) {
+        int par = parent_of(shape, 1 + rand() % n, cfg->fanout);
+        double t = now();
+        sea.rows += eng_search(&e, par);
+        series_add(&sea, now() - t);
+    }
+
+    // первый запрос строит упорядоченный индекс, дальше удаления его ведут
+    series_init(&rng, cfg->searches);
+    for (int i = 0; i < cfg->searches; i++) {
+        int lo = 1 + rand() % n;
+        double t = now();
+        rng.rows += eng_range(&e, lo, lo + BENCH_RANGE - 1);
+        series_add(&rng, now() - t);
+    }
+
+    series_init(&prn, 1);
+    int saved = mute();
+    double t = now();
+    if (file) tf_print(&e.ft);
+    else tm_print(&e.tm);
+    series_add(&prn, now() - t);
+    unmute(saved);
+    prn.rows = n;
+
+    char dotfile[4096];
+    snprintf(dotfile, sizeof(dotfile), "%s.dot", cfg->path);
+    series_init(&dot, 1);
+    t = now();
+    if (file) tf_export_dot(&e.ft, dotfile);
+    else tm_export_dot(&e.tm, dotfile);
+    series_add(&dot, now() - t);
+    remove(dotfile);
+    dot.rows = n;
+
+    // ключи в случайном порядке; ключ, удалённый вместе с предком,
+    // даёт быстрый "не найден" и в задержки не попадает
+    int *keys = malloc(n * sizeof(int));
+    series_init(&rem, n);
+    if (keys) {
+        for (int k = 1; k <= n; k++) keys[k - 1] = k;
+        shuffle(keys, n);
+        for (long i = 0; i < n; i++) {
+            long before = file ? e.ft.count : e.tm.count;
+            t = now();
+            int res = eng_remove(&e, keys[i]);
+            double dt = now() - t;
+            if (res != TM_OK) continue;
+            series_add(&rem, dt);
+            rem.rows += before - (file ? e.ft.count : e.tm.count);
+        }
+        free(keys);
+    }
+
+    if (file) {
+        tf_close(&e.ft);
+        remove(cfg->path);
+    } else {
+        tm_free(&e.tm);
+    }
+
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    printf("    {\"engine\": \"%s\", \"shape\": \"%s\", \"n\": %ld, \"peak_rss_kb\": %ld,\n"
+           "     \"ops\": {\n", file ? "file" : "mem", shape_name[shape], n, ru.ru_maxrss);
+    series_json(&ins, "insert", 0);
+    series_json(&sea, "search", 0);
+    series_json(&rng, "range", 0);
+    series_json(&prn, "print", 0);
+    series_json(&dot, "export_dot", 0);
+    series_json(&rem, "remove", 1);
+    printf("    }}");
+    fflush(stdout);
+    return 0;
+}
+
+
+static int parse_sizes(Config *cfg, const char *s) {
+    cfg->nsizes = 0;
+    while (*s && cfg->nsizes < MAX_SIZES) {
+        char *end;
+        double v = strtod(s, &end); // допускается запись 1e6
+        if (end == s || v < 1 || v > 2e9) return -1;
+        cfg->sizes[cfg->nsizes++] = (long)v;
+        s = *end == ',' ? end + 1 : end;
+        if (*end && *end != ',') return -1;
+    }
+    return cfg->nsizes > 0 ? 0 : -1;
+}
+
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [--engine=mem|file|both] [--shape=wide|deep|random|all]\n"
+            "          [--sizes=1e3,1e4,1e5] [--fanout=N] [--searches=N]\n"
+            "          [--file=path] [--threads=N] [--btree] [--wal] [--mmap] [--compress] [--seed=N]\n",
+            prog);
+}
+
+
+int main(int argc, char *argv[]) {
+    Config cfg;
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.mem = cfg.file = 1;
+    cfg.shapes[0] = cfg.shapes[1] = cfg.shapes[2] = 1;
+    cfg.sizes[0] = 1000;
+    cfg.sizes[1] = 10000;
+    cfg.sizes[2] = 100000;
+    cfg.nsizes   = 3;
+    cfg.fanout   = 1000;
+    cfg.searches = 10000;
+    cfg.path     = "bench_table.dat";
+    cfg.threads  = 1;
+    cfg.seed     = 1;
+
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        if (!strncmp(a, "--engine=", 9)) {
+            cfg.mem  = !strcmp(a + 9, "mem") || !strcmp(a + 9, "both");
+            cfg.file = !strcmp(a + 9, "file") || !strcmp(a + 9, "both");
+            if (!cfg.mem && !cfg.file) {
+                usage(argv[0]);
+                return 2;
+            }
+        } else if (!strncmp(a, "--shape=", 8)) {
+            int all = !strcmp(a + 8, "all"), any = all;
+            for (int s = 0; s < 3; s++) {
+                cfg.shapes[s] = all || !strcmp(a + 8, shape_name[s]);
+                any |= cfg.shapes[s];
+            }
+            if (!any) {
+                usage(argv[0]);
+                return 2;
+            }
+        } else if (!strncmp(a, "--sizes=", 8)) {
+            if (parse_sizes(&cfg, a + 8) != 0) {
+                usage(argv[0]);
+                return 2;
+            }
+        } else if (!strncmp(a, "--fanout=", 9)) {
+            cfg.fanout = atoi(a + 9) > 0 ? atoi(a + 9) : 1;
+        } else if (!strncmp(a, "--searches=", 11)) {
+            cfg.searches = atoi(a + 11) > 0 ? atoi(a + 11) : 0;
+        } else if (!strncmp(a, "--file=", 7)) {
+            cfg.path = a + 7;
+        } else if (!strncmp(a, "--threads=", 10)) {
+            cfg.threads = atoi(a + 10);
+        } else if (!strncmp(a, "--seed=", 7)) {
+            cfg.seed = (unsigned)atoi(a + 7);
+        } else if (!strcmp(a, "--btree")) {
+            cfg.opt.use_btree = 1;
+        } else if (!strcmp(a, "--wal")) {
+            cfg.opt.use_wal = 1;
+        } else if (!strcmp(a, "--mmap")) {
+            cfg.opt.use_mmap = 1;
+        } else if (!strcmp(a, "--compress")) {
+            cfg.opt.compress = 1;
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    printf("{\n  \"threads\": %d, \"fanout\": %d, \"searches\": %d, "
+           "\"btree\": %d, \"wal\": %d, \"mmap\": %d, \"compress\": %d,\n  \"cases\": [\n",
+           cfg.threads, cfg.fanout, cfg.searches,
+           cfg.opt.use_btree, cfg.opt.use_wal, cfg.opt.use_mmap, cfg.opt.compress);
+    int first = 1, failed = 0;
+    for (int file = 0; file < 2; file++) {
+        if (!(file ? cfg.file : cfg.mem)) continue;
+        for (int shape = 0; shape < 3; shape++) {
+            if (!cfg.shapes[shape]) continue;
+            for (int i = 0; i < cfg.nsizes; i++) {
+                if (!first) printf(",\n");
+                fflush(stdout);
+                pid_t pid = fork();
+                if (pid == 0) _exit(run_case(&cfg, file, shape, cfg.sizes[i]));
+                int status = 0;
+                if (pid < 0 || waitpid(pid, &status, 0) < 0 ||
+                    !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                    // случай не выполнен: пустой объект с признаком ошибки
+                    printf("    {\"engine\": \"%s\", \"shape\": \"%s\", \"n\": %ld, \"error\": true}",
+                           file ? "file" : "mem", shape_name[shape], cfg.sizes[i]);
+                    failed = 1;
+                }
+                first = 0;
+            }
+        }
+    }
+    printf("\n  ]\n}\n");
+    return failed;
+}
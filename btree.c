@@ -0,0 +1,433 @@
+#include "btree.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+struct BtFrame {
+    long off;   // page held by the frame, 0 — empty
+    int  pin;   // callers holding the page
+    char dirty;
+    char ref;   // used since the clock hand last passed
+};
+
+// Page layout: PageHead, then
+//   leaf:  n entries of BtKey + value
+//   inner: child 0, then n entries of BtKey + child (keys >= key[i] go to child i + 1)
+typedef struct {
+    int  leaf;
+    int  n;
+    long next; // leaf: right sibling, 0 — last leaf
+} PageHead;
+
+typedef struct {
+    BtKey k;
+    long  child;
+} InnerEntry;
+
+#define HEAD(p)      ((PageHead *)(p))
+#define CHILD0(p)    (*(long *)((p) + sizeof(PageHead)))
+#define INNER(p)     ((InnerEntry *)((p) + sizeof(PageHead) + sizeof(long)))
+#define INNER_CAP    ((int)((BT_PAGE - sizeof(PageHead) - sizeof(long)) / sizeof(InnerEntry)))
+#define ESIZE(t)     ((int)sizeof(BtKey) + (t)->vsize)
+#define LEAF_CAP(t)  ((int)((BT_PAGE - sizeof(PageHead)) / ESIZE(t)))
+#define ENTRY(t, p, i) ((p) + sizeof(PageHead) + (size_t)(i) * ESIZE(t))
+
+static int key_cmp(BtKey x, BtKey y) {
+    if (x.a != y.a) return x.a < y.a ? -1 : 1;
+    return (x.b > y.b) - (x.b < y.b);
+}
+
+static BtKey entry_key(const char *e) {
+    BtKey k;
+    memcpy(&k, e, sizeof(k));
+    return k;
+}
+
+// --- page cache ---
+
+int pg_init(BtPager *pg, int fd, int pages, BtAllocFn alloc, void *ctx) {
+    memset(pg, 0, sizeof(*pg));
+    if (pages < BT_MIN_PAGES) pages = BT_MIN_PAGES;
+    pg->frames = calloc((size_t)pages, sizeof(BtFrame));
+    pg->mem = malloc((size_t)pages * BT_PAGE);
+    if (!pg->frames || !pg->mem || hi_init(&pg->map, pages) != 0) {
+        free(pg->frames);
+        free(pg->mem);
+        memset(pg, 0, sizeof(*pg));
+        return -1;
+    }
+    pthread_mutex_init(&pg->lock, NULL);
+    pg->fd = fd;
+    pg->nframes = pages;
+    pg->alloc = alloc;
+    pg->ctx = ctx;
+    return 0;
+}
+
+static char *frame_data(const BtPager *pg, int i) {
+    return pg->mem + (size_t)i * BT_PAGE;
+}
+
+static int write_frame(BtPager *pg, int i) {
+    BtFrame *f = &pg->frames[i];
+    if (!f->dirty) return 0;
+    if (pwrite(pg->fd, frame_data(pg, i), BT_PAGE, f->off) != BT_PAGE) return -1;
+    f->dirty = 0;
+    pg->writes++;
+    return 0;
+}
+
+// picks a frame for a new page: an empty one or the first unpinned page
+// the clock hand finds unused since its last pass
+static int victim(BtPager *pg) {
+    for (int step = 0; step < 2 * pg->nframes; step++) {
+        int i = pg->hand;
+        pg->hand = (pg->hand + 1) % pg->nframes;
+        BtFrame *f = &pg->frames[i];
+        if (f->pin) continue;
+        if (f->off && f->ref) {
+            f->ref = 0;
+            continue;
+        }
+        if (f->off) {
+            if (write_frame(pg, i) != 0) return -1;
+            hi_del(&pg->map, (int)(f->off / BT_PAGE));
+            f->off = 0;
+        }
+        return i;
+    }
+    return -1; // every frame is pinned
+}
+
+// pins page off and returns its data; fresh pages are zeroed instead of read.
+// A pinned page is never evicted, so concurrent readers may use it unlocked
+static char *get_page(BtPager *pg, long off, int fresh) {
+    int i = hi_find(&pg->map, (int)(off / BT_PAGE));
+    if (i < 0) {
+        i = victim(pg);
+        if (i < 0) return NULL;
+        if (fresh) {
+            memset(frame_data(pg, i), 0, BT_PAGE);
+        } else {
+            if (pread(pg->fd, frame_data(pg, i), BT_PAGE, off) != BT_PAGE) return NULL;
+            pg->reads++;
+        }
+        if (hi_put(&pg->map, (int)(off / BT_PAGE), i) != 0) return NULL;
+        pg->frames[i].off = off;
+        pg->frames[i].dirty = (char)fresh;
+    }
+    pg->frames[i].pin++;
+    pg->frames[i].ref = 1;
+    return frame_data(pg, i);
+}
+
+static char *pg_get(BtPager *pg, long off, int fresh) {
+    if (!pg->concurrent) return get_page(pg, off, fresh);
+    pthread_mutex_lock(&pg->lock);
+    char *p = get_page(pg, off, fresh);
+    pthread_mutex_unlock(&pg->lock);
+    return p;
+}
+
+// unpins a page returned by pg_get
+static void pg_put(BtPager *pg, char *p, int dirty) {
+    BtFrame *f = &pg->frames[(p - pg->mem) / BT_PAGE];
+    if (pg->concurrent) pthread_mutex_lock(&pg->lock);
+    f->pin--;
+    if (dirty) f->dirty = 1;
+    if (pg->concurrent) pthread_mutex_unlock(&pg->lock);
+}
+
+// allocates and pins a zeroed page
+static char *pg_new(BtPager *pg, long *off) {
+    *off = pg->alloc(pg->ctx);
+    return *off < 0 ? NULL : pg_get(pg, *off, 1);
+}
+
+int pg_flush(BtPager *pg) {
+    for (int i = 0; i < pg->nframes; i++) {
+        if (pg->frames[i].off && write_frame(pg, i) != 0) return -1;
+    }
+    return 0;
+}
+
+void pg_free(BtPager *pg) {
+    if (pg->frames) pthread_mutex_destroy(&pg->lock);
+    free(pg->frames);
+    free(pg->mem);
+    hi_free(&pg->map);
+    memset(pg, 0, sizeof(*pg));
+}
+
+// --- tree ---
+
+int bt_create(BTree *t, BtPager *pg, int vsize) {
+    t->pg = pg;
+    t->vsize = vsize;
+    char *p = pg_new(pg, &t->root);
+    if (!p) return -1;
+    HEAD(p)->leaf = 1;
+    pg_put(pg, p, 1);
+    return 0;
+}
+
+void bt_attach(BTree *t, BtPager *pg, long root, int vsize) {
+    t->pg = pg;
+    t->root = root;
+    t->vsize = vsize;
+}
+
+// number of keys in an inner page that are <= k, i.e. the child to descend into
+static int inner_pos(const char *p, BtKey k) {
+    const InnerEntry *e = INNER(p);
+    int lo = 0, hi = HEAD(p)->n;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (key_cmp(e[mid].k, k) <= 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static long inner_child(const char *p, int pos) {
+    return pos == 0 ? CHILD0(p) : INNER(p)[pos - 1].child;
+}
+
+// first entry of a leaf with key >= k
+static int leaf_pos(const BTree *t, const char *p, BtKey k) {
+    int lo = 0, hi = HEAD(p)->n;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (key_cmp(entry_key(ENTRY(t, p, mid)), k) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// descends to the leaf that may hold k; path (if not NULL) receives the inner pages
+static char *find_leaf(BTree *t, BtKey k, long *leaf, long *path, int *depth) {
+    long off = t->root;
+    int d = 0;
+    for (;;) {
+        char *p = pg_get(t->pg, off, 0);
+        if (!p || HEAD(p)->leaf) {
+            *leaf = off;
+            if (depth) *depth = d;
+            return p;
+        }
+        long next = inner_child(p, inner_pos(p, k));
+        pg_put(t->pg, p, 0);
+        if (d == BT_MAX_DEPTH) return NULL;
+        if (path) path[d] = off;
+        d++;
+        off = next;
+    }
+}
+
+int bt_find(BTree *t, BtKey k, void *val) {
+    long off;
+    char *p = find_leaf(t, k, &off, NULL, NULL);
+    if (!p) return -1;
+    int i = leaf_pos(t, p, k);
+    int found = i < HEAD(p)->n && key_cmp(entry_key(ENTRY(t, p, i)), k) == 0;
+    if (found && val) memcpy(val, ENTRY(t, p, i) + sizeof(BtKey), (size_t)t->vsize);
+    pg_put(t->pg, p, 0);
+    return found;
+}
+
+// splits a full leaf while inserting entry e at position i;
+// returns the first key of the new right leaf in *sep
+static int split_leaf(BTree *t, char *p, int i, const char *e, BtKey *sep, long *right) {
+    int esz = ESIZE(t);
+    int n = HEAD(p)->n;
+    char tmp[2 * BT_PAGE];
+    memcpy(tmp, ENTRY(t, p, 0), (size_t)i * esz);
+    memcpy(tmp + (size_t)i * esz, e, esz);
+    memcpy(tmp + (size_t)(i + 1) * esz, ENTRY(t, p, i), (size_t)(n - i) * esz);
+    char *r = pg_new(t->pg, right);
+    if (!r) return -1;
+    int h = (n + 1) / 2;
+    HEAD(r)->leaf = 1;
+    HEAD(r)->n = n + 1 - h;
+    HEAD(r)->next = HEAD(p)->next;
+    memcpy(ENTRY(t, r, 0), tmp + (size_t)h * esz, (size_t)(n + 1 - h) * esz);
+    HEAD(p)->n = h;
+    HEAD(p)->next = *right;
+    memcpy(ENTRY(t, p, 0), tmp, (size_t)h * esz);
+    *sep = entry_key(ENTRY(t, r, 0));
+    pg_put(t->pg, r, 1);
+    return 0;
+}
+
+// inserts (sep, child) into the inner page off; a full page is split and
+// its middle key is passed up through sep/child
+static int inner_insert(BTree *t, long off, BtKey *sep, long *child, int *split) {
+    char *p = pg_get(t->pg, off, 0);
+    if (!p) return -1;
+    int n = HEAD(p)->n;
+    int pos = inner_pos(p, *sep);
+    InnerEntry e = { *sep, *child };
+    if (n < INNER_CAP) {
+        memmove(INNER(p) + pos + 1, INNER(p) + pos, (size_t)(n - pos) * sizeof(InnerEntry));
+        INNER(p)[pos] = e;
+        HEAD(p)->n = n + 1;
+        pg_put(t->pg, p, 1);
+        *split = 0;
+        return 0;
+    }
+    InnerEntry tmp[INNER_CAP + 1];
+    memcpy(tmp, INNER(p), (size_t)pos * sizeof(InnerEntry));
+    tmp[pos] = e;
+    memcpy(tmp + pos + 1, INNER(p) + pos, (size_t)(n - pos) * sizeof(InnerEntry));
+    long roff;
+    char *r = pg_new(t->pg, &roff);
+    if (!r) {
+        pg_put(t->pg, p, 0);
+        return -1;
+    }
+    // tmp[h] moves up: its child becomes child 0 of the right page
+    int h = (n + 1) / 2;
+    HEAD(p)->n = h;
+    memcpy(INNER(p), tmp, (size_t)h * sizeof(InnerEntry));
+    CHILD0(r) = tmp[h].child;
+    HEAD(r)->n = n - h;
+    memcpy(INNER(r), tmp + h + 1, (size_t)(n - h) * sizeof(InnerEntry));
+    pg_put(t->pg, r, 1);
+    pg_put(t->pg, p, 1);
+    *sep = tmp[h].k;
+    *child = roff;
+    *split = 1;
+    return 0;
+}
+
+int bt_insert(BTree *t, BtKey k, const void *val) {
+    long path[BT_MAX_DEPTH];
+    int d;
+    long off;
+    char *p = find_leaf(t, k, &off, path, &d);
+    if (!p) return -1;
+    int esz = ESIZE(t);
+    int n = HEAD(p)->n;
+    int i = leaf_pos(t, p, k);
+    if (i < n && key_cmp(entry_key(ENTRY(t, p, i)), k) == 0) {
+        memcpy(ENTRY(t, p, i) + sizeof(BtKey), val, (size_t)t->vsize);
+        pg_put(t->pg, p, 1);
+        return 0;
+    }
+    if (n < LEAF_CAP(t)) {
+        memmove(ENTRY(t, p, i + 1), ENTRY(t, p, i), (size_t)(n - i) * esz);
+        memcpy(ENTRY(t, p, i), &k, sizeof(k));
+        memcpy(ENTRY(t, p, i) + sizeof(k), val, (size_t)t->vsize);
+        HEAD(p)->n = n + 1;
+        pg_put(t->pg, p, 1);
+        return 0;
+    }
+
+    // the leaf is full: split it and carry separators up the path
+    char e[BT_PAGE];
+    memcpy(e, &k, sizeof(k));
+    memcpy(e + sizeof(k), val, (size_t)t->vsize);
+    BtKey sep;
+    long child;
+    int res = split_leaf(t, p, i, e, &sep, &child);
+    pg_put(t->pg, p, 1);
+    if (res != 0) return -1;
+    int split = 1;
+    while (split && d > 0) {
+        if (inner_insert(t, path[--d], &sep, &child, &split) != 0) return -1;
+    }
+    if (!split) return 0;
+
+    // the root itself was split: the tree grows by one level
+    long root;
+    char *r = pg_new(t->pg, &root);
+    if (!r) return -1;
+    CHILD0(r) = t->root;
+    INNER(r)[0].k = sep;
+    INNER(r)[0].child = child;
+    HEAD(r)->n = 1;
+    pg_put(t->pg, r, 1);
+    t->root = root;
+    return 0;
+}
+
+int bt_delete(BTree *t, BtKey k) {
+    long off;
+    char *p = find_leaf(t, k, &off, NULL, NULL);
+    if (!p) return -1;
+    int esz = ESIZE(t);
+    int n = HEAD(p)->n;
+    int i = leaf_pos(t, p, k);
+    if (i >= n || key_cmp(entry_key(ENTRY(t, p, i)), k) != 0) {
+        pg_put(t->pg, p, 0);
+        return 0;
+    }
+    memmove(ENTRY(t, p, i), ENTRY(t, p, i + 1), (size_t)(n - i - 1) * esz);
+    HEAD(p)->n = n - 1;
+    pg_put(t->pg, p, 1);
+    return 1;
+}
+
+// the largest entry under page off; leaves left empty by deletions are
+// skipped by trying the children from right to left
+static int last_under(BTree *t, long off, int depth, BtKey *k, void *val) {
+    char *p = pg_get(t->pg, off, 0);
+    if (!p) return -1;
+    int n = HEAD(p)->n;
+    if (HEAD(p)->leaf) {
+        if (n > 0) {
+            const char *e = ENTRY(t, p, n - 1);
+            if (k) *k = entry_key(e);
+            if (val) memcpy(val, e + sizeof(BtKey), (size_t)t->vsize);
+        }
+        pg_put(t->pg, p, 0);
+        return n > 0;
+    }
+    pg_put(t->pg, p, 0);
+    if (depth == BT_MAX_DEPTH) return -1;
+    for (int pos = n; pos >= 0; pos--) {
+        // the page is not kept pinned while its children are read
+        if (!(p = pg_get(t->pg, off, 0))) return -1;
+        long child = inner_child(p, pos);
+        pg_put(t->pg, p, 0);
+        int res = last_under(t, child, depth + 1, k, val);
+        if (res != 0) return res;
+    }
+    return 0;
+}
+
+int bt_last(BTree *t, BtKey *k, void *val) {
+    return last_under(t, t->root, 0, k, val);
+}
+
+int bt_seek(BtIter *it, BTree *t, BtKey lo) {
+    long off;
+    char *p = find_leaf(t, lo, &off, NULL, NULL);
+    it->t = t;
+    it->page = 0;
+    if (!p) return -1;
+    it->page = off;
+    it->i = leaf_pos(t, p, lo);
+    pg_put(t->pg, p, 0);
+    return 0;
+}
+
+int bt_next(BtIter *it, BtKey *k, void *val) {
+    BTree *t = it->t;
+    while (it->page) {
+        char *p = pg_get(t->pg, it->page, 0);
+        if (!p) return -1;
+        if (it->i < HEAD(p)->n) {
+            const char *e = ENTRY(t, p, it->i++);
+            if (k) *k = entry_key(e);
+            if (val) memcpy(val, e + sizeof(BtKey), (size_t)t->vsize);
+            pg_put(t->pg, p, 0);
+            return 1;
+        }
+        // this leaf is done (or empty after deletions): go to the right sibling
+        it->page = HEAD(p)->next;
+        it->i = 0;
+        pg_put(t->pg, p, 0);
+    }
+    return 0;
+}
@@ -0,0 +1,123 @@
+#ifndef BTREE_H
+#define BTREE_H
+
+#include <pthread.h>
+#include "hash_index.h"
+
+// Страничное B+дерево внутри файла таблицы.
+// Узлы занимают страницы по BT_PAGE байт и читаются через кэш страниц
+// (BtPager) с фиксированным числом кадров, поэтому память не зависит
+// от размера дерева. Вытесняется давно не использованная незакреплённая
+// страница (алгоритм "часы"); изменённая страница перед вытеснением
+// записывается на своё место в файле.
+// Ключ — пара целых (a, b), упорядоченная по a, затем по b; значение —
+// vsize байт. Листья связаны в список по возрастанию ключей.
+// Удаление не объединяет страницы: опустевший лист остаётся в дереве.
+// С concurrent = 1 кэш защищён мьютексом, и поиск с обходами можно
+// вести из нескольких потоков (изменения дерева — только монопольно).
+
+#define BT_PAGE      4096 // размер страницы (и выравнивание в файле)
+#define BT_MIN_PAGES 16   // наименьшее число кадров кэша
+#define BT_MAX_DEPTH 32   // предельная высота дерева
+
+typedef struct {
+    int a;
+    int b;
+} BtKey;
+
+// Выделение новой страницы в файле: смещение, кратное BT_PAGE, или -1
+typedef long (*BtAllocFn)(void *ctx);
+
+typedef struct BtFrame BtFrame;
+
+typedef struct {
+    int       fd;      // файл (чтение и запись через pread/pwrite)
+    BtFrame  *frames;  // кадры кэша
+    char     *mem;     // данные кадров: nframes * BT_PAGE байт
+    int       nframes; // число кадров
+    int       hand;    // стрелка "часов"
+    HashIndex map;     // номер страницы (смещение / BT_PAGE) -> кадр
+    BtAllocFn alloc;   // выделение страниц
+    void     *ctx;     // контекст alloc
+    long      reads;   // прочитано страниц
+    long      writes;  // записано страниц
+    pthread_mutex_t lock; // защищает кадры и map при concurrent
+    int       concurrent; // 1 — кэш используют несколько потоков
+} BtPager;
+
+typedef struct {
+    BtPager *pg;
+    long     root;   // смещение корневой страницы
+    int      vsize;  // размер значения в байтах
+} BTree;
+
+// Позиция диапазонного обхода
+typedef struct {
+    BTree *t;
+    long   page;  // текущий лист или 0 — обход закончен
+    int    i;     // следующая запись листа
+} BtIter;
+
+/*
+ * Инициализация кэша на pages страниц (не меньше BT_MIN_PAGES)
+ * для файла fd. Возвращает 0 или -1 при нехватке памяти.
+ */
+int pg_init(BtPager *pg, int fd, int pages, BtAllocFn alloc, void *ctx);
+
+/*
+ * Записать все изменённые страницы. Возвращает 0 или -1.
+ */
+int pg_flush(BtPager *pg);
+
+/*
+ * Освобождение кэша (изменения не записываются).
+ */
+void pg_free(BtPager *pg);
+
+/*
+ * Создать пустое дерево (один лист). Возвращает 0 или -1.
+ */
+int bt_create(BTree *t, BtPager *pg, int vsize);
+
+/*
+ * Подключить существующее дерево с корнем root.
+ */
+void bt_attach(BTree *t, BtPager *pg, long root, int vsize);
+
+/*
+ * Найти ключ k и скопировать значение в val (может быть NULL).
+ * Возвращает 1 — найден, 0 — нет, -1 — ошибка ввода-вывода.
+ */
+int bt_find(BTree *t, BtKey k, void *val);
+
+/*
+ * Вставить k -> val или заменить значение существующего ключа.
+ * Может сменить t->root. Возвращает 0 или -1.
+ */
+int bt_insert(BTree *t, BtKey k, const void *val);
+
+/*
+ * Удалить ключ k. Возвращает 1 — удалён, 0 — не найден, -1 — ошибка.
+ */
+int bt_delete(BTree *t, BtKey k);
+
+/*
+ * Наибольший ключ дерева и его значение (k и val могут быть NULL).
+ * Опустевшие листья в конце дерева пропускаются.
+ * Возвращает 1, 0 — дерево пусто, -1 — ошибка.
+ */
+int bt_last(BTree *t, BtKey *k, void *val);
+
+/*
+ * Встать перед первым ключом >= lo. Возвращает 0 или -1.
+ * Дерево нельзя изменять, пока обход не закончен.
+ */
+int bt_seek(BtIter *it, BTree *t, BtKey lo);
+
+/*
+ * Следующая пара по возрастанию ключей (k и val могут быть NULL).
+ * Возвращает 1, 0 — записей больше нет, -1 — ошибка.
+ */
+int bt_next(BtIter *it, BtKey *k, void *val);
+
+#endif // BTREE_H
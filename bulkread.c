@@ -0,0 +1,116 @@
+#include "bulkread.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+struct BrSpan {
+    long off;
+    long len;
+    int  idx; // index of the request in want
+};
+
+static int cmp_span(const void *a, const void *b) {
+    long x = ((const BrSpan *)a)->off, y = ((const BrSpan *)b)->off;
+    return (x > y) - (x < y);
+}
+
+void br_init(BulkRead *b) {
+    memset(b, 0, sizeof(*b));
+}
+
+static int reserve(void **p, int *cap, int need, size_t elem) {
+    if (*cap >= need) return 0;
+    int c = *cap ? *cap : 64;
+    while (c < need) c *= 2;
+    void *q = realloc(*p, (size_t)c * elem);
+    if (!q) return -1;
+    *p = q;
+    *cap = c;
+    return 0;
+}
+
+int br_read(BulkRead *b, int fd, const BrRange *want, int n) {
+    if (n <= 0) return 0;
+    if (reserve((void **)&b->spans, &b->spancap, n, sizeof(BrSpan)) != 0 ||
+        reserve((void **)&b->pos, &b->poscap, n, sizeof(long)) != 0) {
+        return -1;
+    }
+    for (int i = 0; i < n; i++) {
+        b->spans[i].off = want[i].off;
+        b->spans[i].len = want[i].len;
+        b->spans[i].idx = i;
+    }
+    qsort(b->spans, n, sizeof(BrSpan), cmp_span);
+
+    // first pass: size of the buffer once close spans are merged
+    size_t total = 0;
+    long end = -1;
+    for (int i = 0; i < n; i++) {
+        const BrSpan *s = &b->spans[i];
+        if (end >= 0 && s->off <= end + BR_GAP) {
+            if (s->off + s->len > end) {
+                total += (size_t)(s->off + s->len - end);
+                end = s->off + s->len;
+            }
+        } else {
+            total += (size_t)s->len;
+            end = s->off + s->len;
+        }
+    }
+    if (b->cap < total) {
+        char *p = realloc(b->buf, total);
+        if (!p) return -1;
+        b->buf = p;
+        b->cap = total;
+    }
+
+    // second pass: one pread per merged run
+    size_t at = 0;
+    int i = 0;
+    while (i < n) {
+        long run_off = b->spans[i].off;
+        long run_end = run_off + b->spans[i].len;
+        int j = i + 1;
+        while (j < n && b->spans[j].off <= run_end + BR_GAP) {
+            if (b->spans[j].off + b->spans[j].len > run_end) run_end = b->spans[j].off + b->spans[j].len;
+            j++;
+        }
+        size_t len = (size_t)(run_end - run_off);
+        size_t got = 0;
+        while (got < len) {
+            ssize_t r = pread(fd, b->buf + at + got, len - got, run_off + (long)got);
+            if (r <= 0) return -1;
+            got += (size_t)r;
+            b->reads++;
+            b->bytes += r;
+        }
+        for (int k = i; k < j; k++) b->pos[b->spans[k].idx] = (long)at + (b->spans[k].off - run_off);
+        at += len;
+        i = j;
+    }
+    return 0;
+}
+
+int br_reserve(BulkRead *b, const BrRange *want, int n) {
+    if (n <= 0) return 0;
+    if (reserve((void **)&b->pos, &b->poscap, n, sizeof(long)) != 0) return -1;
+    size_t total = 0;
+    for (int i = 0; i < n; i++) {
+        b->pos[i] = (long)total;
+        total += (size_t)want[i].len;
+    }
+    if (b->cap < total) {
+        char *p = realloc(b->buf, total);
+        if (!p) return -1;
+        b->buf = p;
+        b->cap = total;
+    }
+    return 0;
+}
+
+void br_free(BulkRead *b) {
+    free(b->buf);
+    free(b->pos);
+    free(b->spans);
+    br_init(b);
+}
@@ -0,0 +1,57 @@
+#ifndef BULKREAD_H
+#define BULKREAD_H
+
+#include <stddef.h>
+
+// Пакетное чтение участков файла.
+// Запрошенные участки сортируются по смещению, соседние (и близкие,
+// с промежутком до BR_GAP байт) объединяются, и каждый объединённый
+// участок читается одним pread в общий буфер. Буфер и служебные
+// массивы переиспользуются между вызовами и только растут.
+
+#define BR_GAP 4096 // промежуток, который выгоднее прочитать, чем пропустить
+
+// Запрошенный участок [off, off + len)
+typedef struct {
+    long off;
+    long len;
+} BrRange;
+
+typedef struct BrSpan BrSpan;
+
+typedef struct {
+    char   *buf;     // прочитанные данные
+    size_t  cap;     // размер buf
+    long   *pos;     // pos[i] — начало i-го участка в buf
+    int     poscap;  // размер pos
+    BrSpan *spans;   // участки, отсортированные по смещению
+    int     spancap; // размер spans
+    long    reads;   // число вызовов pread (для оценки эффекта объединения)
+    long    bytes;   // прочитано байт (вместе с промежутками между участками)
+} BulkRead;
+
+/*
+ * Инициализация пустого читателя.
+ */
+void br_init(BulkRead *b);
+
+/*
+ * Прочитать n участков want из файла fd. После успешного вызова
+ * данные участка i лежат в b->buf + b->pos[i].
+ * Возвращает 0 или -1 (ошибка чтения или нехватка памяти).
+ */
+int br_read(BulkRead *b, int fd, const BrRange *want, int n);
+
+/*
+ * Разместить n участков want в буфере без чтения: данные участка i
+ * записывает вызывающий в b->buf + b->pos[i] (участки не перекрываются).
+ * Возвращает 0 или -1 при нехватке памяти.
+ */
+int br_reserve(BulkRead *b, const BrRange *want, int n);
+
+/*
+ * Освобождение памяти читателя.
+ */
+void br_free(BulkRead *b);
+
+#endif // BULKREAD_H
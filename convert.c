@@ -0,0 +1,69 @@
+#include "convert.h"
+#include <stdlib.h>
+
+typedef struct {
+    Table *t;
+    int    err;
+} ToMem;
+
+static int to_mem(const TfRow *row, void *ctx) {
+    ToMem *c = ctx;
+    c->err = tm_insert(c->t, row->key, row->par, row->info);
+    return c->err != TM_OK;
+}
+
+int tm_load_ftable(Table *t, FTable *ft) {
+    ToMem c = { t, TM_OK };
+    tm_init(t, ft->count);
+    int res = tf_descendants(ft, 0, to_mem, &c);
+    if (res != TMF_OK) res = TM_ERR_READ;
+    else if (c.err == TM_ERR_FULL) res = TM_ERR_FULL;
+    else if (c.err != TM_OK) res = TM_ERR_READ; // ft itself holds a broken tree
+    if (res != TM_OK) tm_free(t);
+    return res;
+}
+
+// rows are gathered into batches; their infos are borrowed from the table
+typedef struct {
+    FTable   *ft;
+    BatchRow *rows;
+    int      *errs;
+    int       n;
+    int       loaded;
+    int       res;
+} ToFile;
+
+static void flush_rows(ToFile *c) {
+    c->loaded += tf_insert_batch(c->ft, c->rows, c->n, c->errs);
+    for (int i = 0; i < c->n; i++) {
+        if (c->errs[i] == TMF_ERR_WRITE || c->errs[i] == TMF_ERR_READ) c->res = TMF_ERR_WRITE;
+        else if (c->errs[i] != TMF_OK && c->res == TMF_OK) c->res = TMF_ERR_INVALID;
+    }
+    c->n = 0;
+}
+
+static int to_file(const TmRow *row, void *ctx) {
+    ToFile *c = ctx;
+    BatchRow *r = &c->rows[c->n++];
+    r->key  = row->key;
+    r->par  = row->par;
+    r->info = row->info;
+    if (c->n == CONV_BATCH) flush_rows(c);
+    return 0;
+}
+
+int tf_load_table(FTable *ft, const Table *t, int *loaded) {
+    ToFile c = { ft, malloc(CONV_BATCH * sizeof(BatchRow)), malloc(CONV_BATCH * sizeof(int)), 0, 0, TMF_OK };
+    if (loaded) *loaded = 0;
+    if (!c.rows || !c.errs) {
+        free(c.rows);
+        free(c.errs);
+        return TMF_ERR_WRITE;
+    }
+    tm_descendants(t, 0, to_file, &c);
+    if (c.n > 0) flush_rows(&c);
+    free(c.rows);
+    free(c.errs);
+    if (loaded) *loaded = c.loaded;
+    return c.res;
+}
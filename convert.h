@@ -0,0 +1,34 @@
+#ifndef CONVERT_H
+#define CONVERT_H
+
+#include "table_mem.h"
+#include "table_file.h"
+
+// Перенос данных между таблицей в памяти (Table) и файловой (FTable).
+// Элементы читаются обходом всей таблицы в прямом порядке
+// (tm_descendants / tf_descendants с ключом 0), поэтому родитель
+// всегда приходит раньше потомков и вставляется первым.
+
+#define CONV_BATCH 4096 // элементов в одном пакете tf_insert_batch
+
+/*
+ * Загрузить все записи открытой файловой таблицы ft в t: t
+ * инициализируется (как tm_init) с ёмкостью под все записи ft,
+ * info читаются из файла пакетами. t не должна быть инициализирована;
+ * при ошибке она остаётся неинициализированной (освобождается).
+ * Возвращает TM_OK, TM_ERR_READ (ошибка чтения ft) или TM_ERR_FULL.
+ */
+int tm_load_ftable(Table *t, FTable *ft);
+
+/*
+ * Записать все элементы t в открытую таблицу ft пакетами по CONV_BATCH
+ * строк (info пакета дописываются в файл одной записью, см.
+ * tf_insert_batch). Элементы с ключами, которые уже есть в ft,
+ * пропускаются вместе с их поддеревьями. t не должна изменяться,
+ * пока идёт запись. loaded (может быть NULL) — число записанных.
+ * Возвращает TMF_OK, TMF_ERR_INVALID (часть элементов пропущена)
+ * или TMF_ERR_WRITE.
+ */
+int tf_load_table(FTable *ft, const Table *t, int *loaded);
+
+#endif // CONVERT_H
@@ -0,0 +1,235 @@
+#include "freemap.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define BY_OFF 0
+#define BY_LEN 1
+
+struct FmNode {
+    long     off;
+    long     len;
+    int      kid[2][2]; // kid[tree][0] — left, kid[tree][1] — right
+    unsigned prio;
+};
+
+#define N(i) (m->nodes[i])
+
+// strict order of nodes a and b in the given tree
+static int less(const FreeMap *m, int tree, int a, int b) {
+    if (tree == BY_LEN && N(a).len != N(b).len) return N(a).len < N(b).len;
+    return N(a).off < N(b).off;
+}
+
+static unsigned next_prio(FreeMap *m) {
+    // xorshift32
+    unsigned x = m->seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    m->seed = x;
+    return x;
+}
+
+// every key of a is below every key of b
+static int merge(FreeMap *m, int tree, int a, int b) {
+    if (a < 0) return b;
+    if (b < 0) return a;
+    if (N(a).prio > N(b).prio) {
+        N(a).kid[tree][1] = merge(m, tree, N(a).kid[tree][1], b);
+        return a;
+    }
+    N(b).kid[tree][0] = merge(m, tree, a, N(b).kid[tree][0]);
+    return b;
+}
+
+// splits t into nodes ordered before x (*l) and the rest (*r)
+static void split(FreeMap *m, int tree, int t, int x, int *l, int *r) {
+    if (t < 0) {
+        *l = *r = -1;
+    } else if (less(m, tree, t, x)) {
+        split(m, tree, N(t).kid[tree][1], x, &N(t).kid[tree][1], r);
+        *l = t;
+    } else {
+        split(m, tree, N(t).kid[tree][0], x, l, &N(t).kid[tree][0]);
+        *r = t;
+    }
+}
+
+static void tree_insert(FreeMap *m, int tree, int x) {
+    int l, r;
+    N(x).kid[tree][0] = N(x).kid[tree][1] = -1;
+    split(m, tree, m->root[tree], x, &l, &r);
+    m->root[tree] = merge(m, tree, merge(m, tree, l, x), r);
+}
+
+static int tree_erase(FreeMap *m, int tree, int t, int x) {
+    if (t == x) return merge(m, tree, N(t).kid[tree][0], N(t).kid[tree][1]);
+    int side = less(m, tree, t, x);
+    N(t).kid[tree][side] = tree_erase(m, tree, N(t).kid[tree][side], x);
+    return t;
+}
+
+static int node_new(FreeMap *m, long off, long len) {
+    if (m->free < 0) {
+        int cap = m->cap ? m->cap * 2 : 64;
+        FmNode *p = realloc(m->nodes, cap * sizeof(FmNode));
+        if (!p) return -1;
+        m->nodes = p;
+        for (int i = cap - 1; i >= m->cap; i--) {
+            p[i].kid[0][0] = m->free;
+            m->free = i;
+        }
+        m->cap = cap;
+    }
+    int x = m->free;
+    m->free = N(x).kid[0][0];
+    N(x).off  = off;
+    N(x).len  = len;
+    N(x).prio = next_prio(m);
+    return x;
+}
+
+static void add(FreeMap *m, int x) {
+    tree_insert(m, BY_OFF, x);
+    tree_insert(m, BY_LEN, x);
+    m->count++;
+    m->total += N(x).len;
+}
+
+// unlinks x from both trees and returns it to the pool
+static void drop(FreeMap *m, int x) {
+    m->root[BY_OFF] = tree_erase(m, BY_OFF, m->root[BY_OFF], x);
+    m->root[BY_LEN] = tree_erase(m, BY_LEN, m->root[BY_LEN], x);
+    m->count--;
+    m->total -= N(x).len;
+    N(x).kid[0][0] = m->free;
+    m->free = x;
+}
+
+// last extent starting at or before off, or -1
+static int floor_off(const FreeMap *m, long off) {
+    int best = -1;
+    for (int t = m->root[BY_OFF]; t >= 0;) {
+        if (N(t).off <= off) {
+            best = t;
+            t = N(t).kid[BY_OFF][1];
+        } else {
+            t = N(t).kid[BY_OFF][0];
+        }
+    }
+    return best;
+}
+
+// first extent starting after off, or -1
+static int above_off(const FreeMap *m, long off) {
+    int best = -1;
+    for (int t = m->root[BY_OFF]; t >= 0;) {
+        if (N(t).off > off) {
+            best = t;
+            t = N(t).kid[BY_OFF][0];
+        } else {
+            t = N(t).kid[BY_OFF][1];
+        }
+    }
+    return best;
+}
+
+void fm_init(FreeMap *m) {
+    memset(m, 0, sizeof(*m));
+    m->free = -1;
+    m->root[BY_OFF] = m->root[BY_LEN] = -1;
+    m->seed = 2463534242u;
+}
+
+int fm_put(FreeMap *m, long off, long len) {
+    if (len <= 0) return 0;
+    int p = floor_off(m, off);
+    int s = above_off(m, off);
+    if ((p >= 0 && N(p).off + N(p).len > off) || (s >= 0 && off + len > N(s).off)) return -1;
+    // coalesce with the neighbours that touch the new extent
+    if (p >= 0 && N(p).off + N(p).len == off) {
+        off = N(p).off;
+        len += N(p).len;
+        drop(m, p);
+    }
+    if (s >= 0 && off + len == N(s).off) {
+        len += N(s).len;
+        drop(m, s);
+    }
+    int x = node_new(m, off, len);
+    if (x < 0) return -1;
+    add(m, x);
+    return 0;
+}
+
+long fm_take(FreeMap *m, long len) {
+    // smallest extent with length >= len (ties: lowest offset)
+    int best = -1;
+    for (int t = m->root[BY_LEN]; t >= 0;) {
+        if (N(t).len >= len) {
+            best = t;
+            t = N(t).kid[BY_LEN][0];
+        } else {
+            t = N(t).kid[BY_LEN][1];
+        }
+    }
+    if (best < 0) return -1;
+    long off = N(best).off;
+    long rest = N(best).len - len;
+    drop(m, best);
+    if (rest > 0) {
+        // the node just dropped is reused, so this cannot fail
+        int x = node_new(m, off + len, rest);
+        add(m, x);
+    }
+    return off;
+}
+
+int fm_reserve(FreeMap *m, long off, long len) {
+    long end = off + len;
+    int t = floor_off(m, off);
+    if (t < 0 || N(t).off + N(t).len <= off) t = above_off(m, off);
+    // cut [off, end) out of every extent it overlaps
+    while (t >= 0 && N(t).off < end) {
+        long a = N(t).off, b = N(t).off + N(t).len;
+        int next = above_off(m, a);
+        drop(m, t);
+        if (a < off) {
+            int x = node_new(m, a, off - a);
+            if (x < 0) return -1;
+            add(m, x);
+        }
+        if (b > end) {
+            int x = node_new(m, end, b - end);
+            if (x < 0) return -1;
+            add(m, x);
+        }
+        t = next;
+    }
+    return 0;
+}
+
+long fm_trim(FreeMap *m, long end) {
+    int t = floor_off(m, end);
+    if (t >= 0 && N(t).off + N(t).len == end) {
+        end = N(t).off;
+        drop(m, t);
+    }
+    return end;
+}
+
+int fm_export(const FreeMap *m, FmExtent *out) {
+    int n = 0;
+    // offsets are never negative, so above_off(-1) is the first extent
+    for (int t = above_off(m, -1); t >= 0; t = above_off(m, N(t).off)) {
+        out[n].off = N(t).off;
+        out[n].len = N(t).len;
+        n++;
+    }
+    return n;
+}
+
+void fm_free(FreeMap *m) {
+    free(m->nodes);
+    fm_init(m);
+}
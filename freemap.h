@@ -0,0 +1,69 @@
+#ifndef FREEMAP_H
+#define FREEMAP_H
+
+// Карта свободных участков файла (для кучи info файловой таблицы).
+// Участки хранятся в двух декартовых деревьях (treap) над общим пулом
+// узлов: по смещению — для поиска соседей и слияния смежных участков,
+// по паре (длина, смещение) — для выбора наименьшего подходящего
+// участка (best fit). Все операции — O(log n) в среднем.
+
+// Свободный участок [off, off + len)
+typedef struct {
+    long off;
+    long len;
+} FmExtent;
+
+typedef struct FmNode FmNode;
+
+typedef struct {
+    FmNode  *nodes;    // пул узлов
+    int      cap;      // размер пула
+    int      free;     // первый свободный узел пула или -1
+    int      root[2];  // корни: [0] — по смещению, [1] — по длине
+    int      count;    // число участков
+    long     total;    // суммарная длина участков
+    unsigned seed;     // состояние генератора приоритетов
+} FreeMap;
+
+/*
+ * Инициализация пустой карты.
+ */
+void fm_init(FreeMap *m);
+
+/*
+ * Освободить участок [off, off + len); смежные участки сливаются.
+ * Возвращает 0 или -1 (нехватка памяти или участок пересекается
+ * с уже свободным — повторное освобождение).
+ */
+int fm_put(FreeMap *m, long off, long len);
+
+/*
+ * Выделить len байт из наименьшего подходящего участка
+ * (остаток остаётся свободным). Возвращает смещение или -1.
+ */
+long fm_take(FreeMap *m, long len);
+
+/*
+ * Пометить занятым участок [off, off + len), если он свободен
+ * (целиком или частично). Возвращает 0 или -1 при нехватке памяти.
+ */
+int fm_reserve(FreeMap *m, long off, long len);
+
+/*
+ * Убрать из карты участок, который заканчивается ровно в end
+ * (хвост файла). Возвращает новый конец занятой части.
+ */
+long fm_trim(FreeMap *m, long end);
+
+/*
+ * Записать участки в out в порядке смещений (out — не меньше count
+ * элементов). Возвращает число участков.
+ */
+int fm_export(const FreeMap *m, FmExtent *out);
+
+/*
+ * Освобождение памяти карты.
+ */
+void fm_free(FreeMap *m);
+
+#endif // FREEMAP_H
@@ -0,0 +1,152 @@
+#include "hash_index.h"
+#include <stdlib.h>
+
+#define HI_EMPTY    0
+#define HI_DELETED -1
+#define HI_MIN_CAP 16
+
+static unsigned hash_key(int key) {
+    unsigned x = (unsigned)key;
+    // multiplicative hashing, good spread for sequential keys
+    x ^= x >> 16;
+    x *= 0x45d9f3bu;
+    x ^= x >> 16;
+    return x;
+}
+
+static int alloc_entries(HashIndex *h, int cap) {
+    h->entries = calloc(cap, sizeof(HashEntry));
+    if (!h->entries) return -1;
+    h->cap   = cap;
+    h->used  = 0;
+    h->count = 0;
+    h->external = 0;
+    return 0;
+}
+
+int hi_init(HashIndex *h, int hint) {
+    int cap = HI_MIN_CAP;
+    // keep load factor below 0.7 for the expected number of keys
+    while (cap < hint + hint / 2 + 1 && cap < (1 << 30)) cap <<= 1;
+    return alloc_entries(h, cap);
+}
+
+int hi_find(const HashIndex *h, int key) {
+    if (!h->entries || key <= 0) return -1;
+    unsigned mask = (unsigned)h->cap - 1;
+    unsigned i = hash_key(key) & mask;
+    while (h->entries[i].key != HI_EMPTY) {
+        if (h->entries[i].key == key) return h->entries[i].slot;
+        i = (i + 1) & mask;
+    }
+    return -1;
+}
+
+static void move_entries(HashIndex *h, const HashEntry *old, int old_cap) {
+    unsigned mask = (unsigned)h->cap - 1;
+    for (int j = 0; j < old_cap; j++) {
+        if (old[j].key <= 0) continue; // skip empty and tombstones
+        unsigned i = hash_key(old[j].key) & mask;
+        while (h->entries[i].key != HI_EMPTY) i = (i + 1) & mask;
+        h->entries[i] = old[j];
+        h->used++;
+        h->count++;
+    }
+}
+
+static int rehash(HashIndex *h, int cap) {
+    HashEntry *old = h->entries;
+    int old_cap = h->cap;
+    if (alloc_entries(h, cap) != 0) {
+        h->entries = old;
+        h->cap = old_cap;
+        return -1;
+    }
+    move_entries(h, old, old_cap);
+    free(old);
+    return 0;
+}
+
+int hi_grow_cap(const HashIndex *h) {
+    if (!h->entries) return HI_MIN_CAP;
+    // grow (or just drop tombstones) before the table gets too dense
+    if ((long long)(h->used + 1) * 10 < (long long)h->cap * 7) return 0;
+    int cap = h->cap;
+    if ((long long)(h->count + 1) * 10 >= (long long)cap * 4) cap <<= 1;
+    return cap;
+}
+
+void hi_attach(HashIndex *h, HashEntry *entries, int cap, int used, int count, int owned) {
+    h->entries  = entries;
+    h->cap      = cap;
+    h->used     = used;
+    h->count    = count;
+    h->external = !owned;
+}
+
+void hi_rehash_into(HashIndex *h, HashEntry *entries, int cap) {
+    const HashEntry *old = h->entries;
+    int old_cap = old ? h->cap : 0;
+    h->entries = entries;
+    h->cap     = cap;
+    h->used    = 0;
+    h->count   = 0;
+    move_entries(h, old, old_cap);
+}
+
+int hi_put(HashIndex *h, int key, int slot) {
+    if (key <= 0) return -1;
+    int cap = hi_grow_cap(h);
+    if (cap) {
+        // external storage is resized by its owner only
+        if (h->external) return -1;
+        if (!h->entries) {
+            if (hi_init(h, 0) != 0) return -1;
+        } else if (rehash(h, cap) != 0) {
+            return -1;
+        }
+    }
+    unsigned mask = (unsigned)h->cap - 1;
+    unsigned i = hash_key(key) & mask;
+    int tomb = -1;
+    while (h->entries[i].key != HI_EMPTY) {
+        if (h->entries[i].key == key) {
+            h->entries[i].slot = slot;
+            return 0;
+        }
+        if (h->entries[i].key == HI_DELETED && tomb < 0) tomb = (int)i;
+        i = (i + 1) & mask;
+    }
+    if (tomb >= 0) {
+        i = (unsigned)tomb; // reuse the first tombstone on the probe path
+    } else {
+        h->used++;
+    }
+    h->entries[i].key  = key;
+    h->entries[i].slot = slot;
+    h->count++;
+    return 0;
+}
+
+void hi_del(HashIndex *h, int key) {
+    if (!h->entries || key <= 0) return;
+    unsigned mask = (unsigned)h->cap - 1;
+    unsigned i = hash_key(key) & mask;
+    while (h->entries[i].key != HI_EMPTY) {
+        if (h->entries[i].key == key) {
+            h->entries[i].key = HI_DELETED;
+            h->count--;
+            return;
+        }
+        i = (i + 1) & mask;
+    }
+}
+
+void hi_free(HashIndex *h) {
+    if (!h->external) free(h->entries);
+    h->entries = NULL;
+    h->cap     = 0;
+    h->used    = 0;
+    h->count   = 0;
+    h->external = 0;
+}
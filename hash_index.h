@@ -0,0 +1,70 @@
+#ifndef HASH_INDEX_H
+#define HASH_INDEX_H
+
+// Хеш-индекс "ключ -> номер слота" с открытой адресацией
+// (линейное пробирование). Ключи таблиц всегда > 0, поэтому
+// 0 обозначает пустую ячейку, а -1 — удалённую (tombstone).
+
+typedef struct {
+    int key;   // ключ записи, 0 — пусто, -1 — удалено
+    int slot;  // индекс слота в таблице
+} HashEntry;
+
+typedef struct {
+    HashEntry *entries; // массив ячеек, размер — степень двойки
+    int        cap;     // число ячеек
+    int        used;    // занятые ячейки вместе с tombstone
+    int        count;   // число живых ключей
+    int        external;// 1 — ячейки принадлежат владельцу индекса (hi_attach)
+} HashIndex;
+
+/*
+ * Инициализация индекса под ожидаемое число ключей hint.
+ * Возвращает 0 или -1 при нехватке памяти.
+ */
+int hi_init(HashIndex *h, int hint);
+
+/*
+ * Поиск слота по ключу. Возвращает индекс слота или -1.
+ */
+int hi_find(const HashIndex *h, int key);
+
+/*
+ * Добавить (или обновить) пару key -> slot.
+ * Возвращает 0 или -1 при нехватке памяти.
+ */
+int hi_put(HashIndex *h, int key, int slot);
+
+/*
+ * Удалить ключ из индекса (если он есть).
+ */
+void hi_del(HashIndex *h, int key);
+
+/*
+ * Освобождение памяти индекса.
+ */
+void hi_free(HashIndex *h);
+
+/*
+ * Подключить индекс к готовому массиву ячеек (например, прочитанному
+ * из файла или отображённому в память). owned = 1 — массив выделен
+ * malloc и переходит во владение индекса; owned = 0 — массив чужой:
+ * индекс сам память не выделяет и не освобождает, поэтому перед hi_put
+ * владелец проверяет hi_grow_cap и при необходимости переносит индекс
+ * в новый массив через hi_rehash_into.
+ */
+void hi_attach(HashIndex *h, HashEntry *entries, int cap, int used, int count, int owned);
+
+/*
+ * Число ячеек, до которого нужно перестроить индекс перед следующей
+ * вставкой, или 0, если места достаточно.
+ */
+int hi_grow_cap(const HashIndex *h);
+
+/*
+ * Перенести ключи в обнулённый массив entries из cap ячеек
+ * (cap — степень двойки). Старый массив не освобождается.
+ */
+void hi_rehash_into(HashIndex *h, HashEntry *entries, int cap);
+
+#endif // HASH_INDEX_H
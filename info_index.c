@@ -0,0 +1,367 @@
+#include "info_index.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define II_MIN_CAP     16
+#define II_COMPACT_MIN 64 // dead entries tolerated regardless of the live count
+
+static unsigned mix(unsigned x) {
+    x ^= x >> 16;
+    x *= 0x45d9f3bu;
+    x ^= x >> 16;
+    return x;
+}
+
+static int gram_at(const char *s) {
+    const unsigned char *u = (const unsigned char *)s;
+    return (u[0] << 16) | (u[1] << 8) | u[2];
+}
+
+int ii_init(InfoIndex *ix, int hint) {
+    ix->e     = NULL;
+    ix->n     = 0;
+    ix->cap   = 0;
+    ix->live  = 0;
+    ix->root  = -1;
+    ix->grams = NULL;
+    ix->gcap  = 0;
+    ix->gused = 0;
+    ix->seed  = 0x9e3779b9u;
+    return hi_init(&ix->keys, hint);
+}
+
+void ii_free(InfoIndex *ix) {
+    for (int i = 0; i < ix->n; i++) free(ix->e[i].text);
+    for (int i = 0; i < ix->gcap; i++) free(ix->grams[i].ids);
+    free(ix->e);
+    free(ix->grams);
+    hi_free(&ix->keys);
+    ix->e = NULL;
+    ix->grams = NULL;
+    ix->n = ix->cap = ix->live = ix->gcap = ix->gused = 0;
+    ix->root = -1;
+}
+
+// --- treap ordered by (text, key) ---
+
+// the leading bytes as a number that orders like strcmp (zero padded)
+static uint64_t head_of(const char *s) {
+    uint64_t h = 0;
+    int i = 0;
+    for (; i < 8 && s[i]; i++) h = h << 8 | (unsigned char)s[i];
+    for (; i < 8; i++) h <<= 8;
+    return h;
+}
+
+static int less(const IiEntry *e, int a, int b) {
+    // most comparisons are settled by the heads, without touching the texts
+    if (e[a].head != e[b].head) return e[a].head < e[b].head;
+    int c = e[a].head & 0xff ? strcmp(e[a].text + 8, e[b].text + 8) : 0;
+    return c ? c < 0 : e[a].key < e[b].key;
+}
+
+static int tr_insert(IiEntry *e, int t, int id) {
+    if (t < 0) return id;
+    if (less(e, id, t)) {
+        int l = e[t].left = tr_insert(e, e[t].left, id);
+        if (e[l].prio > e[t].prio) { // rotate right
+            e[t].left = e[l].right;
+            e[l].right = t;
+            return l;
+        }
+    } else {
+        int r = e[t].right = tr_insert(e, e[t].right, id);
+        if (e[r].prio > e[t].prio) { // rotate left
+            e[t].right = e[r].left;
+            e[r].left = t;
+            return r;
+        }
+    }
+    return t;
+}
+
+static int tr_merge(IiEntry *e, int a, int b) {
+    if (a < 0) return b;
+    if (b < 0) return a;
+    if (e[a].prio > e[b].prio) {
+        e[a].right = tr_merge(e, e[a].right, b);
+        return a;
+    }
+    e[b].left = tr_merge(e, a, e[b].left);
+    return b;
+}
+
+static int tr_delete(IiEntry *e, int t, int id) {
+    if (t < 0) return t; // appended, the tree is not built yet
+    if (t == id) return tr_merge(e, e[t].left, e[t].right);
+    if (less(e, id, t)) e[t].left = tr_delete(e, e[t].left, id);
+    else e[t].right = tr_delete(e, e[t].right, id);
+    return t;
+}
+
+// --- trigram posting lists ---
+
+static IiPosting *find_gram(const InfoIndex *ix, int g) {
+    if (ix->gcap == 0) return NULL;
+    unsigned mask = (unsigned)ix->gcap - 1;
+    for (unsigned i = mix((unsigned)g) & mask; ix->grams[i].gram; i = (i + 1) & mask) {
+        if (ix->grams[i].gram == g + 1) return &ix->grams[i];
+    }
+    return NULL;
+}
+
+static int grow_grams(InfoIndex *ix) {
+    int cap = ix->gcap ? ix->gcap * 2 : 256;
+    IiPosting *g = calloc((size_t)cap, sizeof(IiPosting));
+    if (!g) return -1;
+    unsigned mask = (unsigned)cap - 1;
+    for (int q = 0; q < ix->gcap; q++) {
+        if (!ix->grams[q].gram) continue;
+        unsigned i = mix((unsigned)(ix->grams[q].gram - 1)) & mask;
+        while (g[i].gram) i = (i + 1) & mask;
+        g[i] = ix->grams[q];
+    }
+    free(ix->grams);
+    ix->grams = g;
+    ix->gcap = cap;
+    return 0;
+}
+
+static IiPosting *add_gram(InfoIndex *ix, int g) {
+    IiPosting *p = find_gram(ix, g);
+    if (p) return p;
+    // keep the load factor at or below one half
+    if ((ix->gused + 1) * 2 > ix->gcap && grow_grams(ix) != 0) return NULL;
+    unsigned mask = (unsigned)ix->gcap - 1;
+    unsigned i = mix((unsigned)g) & mask;
+    while (ix->grams[i].gram) i = (i + 1) & mask;
+    ix->grams[i].gram = g + 1;
+    ix->gused++;
+    return &ix->grams[i];
+}
+
+static int post(IiPosting *p, int id) {
+    // ids arrive in increasing order, so a repeated trigram of one text is the last id
+    if (p->n > 0 && p->ids[p->n - 1] == id) return 0;
+    if (p->n == p->cap) {
+        int cap = p->cap ? p->cap * 2 : 4;
+        int *ids = realloc(p->ids, (size_t)cap * sizeof(int));
+        if (!ids) return -1;
+        p->ids = ids;
+        p->cap = cap;
+    }
+    p->ids[p->n++] = id;
+    return 0;
+}
+
+// renumbers the entries without the removed ones; the treap, the key map
+// and the posting lists are remapped in place (only the key map is rebuilt)
+static void compact(InfoIndex *ix) {
+    int *map = malloc((size_t)ix->n * sizeof(int));
+    HashIndex keys;
+    if (!map || hi_init(&keys, ix->live) != 0) {
+        free(map);
+        return; // keep the dead entries for now
+    }
+    int m = 0;
+    for (int i = 0; i < ix->n; i++) map[i] = ix->e[i].text ? m++ : -1;
+    for (int i = 0; i < ix->n; i++) {
+        if (map[i] < 0 || hi_put(&keys, ix->e[i].key, map[i]) == 0) continue;
+        hi_free(&keys);
+        free(map);
+        return;
+    }
+    for (int i = 0; i < ix->n; i++) {
+        if (map[i] < 0) continue;
+        IiEntry *d = &ix->e[map[i]];
+        *d = ix->e[i]; // map[i] <= i: moves never overwrite unread entries
+        // children are live: removed entries have already left the treap
+        if (d->left >= 0) d->left = map[d->left];
+        if (d->right >= 0) d->right = map[d->right];
+    }
+    if (ix->root >= 0) ix->root = map[ix->root];
+    for (int q = 0; q < ix->gcap; q++) {
+        IiPosting *p = &ix->grams[q];
+        int k = 0;
+        // the map is increasing, so the lists stay sorted
+        for (int j = 0; j < p->n; j++) {
+            if (map[p->ids[j]] >= 0) p->ids[k++] = map[p->ids[j]];
+        }
+        p->n = k;
+    }
+    hi_free(&ix->keys);
+    ix->keys = keys;
+    ix->n = m;
+    free(map);
+}
+
+// a new entry with its trigrams posted, not yet in the treap; -1 on failure
+static int append(InfoIndex *ix, int key, const char *info) {
+    if (ix->n == ix->cap) {
+        int cap = ix->cap ? ix->cap * 2 : II_MIN_CAP;
+        IiEntry *e = realloc(ix->e, (size_t)cap * sizeof(IiEntry));
+        if (!e) return -1;
+        ix->e = e;
+        ix->cap = cap;
+    }
+    int id = ix->n;
+    IiEntry *d = &ix->e[id];
+    d->text = strdup(info);
+    if (!d->text) return -1;
+    if (hi_put(&ix->keys, key, id) != 0) {
+        free(d->text);
+        return -1;
+    }
+    ix->n++;
+    for (const char *s = info; s[0] && s[1] && s[2]; s++) {
+        IiPosting *p = add_gram(ix, gram_at(s));
+        if (!p || post(p, id) != 0) {
+            // the ids already posted point to a removed entry
+            hi_del(&ix->keys, key);
+            free(d->text);
+            d->text = NULL;
+            return -1;
+        }
+    }
+    d->head  = head_of(info);
+    d->key   = key;
+    d->left  = d->right = -1;
+    ix->seed ^= ix->seed << 13; // xorshift32
+    ix->seed ^= ix->seed >> 17;
+    ix->seed ^= ix->seed << 5;
+    d->prio  = ix->seed;
+    ix->live++;
+    return id;
+}
+
+int ii_add(InfoIndex *ix, int key, const char *info) {
+    int id = append(ix, key, info);
+    if (id < 0) return -1;
+    ix->root = tr_insert(ix->e, ix->root, id);
+    return 0;
+}
+
+int ii_append(InfoIndex *ix, int key, const char *info) {
+    return append(ix, key, info) < 0 ? -1 : 0;
+}
+
+// what less() needs, next to each other for the sort
+typedef struct {
+    uint64_t    head;
+    const char *text;
+    int         key;
+    int         id;
+} SortRec;
+
+static int cmp_rec(const void *a, const void *b) {
+    const SortRec *x = a, *y = b;
+    if (x->head != y->head) return x->head < y->head ? -1 : 1;
+    int c = x->head & 0xff ? strcmp(x->text + 8, y->text + 8) : 0;
+    return c ? c : (x->key > y->key) - (x->key < y->key);
+}
+
+int ii_build(InfoIndex *ix) {
+    SortRec *recs = malloc((size_t)ix->live * sizeof(SortRec) + 1);
+    int *stack = malloc((size_t)ix->live * sizeof(int) + 1);
+    if (!recs || !stack) {
+        free(recs);
+        free(stack);
+        return -1;
+    }
+    int n = 0;
+    for (int i = 0; i < ix->n; i++) {
+        if (!ix->e[i].text) continue;
+        recs[n].head = ix->e[i].head;
+        recs[n].text = ix->e[i].text;
+        recs[n].key  = ix->e[i].key;
+        recs[n++].id = i;
+    }
+    // the texts are touched only on ties of the heads
+    qsort(recs, (size_t)n, sizeof(SortRec), cmp_rec);
+    // Cartesian tree of the sorted run: the right spine sits on a stack
+    int top = 0;
+    for (int q = 0; q < n; q++) {
+        IiEntry *d = &ix->e[recs[q].id];
+        int last = -1;
+        while (top > 0 && ix->e[stack[top - 1]].prio < d->prio) last = stack[--top];
+        d->left = last;
+        d->right = -1;
+        if (top > 0) ix->e[stack[top - 1]].right = recs[q].id;
+        stack[top++] = recs[q].id;
+    }
+    ix->root = top > 0 ? stack[0] : -1;
+    free(recs);
+    free(stack);
+    return 0;
+}
+
+void ii_del(InfoIndex *ix, int key) {
+    int id = hi_find(&ix->keys, key);
+    if (id < 0) return;
+    ix->root = tr_delete(ix->e, ix->root, id);
+    free(ix->e[id].text);
+    ix->e[id].text = NULL;
+    hi_del(&ix->keys, key);
+    ix->live--;
+    int dead = ix->n - ix->live;
+    if (dead > ix->live && dead >= II_COMPACT_MIN) compact(ix);
+}
+
+typedef struct {
+    const IiEntry *e;
+    const char    *p;
+    size_t         len;
+    IiFn           fn;
+    void          *ctx;
+    long           seen;
+} PrefixWalk;
+
+// in-order walk of the entries starting with w->p; 1 once fn asks to stop
+static int walk_prefix(PrefixWalk *w, int t) {
+    while (t >= 0) {
+        w->seen++;
+        int c = strncmp(w->e[t].text, w->p, w->len);
+        if (c < 0) {
+            t = w->e[t].right;
+        } else if (c > 0) {
+            t = w->e[t].left;
+        } else {
+            // matches sort between the smaller and the bigger ones
+            if (walk_prefix(w, w->e[t].left)) return 1;
+            if (w->fn(w->e[t].key, w->e[t].text, w->ctx)) return 1;
+            t = w->e[t].right;
+        }
+    }
+    return 0;
+}
+
+long ii_prefix(const InfoIndex *ix, const char *prefix, IiFn fn, void *ctx) {
+    PrefixWalk w = { ix->e, prefix, strlen(prefix), fn, ctx, 0 };
+    walk_prefix(&w, ix->root);
+    return w.seen;
+}
+
+long ii_substr(const InfoIndex *ix, const char *s, IiFn fn, void *ctx) {
+    size_t len = strlen(s);
+    const int *ids = NULL;
+    int n = ix->n;
+    if (len >= II_GRAM) {
+        // every match is in the list of each trigram of s: take the shortest
+        const IiPosting *best = NULL;
+        for (size_t i = 0; i + II_GRAM <= len; i++) {
+            const IiPosting *p = find_gram(ix, gram_at(s + i));
+            if (!p) return 0;
+            if (!best || p->n < best->n) best = p;
+        }
+        ids = best->ids;
+        n = best->n;
+    }
+    long seen = 0;
+    for (int q = 0; q < n; q++) {
+        const IiEntry *d = &ix->e[ids ? ids[q] : q];
+        if (!d->text) continue;
+        seen++;
+        if (strstr(d->text, s) && fn(d->key, d->text, ctx)) break;
+    }
+    return seen;
+}
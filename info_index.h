@@ -0,0 +1,94 @@
+#ifndef INFO_INDEX_H
+#define INFO_INDEX_H
+
+#include <stdint.h>
+#include "hash_index.h"
+
+// Вторичный индекс по строкам info (в памяти, общий для Table и FTable).
+// Индекс хранит копии строк по ключам и две структуры над ними:
+// - декартово дерево (treap), упорядоченное по (info, key), — для поиска
+//   по префиксу: спуск за O(log n) и обход подходящего диапазона;
+// - инвертированный индекс триграмм: для каждой тройки байт — номера
+//   записей, в которых она встречается, по возрастанию. Подстрока
+//   ищется по самому короткому из списков своих триграмм, кандидаты
+//   проверяются strstr; строки короче 3 байт проверяются перебором.
+// Удаление убирает запись из дерева сразу, а из списков триграмм —
+// лениво: номер записи остаётся в списках, пока удалённых записей не
+// станет больше живых, после чего номера уплотняются одним проходом.
+
+#define II_GRAM 3 // длина n-граммы
+
+typedef struct {
+    uint64_t head;        // первые 8 байт info (старший байт — первый) для сравнений
+    int      key;
+    int      left, right; // потомки в дереве, -1 — нет
+    unsigned prio;        // приоритет кучи дерева
+    char    *text;        // копия info или NULL — запись удалена
+} IiEntry;
+
+typedef struct {
+    int  gram;  // триграмма + 1, 0 — пустая ячейка
+    int  n, cap;
+    int *ids;   // номера записей по возрастанию
+} IiPosting;
+
+typedef struct {
+    IiEntry   *e;     // записи в порядке добавления
+    int        n;     // занято записей (вместе с удалёнными)
+    int        cap;
+    int        live;  // живых записей
+    int        root;  // корень дерева или -1
+    HashIndex  keys;  // ключ -> номер записи
+    IiPosting *grams; // списки триграмм (открытая адресация)
+    int        gcap;  // число ячеек, степень двойки
+    int        gused;
+    unsigned   seed;  // генератор приоритетов
+} InfoIndex;
+
+// Обработчик найденной записи; ненулевой результат прекращает обход
+typedef int (*IiFn)(int key, const char *info, void *ctx);
+
+/*
+ * Инициализация пустого индекса под hint записей.
+ * Возвращает 0 или -1 при нехватке памяти.
+ */
+int ii_init(InfoIndex *ix, int hint);
+
+/*
+ * Освобождение памяти индекса.
+ */
+void ii_free(InfoIndex *ix);
+
+/*
+ * Добавить строку info ключа key (ключа в индексе ещё нет).
+ * Возвращает 0 или -1 при нехватке памяти (индекс не изменён).
+ */
+int ii_add(InfoIndex *ix, int key, const char *info);
+
+/*
+ * Массовое построение: ii_append добавляет строку, не вставляя её
+ * в дерево, а ii_build один раз строит дерево из всех записей
+ * сортировкой (быстрее, чем n вставок ii_add). До ii_build поиск по
+ * префиксу видит не все записи, а ii_del не вызывается. Возвращают 0 или -1 при нехватке памяти.
+ */
+int ii_append(InfoIndex *ix, int key, const char *info);
+int ii_build(InfoIndex *ix);
+
+/*
+ * Удалить ключ из индекса (если он есть).
+ */
+void ii_del(InfoIndex *ix, int key);
+
+/*
+ * Вызвать fn для записей, info которых начинается с prefix,
+ * по возрастанию (info, key). Возвращает число просмотренных записей.
+ */
+long ii_prefix(const InfoIndex *ix, const char *prefix, IiFn fn, void *ctx);
+
+/*
+ * Вызвать fn для записей, info которых содержит s, в порядке
+ * добавления. Возвращает число проверенных кандидатов.
+ */
+long ii_substr(const InfoIndex *ix, const char *s, IiFn fn, void *ctx);
+
+#endif // INFO_INDEX_H
@@ -0,0 +1,120 @@
+#include "infocache.h"
+#include <stdlib.h>
+#include <string.h>
+
+struct IcEntry {
+    int      key;
+    int      prev;   // towards head, or -1
+    int      next;   // towards tail; chains free entries too
+    int      len;
+    unsigned epoch;  // window of the last ic_get/ic_put
+    char    *data;
+};
+
+#define E(i) (c->e[i])
+
+static void unlink_entry(InfoCache *c, int i) {
+    if (E(i).prev >= 0) E(E(i).prev).next = E(i).next;
+    else c->head = E(i).next;
+    if (E(i).next >= 0) E(E(i).next).prev = E(i).prev;
+    else c->tail = E(i).prev;
+}
+
+static void push_front(InfoCache *c, int i) {
+    E(i).prev = -1;
+    E(i).next = c->head;
+    if (c->head >= 0) E(c->head).prev = i;
+    c->head = i;
+    if (c->tail < 0) c->tail = i;
+}
+
+static void evict(InfoCache *c, int i) {
+    unlink_entry(c, i);
+    hi_del(&c->map, E(i).key);
+    c->bytes -= (size_t)E(i).len + 1;
+    free(E(i).data);
+    E(i).data = NULL;
+    E(i).next = c->free;
+    c->free = i;
+}
+
+int ic_init(InfoCache *c, size_t budget) {
+    memset(c, 0, sizeof(*c));
+    c->free = c->head = c->tail = -1;
+    c->budget = budget;
+    return hi_init(&c->map, 0);
+}
+
+void ic_begin(InfoCache *c) {
+    c->epoch++;
+}
+
+const char *ic_get(InfoCache *c, int key) {
+    if (c->budget == 0) return NULL;
+    int i = hi_find(&c->map, key);
+    if (i < 0) {
+        c->misses++;
+        return NULL;
+    }
+    c->hits++;
+    unlink_entry(c, i);
+    push_front(c, i);
+    E(i).epoch = c->epoch;
+    return E(i).data;
+}
+
+void ic_put(InfoCache *c, int key, const char *data, int len) {
+    size_t need = (size_t)len + 1;
+    if (c->budget == 0 || need > c->budget) return;
+    ic_drop(c, key);
+    // evict from the cold end, but never an entry pinned in this window
+    while (c->bytes + need > c->budget) {
+        if (c->tail < 0 || E(c->tail).epoch == c->epoch) return;
+        evict(c, c->tail);
+    }
+    char *p = malloc(need);
+    if (!p) return;
+    if (c->free < 0) {
+        int cap = c->cap ? c->cap * 2 : 64;
+        IcEntry *e = realloc(c->e, cap * sizeof(IcEntry));
+        if (!e) {
+            free(p);
+            return;
+        }
+        c->e = e;
+        for (int i = cap - 1; i >= c->cap; i--) {
+            e[i].data = NULL;
+            e[i].next = c->free;
+            c->free = i;
+        }
+        c->cap = cap;
+    }
+    int i = c->free;
+    if (hi_put(&c->map, key, i) != 0) {
+        free(p);
+        return;
+    }
+    c->free = E(i).next;
+    memcpy(p, data, (size_t)len);
+    p[len] = '\0';
+    E(i).key   = key;
+    E(i).len   = len;
+    E(i).data  = p;
+    E(i).epoch = c->epoch;
+    push_front(c, i);
+    c->bytes += need;
+}
+
+void ic_drop(InfoCache *c, int key) {
+    if (c->budget == 0) return;
+    int i = hi_find(&c->map, key);
+    if (i >= 0) evict(c, i);
+}
+
+void ic_free(InfoCache *c) {
+    for (int i = c->head; i >= 0; i = E(i).next) free(E(i).data);
+    free(c->e);
+    hi_free(&c->map);
+    memset(c, 0, sizeof(*c));
+    c->free = c->head = c->tail = -1;
+}
@@ -0,0 +1,64 @@
+#ifndef INFOCACHE_H
+#define INFOCACHE_H
+
+#include <stddef.h>
+#include "hash_index.h"
+
+// LRU-кэш строк info файловой таблицы с ограничением по байтам.
+// Ключ — ключ записи (индекс "ключ -> элемент" на hash_index.h),
+// элементы связаны в список от недавно использованных к давним;
+// при нехватке бюджета вытесняются самые давние.
+// Элементы, полученные после ic_begin, закреплены до следующего
+// ic_begin: их не вытесняют, поэтому указатели на их данные,
+// выданные в текущем окне чтения, остаются действительными.
+
+typedef struct IcEntry IcEntry;
+
+typedef struct {
+    IcEntry  *e;       // элементы
+    int       cap;     // размер массива e
+    int       free;    // первый свободный элемент или -1
+    int       head;    // самый недавно использованный или -1
+    int       tail;    // самый давний или -1
+    HashIndex map;     // ключ записи -> элемент
+    size_t    bytes;   // занято байт (данные с '\0')
+    size_t    budget;  // бюджет в байтах, 0 — кэш выключен
+    unsigned  epoch;   // номер текущего окна чтения
+    long      hits;    // попадания
+    long      misses;  // промахи
+} InfoCache;
+
+/*
+ * Инициализация кэша с бюджетом budget байт (0 — выключен).
+ * Возвращает 0 или -1 при нехватке памяти.
+ */
+int ic_init(InfoCache *c, size_t budget);
+
+/*
+ * Начать новое окно чтения: снять закрепление с элементов.
+ */
+void ic_begin(InfoCache *c);
+
+/*
+ * Найти info записи (строка с '\0'). Возвращает указатель или NULL.
+ * Учитывает попадание/промах.
+ */
+const char *ic_get(InfoCache *c, int key);
+
+/*
+ * Запомнить info записи (len байт без '\0'). Если места не хватает
+ * даже после вытеснения незакреплённых элементов, строка не кэшируется.
+ */
+void ic_put(InfoCache *c, int key, const char *data, int len);
+
+/*
+ * Забыть info записи (после удаления или перезаписи записи).
+ */
+void ic_drop(InfoCache *c, int key);
+
+/*
+ * Освобождение памяти кэша.
+ */
+void ic_free(InfoCache *c);
+
+#endif // INFOCACHE_H
@@ -0,0 +1,115 @@
+#include "lz.h"
+#include <string.h>
+
+#define LZ_MIN_MATCH    4
+#define LZ_HASH_BITS    12
+#define LZ_MAX_OFFSET   65535
+#define LZ_LAST_LITERALS 5  // the format ends with at least this many literals
+#define LZ_MATCH_LIMIT  12  // and no match starts closer to the end
+
+static unsigned read32(const unsigned char *p) {
+    unsigned v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static unsigned hash4(unsigned v) {
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+int lz_bound(int n) {
+    return n + n / 255 + 16;
+}
+
+// extension bytes of a length that did not fit in its 4-bit token field
+static unsigned char *put_len(unsigned char *op, int len) {
+    for (len -= 15; len >= 255; len -= 255) *op++ = 255;
+    *op++ = (unsigned char)len;
+    return op;
+}
+
+static unsigned char *put_literals(unsigned char *op, const unsigned char *from, int lit, int mlen) {
+    *op++ = (unsigned char)((lit >= 15 ? 15 : lit) << 4 | (mlen >= 15 ? 15 : mlen));
+    if (lit >= 15) op = put_len(op, lit);
+    memcpy(op, from, (size_t)lit);
+    return op + lit;
+}
+
+int lz_compress(const char *src, int n, char *dst) {
+    const unsigned char *base = (const unsigned char *)src;
+    const unsigned char *ip = base, *anchor = base, *end = base + n;
+    unsigned char *op = (unsigned char *)dst;
+    int table[1 << LZ_HASH_BITS];
+    for (int i = 0; i < (1 << LZ_HASH_BITS); i++) table[i] = -1;
+    if (n > LZ_MATCH_LIMIT) {
+        const unsigned char *limit = end - LZ_MATCH_LIMIT;
+        const unsigned char *mend = end - LZ_LAST_LITERALS;
+        while (ip < limit) {
+            unsigned v = read32(ip);
+            unsigned h = hash4(v);
+            int ref = table[h];
+            table[h] = (int)(ip - base);
+            if (ref < 0 || ip - base - ref > LZ_MAX_OFFSET || read32(base + ref) != v) {
+                ip++;
+                continue;
+            }
+            const unsigned char *m = base + ref;
+            const unsigned char *p = ip + LZ_MIN_MATCH, *q = m + LZ_MIN_MATCH;
+            while (p < mend && *p == *q) {
+                p++;
+                q++;
+            }
+            int mlen = (int)(p - ip) - LZ_MIN_MATCH;
+            op = put_literals(op, anchor, (int)(ip - anchor), mlen);
+            int off = (int)(ip - m);
+            *op++ = (unsigned char)(off & 255);
+            *op++ = (unsigned char)(off >> 8);
+            if (mlen >= 15) op = put_len(op, mlen);
+            ip = anchor = p;
+        }
+    }
+    op = put_literals(op, anchor, (int)(end - anchor), 0);
+    return (int)(op - (unsigned char *)dst);
+}
+
+// reads the extension bytes of a length; -1 if the input ends first
+static long get_len(const unsigned char **ip, const unsigned char *iend, long len) {
+    unsigned b;
+    do {
+        if (*ip >= iend) return -1;
+        b = *(*ip)++;
+        len += b;
+    } while (b == 255);
+    return len;
+}
+
+int lz_decompress(const char *src, int zn, char *dst, int n) {
+    const unsigned char *ip = (const unsigned char *)src, *iend = ip + zn;
+    unsigned char *op = (unsigned char *)dst, *oend = op + n;
+    while (ip < iend) {
+        unsigned token = *ip++;
+        long lit = token >> 4;
+        if (lit == 15 && (lit = get_len(&ip, iend, lit)) < 0) return -1;
+        if (lit > iend - ip || lit > oend - op) return -1;
+        memcpy(op, ip, (size_t)lit);
+        op += lit;
+        ip += lit;
+        if (ip == iend) break; // the last sequence has literals only
+        if (iend - ip < 2) return -1;
+        long off = ip[0] | ip[1] << 8;
+        ip += 2;
+        long mlen = token & 15;
+        if (mlen == 15 && (mlen = get_len(&ip, iend, mlen)) < 0) return -1;
+        mlen += LZ_MIN_MATCH;
+        if (off == 0 || off > op - (unsigned char *)dst || mlen > oend - op) return -1;
+        const unsigned char *m = op - off;
+        if (off >= mlen) {
+            memcpy(op, m, (size_t)mlen);
+            op += mlen;
+        } else {
+            // an overlapping match repeats the last off bytes
+            while (mlen-- > 0) *op++ = *m++;
+        }
+    }
+    return op == oend ? 0 : -1;
+}
@@ -0,0 +1,27 @@
+#ifndef LZ_H
+#define LZ_H
+
+// Сжатие блоков данных в формате блока LZ4: последовательности
+// "токен, литералы, смещение совпадения (2 байта), длина совпадения".
+// Совпадения ищутся жадно по хеш-таблице четырёхбайтовых префиксов,
+// поэтому сжатие и распаковка идут со скоростью в сотни МБ/с и хорошо
+// подходят для повторяющихся текстов info. Внешних зависимостей нет.
+
+/*
+ * Наибольший размер сжатых данных для n исходных байт.
+ */
+int lz_bound(int n);
+
+/*
+ * Сжать n байт src в dst (не меньше lz_bound(n) байт).
+ * Возвращает размер сжатых данных.
+ */
+int lz_compress(const char *src, int n, char *dst);
+
+/*
+ * Распаковать zn байт src ровно в n байт dst.
+ * Возвращает 0 или -1, если данные повреждены.
+ */
+int lz_decompress(const char *src, int zn, char *dst, int n);
+
+#endif // LZ_H
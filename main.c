@@ -1,10 +1,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
 #include "table_mem.h"
 #include "table_file.h"
+#include "convert.h"
+#include "script.h"
 
-#define SIZE 100
+#define SIZE 100 // начальная ёмкость (и размер блока в файлах старого формата)
 
 #define COLOR_RED    "\x1B[1;31m"
 #define COLOR_RESET  "\x1B[0m"
@@ -21,6 +25,10 @@ int menu() {
     printf("3 - Search by parent key\n");
     printf("4 - Print all\n");
     printf("5 - Export to Graphviz DOT\n");
+    printf("6 - Compact file (file mode)\n");
+    printf("7 - Statistics\n");
+    printf("8 - Find by info (prefix or substring)\n");
+    printf("9 - Key range (sorted by key)\n");
     printf(COLOR_BLUE "0 - Exit\n" COLOR_RESET);
     printf("> ");
     if (scanf("%d", &cmd) != 1) {
@@ -31,7 +39,180 @@ int menu() {
     return cmd;
 }
 
+// Чтение info до конца строки (пробелы допустимы, длина не ограничена).
+// Возвращает строку или NULL, если строка пуста или ввод закончился
+static char *read_info(char **buf, size_t *cap) {
+    ssize_t n = getline(buf, cap, stdin);
+    if (n <= 0) return NULL;
+    while (n > 0 && ((*buf)[n - 1] == '\n' || (*buf)[n - 1] == '\r')) (*buf)[--n] = '\0';
+    char *s = *buf;
+    while (*s == ' ' || *s == '\t') s++;
+    return *s ? s : NULL;
+}
+
+
+// Вывод найденной строки (поиск по info, диапазон ключей); ctx — счётчик строк
+static int show_tm_row(const TmRow *row, void *ctx) {
+    printf(" key=%d par=%d info='%s'\n", row->key, row->par, row->info);
+    ++*(int *)ctx;
+    return 0;
+}
+
+
+static int show_tf_row(const TfRow *row, void *ctx) {
+    printf("key=%d par=%d info=%s\n", row->key, row->par, row->info);
+    ++*(int *)ctx;
+    return 0;
+}
+
+
+// Чтение вида поиска (1 — префикс, 2 — подстрока) и текста.
+// Возвращает текст или NULL при неверном вводе
+static char *read_find(int *kind, char **buf, size_t *cap) {
+    printf("Enter 1 - prefix or 2 - substring, then text: ");
+    if (scanf("%d", kind) != 1) {
+        while (getchar() != '\n');
+        return NULL;
+    }
+    char *text = read_info(buf, cap);
+    return text && (*kind == 1 || *kind == 2) ? text : NULL;
+}
+
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [table.dat]   (interactive menu)\n"
+            "       %s --mode=mem|file [--script FILE] [--file=table.dat]\n"
+            "          [--threads=N] [--btree] [--wal] [--mmap] [--compress] [--quiet]\n"
+            "          [--snapshot=table.snap] [--from=table.dat]\n"
+            "Script commands are read from FILE or stdin, see script.h.\n"
+            "--snapshot: mem mode starts from the snapshot (if it exists) and saves it on exit.\n"
+            "--from: mem mode starts with the records of a file table.\n"
+            "--compress: a new file table keeps its infos in compressed blocks.\n",
+            prog, prog);
+}
+
+
+// Начальное содержимое таблицы в памяти: записи файловой таблицы from,
+// снимок snap (если файл уже есть) или пустая таблица.
+// Время загрузки выводится в stderr
+static int load_mem(Table *t, const char *snap, const char *from, const TfOptions *opt) {
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    int res = TM_OK;
+    if (from) {
+        FTable src;
+        // tf_open_ex создал бы пустой файл на месте отсутствующего
+        if (access(from, F_OK) != 0 || tf_open_ex(&src, from, opt) != TMF_OK) return TM_ERR_READ;
+        res = tm_load_ftable(t, &src);
+        tf_close(&src);
+    } else if (snap && access(snap, F_OK) == 0) {
+        res = tm_load_snapshot(t, snap);
+    } else {
+        tm_init(t, SIZE);
+        return TM_OK;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    if (res == TM_OK)
+        fprintf(stderr, "loaded=%d sec=%.3f\n", t->count,
+                (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9);
+    return res;
+}
+
+
+// Пакетный режим: команды из файла или stdin, итоги — в stderr
+static int run_script(int argc, char *argv[]) {
+    const char *mode = NULL, *script = NULL, *fname = "table.dat";
+    const char *snap = NULL, *from = NULL;
+    int threads = 1, quiet = 0;
+    TfOptions opt;
+    memset(&opt, 0, sizeof(opt));
+    opt.capacity = SIZE;
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        if (!strncmp(a, "--mode=", 7)) mode = a + 7;
+        else if (!strncmp(a, "--script=", 9)) script = a + 9;
+        else if (!strcmp(a, "--script") && i + 1 < argc) script = argv[++i];
+        else if (!strncmp(a, "--file=", 7)) fname = a + 7;
+        else if (!strncmp(a, "--threads=", 10)) threads = atoi(a + 10);
+        else if (!strcmp(a, "--btree")) opt.use_btree = 1;
+        else if (!strcmp(a, "--wal")) opt.use_wal = 1;
+        else if (!strcmp(a, "--mmap")) opt.use_mmap = 1;
+        else if (!strcmp(a, "--compress")) opt.compress = 1;
+        else if (!strcmp(a, "--quiet")) quiet = 1;
+        else if (!strncmp(a, "--snapshot=", 11)) snap = a + 11;
+        else if (!strncmp(a, "--from=", 7)) from = a + 7;
+        else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (!mode || (strcmp(mode, "mem") && strcmp(mode, "file")) ||
+        ((snap || from) && strcmp(mode, "mem"))) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    FILE *in = stdin;
+    if (script && strcmp(script, "-")) {
+        in = fopen(script, "r");
+        if (!in) {
+            fprintf(stderr, "Cannot open script '%s'\n", script);
+            return 1;
+        }
+    }
+
+    Table  tmem;
+    FTable tfile;
+    int file = !strcmp(mode, "file");
+    if (file) {
+        int res = tf_open_ex(&tfile, fname, &opt);
+        if (res != TMF_OK) {
+            fprintf(stderr, "File opening error '%s': %s\n", fname, tf_errstr(res));
+            if (in != stdin) fclose(in);
+            return 1;
+        }
+    } else {
+        int res = load_mem(&tmem, snap, from, &opt);
+        if (res != TM_OK) {
+            fprintf(stderr, "Cannot load '%s': %s\n", from ? from : snap, tm_errstr(res));
+            if (in != stdin) fclose(in);
+            return 1;
+        }
+        if (tm_set_threads(&tmem, threads) != TM_OK)
+            fprintf(stderr, "Cannot start %d threads, running serially\n", threads);
+    }
+
+    static char obuf[1 << 16];
+    setvbuf(stdout, obuf, _IOFBF, sizeof(obuf));
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    ScriptStats st;
+    int res = script_run(file ? NULL : &tmem, file ? &tfile : NULL, in, stdout, quiet, &st);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double sec = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    fprintf(stderr, "ops=%ld errors=%ld rows=%ld sec=%.3f ops_per_sec=%.0f\n",
+            st.ops, st.errors, st.rows, sec, sec > 0 ? st.ops / sec : 0.0);
+    if (res != 0) fprintf(stderr, "Script read error\n");
+
+    if (in != stdin) fclose(in);
+    if (file) {
+        if (tfile.f) tf_close(&tfile);
+    } else {
+        if (snap) {
+            int sres = tm_save_snapshot(&tmem, snap);
+            if (sres != TM_OK) fprintf(stderr, "Cannot save snapshot '%s': %s\n", snap, tm_errstr(sres));
+        }
+        tm_free(&tmem);
+    }
+    fflush(stdout);
+    return res != 0;
+}
+
+
 int main(int argc, char *argv[]) {
+    if (argc > 1 && !strncmp(argv[1], "--", 2)) return run_script(argc, argv);
+
     int mode;
     printf(COLOR_YELLOW "Select mode:\n" COLOR_RESET);
     printf("1 - Internal (Memory)\n");
@@ -44,6 +225,8 @@ int main(int argc, char *argv[]) {
 
     Table  tmem;
     FTable tfile;
+    char  *line = NULL;   // буфер строки info
+    size_t line_cap = 0;
 
     if (mode == 1) {
         tm_init(&tmem, SIZE);
@@ -62,16 +245,17 @@ int main(int argc, char *argv[]) {
         if (cmd == 0) break;
 
         int key, par, scanned, ret;
-        char info[256];
+        char *info;
 
         if (mode == 1) {
             switch (cmd) {
                 case 1:
                     printf("Enter key, parent key, info: ");
-                    scanned = scanf(" %d , %d , %255s", &key, &par, info);
-                    if (scanned != 3) {
+                    scanned = scanf(" %d , %d ,", &key, &par);
+                    info = scanned == 2 ? read_info(&line, &line_cap) : NULL;
+                    if (!info) {
                         printf(COLOR_RED "%s" COLOR_RESET "\n", tm_errstr(TMF_ERR_INVALID));
-                        while (getchar() != '\n');
+                        if (scanned != 2) while (getchar() != '\n');
                         break;
                     }
                     ret = tm_insert(&tmem, key, par, info);
@@ -98,10 +282,12 @@ int main(int argc, char *argv[]) {
                         while (getchar() != '\n');
                         break;
                     }
-                    Table *res = tm_search(&tmem, par);
-                    tm_print(res);
-                    tm_free(res);
-                    free(res);
+                    TmCursor cur;
+                    TmRow row;
+                    tm_cursor_open(&cur, &tmem, par);
+                    printf("Table (count=%d):\n", cur.total);
+                    while (tm_cursor_next(&cur, &row))
+                        printf(" key=%d par=%d info='%s'\n", row.key, row.par, row.info);
                     break;
                 }
 
@@ -111,13 +297,70 @@ int main(int argc, char *argv[]) {
 
                 case 5: {
                     char dotfile[256];
+                    DotFilter flt = { 0, 0, 0, 0 };
                     printf("Enter output DOT filename: ");
                     if (scanf(" %255s", dotfile) != 1) break;
-                    if (mode == 1)
-                        tm_export_dot(&tmem, dotfile);
+                    printf("Enter subtree root key, max depth, max nodes (0 - no limit): ");
+                    if (scanf("%d %d %ld", &flt.root, &flt.max_depth, &flt.max_nodes) != 3) {
+                        printf(COLOR_RED "%s" COLOR_RESET "\n", tm_errstr(TMF_ERR_INVALID));
+                        while (getchar() != '\n');
+                        break;
+                    }
+                    FILE *f = fopen(dotfile, "w");
+                    if (!f) {
+                        printf(COLOR_RED "Cannot open '%s'" COLOR_RESET "\n", dotfile);
+                        break;
+                    }
+                    ret = tm_export_dot_ex(&tmem, f, &flt);
+                    fclose(f);
+                    if (ret != TM_OK)
+                        printf(COLOR_RED "%s" COLOR_RESET "\n", tm_errstr(ret));
                     else
-                        tf_export_dot(&tfile, dotfile);
-                    printf("DOT saved to '%s'\n", dotfile);
+                        printf("DOT saved to '%s'\n", dotfile);
+                    break;
+                }
+
+                case 7: {
+                    TableStats st;
+                    if (tm_stats(&tmem, &st) != TM_OK)
+                        printf(COLOR_RED "Statistics are off (build with -DTABLE_STATS)" COLOR_RESET "\n");
+                    else
+                        st_print(&st, stdout);
+                    break;
+                }
+
+                case 8: {
+                    int kind, found = 0;
+                    char *text = read_find(&kind, &line, &line_cap);
+                    if (!text) {
+                        printf(COLOR_RED "%s" COLOR_RESET "\n", tm_errstr(TM_ERR_INVALID));
+                        break;
+                    }
+                    // индекс строится при первом поиске, дальше его ведут вставки и удаления
+                    ret = tm_set_info_index(&tmem, 1);
+                    if (ret == TM_OK)
+                        ret = kind == 1 ? tm_find_prefix(&tmem, text, show_tm_row, &found)
+                                        : tm_find_substr(&tmem, text, show_tm_row, &found);
+                    if (ret != TM_OK)
+                        printf(COLOR_RED "%s" COLOR_RESET "\n", tm_errstr(ret));
+                    else
+                        printf("Found: %d\n", found);
+                    break;
+                }
+
+                case 9: {
+                    int lo, hi, found = 0;
+                    printf("Enter lowest and highest key: ");
+                    if (scanf("%d %d", &lo, &hi) != 2) {
+                        printf(COLOR_RED "%s" COLOR_RESET "\n", tm_errstr(TM_ERR_INVALID));
+                        while (getchar() != '\n');
+                        break;
+                    }
+                    ret = tm_range(&tmem, lo, hi, show_tm_row, &found);
+                    if (ret != TM_OK)
+                        printf(COLOR_RED "%s" COLOR_RESET "\n", tm_errstr(ret));
+                    else
+                        printf("Found: %d\n", found);
                     break;
                 }
 
@@ -129,10 +372,11 @@ int main(int argc, char *argv[]) {
             switch (cmd) {
                 case 1:
                     printf("Enter key, parent key, info: ");
-                    scanned = scanf(" %d , %d , %255s", &key, &par, info);
-                    if (scanned != 3) {
+                    scanned = scanf(" %d , %d ,", &key, &par);
+                    info = scanned == 2 ? read_info(&line, &line_cap) : NULL;
+                    if (!info) {
                         printf(COLOR_RED "%s" COLOR_RESET "\n", tf_errstr(TMF_ERR_INVALID));
-                        while (getchar() != '\n');
+                        if (scanned != 2) while (getchar() != '\n');
                         break;
                     }
                     ret = tf_insert(&tfile, key, par, info);
@@ -159,22 +403,17 @@ int main(int argc, char *argv[]) {
                         while (getchar() != '\n');
                         break;
                     }
-                    int out_cnt;
-                    FItem *found = tf_search(&tfile, par, &out_cnt);
-                    if (!found) {
+                    TfCursor cur;
+                    TfRow row;
+                    tf_cursor_open(&cur, &tfile, par);
+                    if (cur.total == 0) {
                         printf(COLOR_RED "%s" COLOR_RESET "\n", tf_errstr(TMF_ERR_NOT_FOUND));
-                    } else {
-                        for (int i = 0; i < out_cnt; i++) {
-                            printf("key=%d par=%d info=", found[i].key, found[i].par);
-                            char *buf = malloc(found[i].length + 1);
-                            fseek(tfile.f, found[i].offset, SEEK_SET);
-                            fread(buf, 1, found[i].length, tfile.f);
-                            buf[found[i].length] = '\0';
-                            printf("%s\n", buf);
-                            free(buf);
-                        }
-                        free(found);
                     }
+                    while (tf_cursor_next(&cur, &row))
+                        printf("key=%d par=%d info=%s\n", row.key, row.par, row.info);
+                    if (cur.err != TMF_OK)
+                        printf(COLOR_RED "%s" COLOR_RESET "\n", tf_errstr(cur.err));
+                    tf_cursor_close(&cur);
                     break;
                 }
 
@@ -184,13 +423,88 @@ int main(int argc, char *argv[]) {
 
                 case 5: {
                     char dotfile[256];
+                    DotFilter flt = { 0, 0, 0, 0 };
                     printf("Enter output DOT filename: ");
                     if (scanf(" %255s", dotfile) != 1) break;
-                    if (mode == 1)
-                        tm_export_dot(&tmem, dotfile);
+                    printf("Enter subtree root key, max depth, max nodes (0 - no limit): ");
+                    if (scanf("%d %d %ld", &flt.root, &flt.max_depth, &flt.max_nodes) != 3) {
+                        printf(COLOR_RED "%s" COLOR_RESET "\n", tf_errstr(TMF_ERR_INVALID));
+                        while (getchar() != '\n');
+                        break;
+                    }
+                    FILE *f = fopen(dotfile, "w");
+                    if (!f) {
+                        printf(COLOR_RED "Cannot open '%s'" COLOR_RESET "\n", dotfile);
+                        break;
+                    }
+                    ret = tf_export_dot_ex(&tfile, f, &flt);
+                    fclose(f);
+                    if (ret != TMF_OK)
+                        printf(COLOR_RED "%s" COLOR_RESET "\n", tf_errstr(ret));
+                    else
+                        printf("DOT saved to '%s'\n", dotfile);
+                    break;
+                }
+
+                case 6: {
+                    int order;
+                    long reclaimed = 0;
+                    printf("Order of info (0 - by slot, 1 - by parent, 2 - depth-first): ");
+                    if (scanf("%d", &order) != 1) {
+                        printf(COLOR_RED "%s" COLOR_RESET "\n", tf_errstr(TMF_ERR_INVALID));
+                        while (getchar() != '\n');
+                        break;
+                    }
+                    ret = tf_compact(&tfile, order, &reclaimed);
+                    if (ret != TMF_OK) {
+                        printf(COLOR_RED "%s" COLOR_RESET "\n", tf_errstr(ret));
+                        if (!tfile.f) return 1; // the file could not be reopened
+                        break;
+                    }
+                    printf("Compacted, %ld bytes reclaimed\n", reclaimed);
+                    break;
+                }
+
+                case 7: {
+                    TableStats st;
+                    if (tf_stats(&tfile, &st) != TMF_OK)
+                        printf(COLOR_RED "Statistics are off (build with -DTABLE_STATS)" COLOR_RESET "\n");
+                    else
+                        st_print(&st, stdout);
+                    break;
+                }
+
+                case 8: {
+                    int kind, found = 0;
+                    char *text = read_find(&kind, &line, &line_cap);
+                    if (!text) {
+                        printf(COLOR_RED "%s" COLOR_RESET "\n", tf_errstr(TMF_ERR_INVALID));
+                        break;
+                    }
+                    ret = tf_set_info_index(&tfile, 1);
+                    if (ret == TMF_OK)
+                        ret = kind == 1 ? tf_find_prefix(&tfile, text, show_tf_row, &found)
+                                        : tf_find_substr(&tfile, text, show_tf_row, &found);
+                    if (ret != TMF_OK)
+                        printf(COLOR_RED "%s" COLOR_RESET "\n", tf_errstr(ret));
+                    else
+                        printf("Found: %d\n", found);
+                    break;
+                }
+
+                case 9: {
+                    int lo, hi, found = 0;
+                    printf("Enter lowest and highest key: ");
+                    if (scanf("%d %d", &lo, &hi) != 2) {
+                        printf(COLOR_RED "%s" COLOR_RESET "\n", tf_errstr(TMF_ERR_INVALID));
+                        while (getchar() != '\n');
+                        break;
+                    }
+                    ret = tf_range(&tfile, lo, hi, show_tf_row, &found);
+                    if (ret != TMF_OK)
+                        printf(COLOR_RED "%s" COLOR_RESET "\n", tf_errstr(ret));
                     else
-                        tf_export_dot(&tfile, dotfile);
-                    printf("DOT saved to '%s'\n", dotfile);
+                        printf("Found: %d\n", found);
                     break;
                 }
 
@@ -205,6 +519,7 @@ int main(int argc, char *argv[]) {
     } else {
         tf_close(&tfile);
     }
+    free(line);
 
     return 0;
 }
@@ -0,0 +1,320 @@
+#include "ord_index.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Both node kinds start with n, so a node of unknown kind tells its size.
+// The arrays have one spare entry: a full node takes the new entry first
+// and is split right after.
+struct OiLeaf {
+    int     n;
+    OiLeaf *prev, *next;
+    int     keys[OI_LEAF + 1];
+    int     vals[OI_LEAF + 1];
+};
+
+typedef struct {
+    int   n;
+    int   keys[OI_FAN + 1]; // keys[i] <= every key under kids[i] (i > 0); keys[0] is unused
+    void *kids[OI_FAN + 1];
+} OiInner;
+
+#define NODE_N(p) (*(int *)(p))
+
+void oi_init(OrdIndex *o) {
+    o->root = NULL;
+    o->height = 0;
+    o->count = 0;
+}
+
+static void free_node(void *p, int h) {
+    if (h > 0) {
+        OiInner *in = p;
+        for (int i = 0; i < in->n; i++) free_node(in->kids[i], h - 1);
+    }
+    free(p);
+}
+
+void oi_free(OrdIndex *o) {
+    if (o->root) free_node(o->root, o->height);
+    oi_init(o);
+}
+
+// the child of in whose range holds key
+static int child_of(const OiInner *in, int key) {
+    int lo = 1, hi = in->n;
+    while (lo < hi) {
+        int m = (lo + hi) / 2;
+        if (in->keys[m] <= key) lo = m + 1;
+        else hi = m;
+    }
+    return lo - 1;
+}
+
+// first position of l with a key >= key
+static int lower(const OiLeaf *l, int key) {
+    int lo = 0, hi = l->n;
+    while (lo < hi) {
+        int m = (lo + hi) / 2;
+        if (l->keys[m] < key) lo = m + 1;
+        else hi = m;
+    }
+    return lo;
+}
+
+static int is_full(const void *p, int h) {
+    return NODE_N(p) >= (h > 0 ? OI_FAN : OI_LEAF);
+}
+
+// inserts into the subtree of height h; a split hands back the new right
+// node and its lowest key. Every full node on the path has its sibling
+// allocated before anything changes, so a failed malloc leaves the tree as
+// it was. Returns 1 — added, 0 — replaced, -1 — out of memory
+static int put(void *node, int h, int key, int val, void **right, int *sep) {
+    *right = NULL;
+    void *spare = NULL;
+    if (is_full(node, h) && !(spare = malloc(h > 0 ? sizeof(OiInner) : sizeof(OiLeaf)))) return -1;
+    if (h == 0) {
+        OiLeaf *l = node;
+        int i = lower(l, key);
+        if (i < l->n && l->keys[i] == key) {
+            l->vals[i] = val;
+            free(spare);
+            return 0;
+        }
+        memmove(l->keys + i + 1, l->keys + i, (size_t)(l->n - i) * sizeof(int));
+        memmove(l->vals + i + 1, l->vals + i, (size_t)(l->n - i) * sizeof(int));
+        l->keys[i] = key;
+        l->vals[i] = val;
+        l->n++;
+        if (!spare) return 1;
+        // an append to the last leaf keeps it full: ascending keys pack densely
+        int half = i == OI_LEAF && !l->next ? OI_LEAF : l->n / 2;
+        OiLeaf *r = spare;
+        r->n = l->n - half;
+        memcpy(r->keys, l->keys + half, (size_t)r->n * sizeof(int));
+        memcpy(r->vals, l->vals + half, (size_t)r->n * sizeof(int));
+        l->n = half;
+        r->prev = l;
+        r->next = l->next;
+        if (l->next) l->next->prev = r;
+        l->next = r;
+        *right = r;
+        *sep = r->keys[0];
+        return 1;
+    }
+    OiInner *in = node;
+    int c = child_of(in, key);
+    void *kid;
+    int kid_sep;
+    int res = put(in->kids[c], h - 1, key, val, &kid, &kid_sep);
+    if (res < 0 || !kid) {
+        free(spare);
+        return res;
+    }
+    memmove(in->keys + c + 2, in->keys + c + 1, (size_t)(in->n - c - 1) * sizeof(int));
+    memmove(in->kids + c + 2, in->kids + c + 1, (size_t)(in->n - c - 1) * sizeof(void *));
+    in->keys[c + 1] = kid_sep;
+    in->kids[c + 1] = kid;
+    in->n++;
+    if (!spare) return res;
+    int half = c + 1 == OI_FAN ? OI_FAN : in->n / 2;
+    OiInner *r = spare;
+    r->n = in->n - half;
+    memcpy(r->keys, in->keys + half, (size_t)r->n * sizeof(int));
+    memcpy(r->kids, in->kids + half, (size_t)r->n * sizeof(void *));
+    in->n = half;
+    *right = r;
+    *sep = r->keys[0];
+    return res;
+}
+
+int oi_put(OrdIndex *o, int key, int val) {
+    if (!o->root) {
+        OiLeaf *l = malloc(sizeof(OiLeaf));
+        if (!l) return -1;
+        l->n = 0;
+        l->prev = l->next = NULL;
+        o->root = l;
+        o->height = 0;
+    }
+    // a full root may split: its new parent is taken in advance
+    OiInner *top = NULL;
+    if (is_full(o->root, o->height) && !(top = malloc(sizeof(OiInner)))) return -1;
+    void *right;
+    int sep;
+    int res = put(o->root, o->height, key, val, &right, &sep);
+    if (res > 0) o->count++;
+    if (right) {
+        top->n = 2;
+        top->kids[0] = o->root;
+        top->kids[1] = right;
+        top->keys[1] = sep;
+        o->root = top;
+        o->height++;
+    } else {
+        free(top);
+    }
+    return res < 0 ? -1 : 0;
+}
+
+// removes key from the subtree; a child left empty is unlinked and freed
+static int del(void *node, int h, int key) {
+    if (h == 0) {
+        OiLeaf *l = node;
+        int i = lower(l, key);
+        if (i == l->n || l->keys[i] != key) return 0;
+        memmove(l->keys + i, l->keys + i + 1, (size_t)(l->n - i - 1) * sizeof(int));
+        memmove(l->vals + i, l->vals + i + 1, (size_t)(l->n - i - 1) * sizeof(int));
+        l->n--;
+        return 1;
+    }
+    OiInner *in = node;
+    int c = child_of(in, key);
+    void *kid = in->kids[c];
+    if (!del(kid, h - 1, key)) return 0;
+    if (NODE_N(kid) > 0) return 1;
+    if (h == 1) {
+        OiLeaf *l = kid;
+        if (l->prev) l->prev->next = l->next;
+        if (l->next) l->next->prev = l->prev;
+    }
+    free(kid);
+    // the range of the removed child joins its left neighbour
+    memmove(in->keys + c, in->keys + c + 1, (size_t)(in->n - c - 1) * sizeof(int));
+    memmove(in->kids + c, in->kids + c + 1, (size_t)(in->n - c - 1) * sizeof(void *));
+    in->n--;
+    return 1;
+}
+
+int oi_del(OrdIndex *o, int key) {
+    if (!o->root || !del(o->root, o->height, key)) return 0;
+    o->count--;
+    if (NODE_N(o->root) == 0) {
+        free(o->root);
+        oi_init(o);
+        return 1;
+    }
+    while (o->height > 0 && NODE_N(o->root) == 1) {
+        OiInner *in = o->root;
+        o->root = in->kids[0];
+        o->height--;
+        free(in);
+    }
+    return 1;
+}
+
+int oi_build(OrdIndex *o, const int *keys, const int *vals, int n) {
+    oi_init(o);
+    if (n <= 0) return 0;
+    int cnt = (n + OI_LEAF - 1) / OI_LEAF;
+    void **level = malloc((size_t)cnt * sizeof(void *));
+    int *low = malloc((size_t)cnt * sizeof(int));
+    if (!level || !low) {
+        free(level);
+        free(low);
+        return -1;
+    }
+    OiLeaf *prev = NULL;
+    int built = 0;
+    for (; built < cnt; built++) {
+        OiLeaf *l = malloc(sizeof(OiLeaf));
+        if (!l) break;
+        int b = built;
+        l->n = n - b * OI_LEAF < OI_LEAF ? n - b * OI_LEAF : OI_LEAF;
+        memcpy(l->keys, keys + b * OI_LEAF, (size_t)l->n * sizeof(int));
+        memcpy(l->vals, vals + b * OI_LEAF, (size_t)l->n * sizeof(int));
+        l->prev = prev;
+        l->next = NULL;
+        if (prev) prev->next = l;
+        prev = l;
+        level[b] = l;
+        low[b] = l->keys[0];
+    }
+    int ok = built == cnt;
+    if (!ok) {
+        for (int b = 0; b < built; b++) free(level[b]);
+    }
+    // inner levels: up to OI_FAN nodes of the level below per node, in place
+    int h = 0;
+    while (ok && cnt > 1) {
+        int up = (cnt + OI_FAN - 1) / OI_FAN;
+        int made = 0;
+        for (; made < up; made++) {
+            OiInner *in = malloc(sizeof(OiInner));
+            if (!in) break;
+            int b = made;
+            in->n = cnt - b * OI_FAN < OI_FAN ? cnt - b * OI_FAN : OI_FAN;
+            memcpy(in->kids, level + b * OI_FAN, (size_t)in->n * sizeof(void *));
+            memcpy(in->keys, low + b * OI_FAN, (size_t)in->n * sizeof(int));
+            level[b] = in;
+            low[b] = in->keys[0];
+        }
+        if (made < up) {
+            // the nodes not grouped yet are still whole subtrees of height h
+            for (int b = 0; b < made; b++) free_node(level[b], h + 1);
+            for (int b = made * OI_FAN; b < cnt; b++) free_node(level[b], h);
+            ok = 0;
+        }
+        cnt = up;
+        h++;
+    }
+    if (ok) {
+        o->root = level[0];
+        o->height = h;
+        o->count = n;
+    }
+    free(level);
+    free(low);
+    return ok ? 0 : -1;
+}
+
+static const OiLeaf *edge_leaf(const OrdIndex *o, int last) {
+    const void *p = o->root;
+    for (int h = o->height; h > 0; h--) {
+        const OiInner *in = p;
+        p = in->kids[last ? in->n - 1 : 0];
+    }
+    return p;
+}
+
+int oi_min(const OrdIndex *o, int *key, int *val) {
+    if (!o->root) return 0;
+    const OiLeaf *l = edge_leaf(o, 0);
+    if (key) *key = l->keys[0];
+    if (val) *val = l->vals[0];
+    return 1;
+}
+
+int oi_max(const OrdIndex *o, int *key, int *val) {
+    if (!o->root) return 0;
+    const OiLeaf *l = edge_leaf(o, 1);
+    if (key) *key = l->keys[l->n - 1];
+    if (val) *val = l->vals[l->n - 1];
+    return 1;
+}
+
+void oi_seek(OiIter *it, const OrdIndex *o, int lo, int hi) {
+    it->leaf = NULL;
+    it->i = 0;
+    it->hi = hi;
+    if (!o->root || lo > hi) return;
+    const void *p = o->root;
+    for (int h = o->height; h > 0; h--) p = ((const OiInner *)p)->kids[child_of(p, lo)];
+    it->leaf = p;
+    it->i = lower(p, lo);
+}
+
+int oi_next(OiIter *it, int *key, int *val) {
+    while (it->leaf && it->i >= it->leaf->n) {
+        it->leaf = it->leaf->next;
+        it->i = 0;
+    }
+    if (!it->leaf || it->leaf->keys[it->i] > it->hi) {
+        it->leaf = NULL;
+        return 0;
+    }
+    if (key) *key = it->leaf->keys[it->i];
+    if (val) *val = it->leaf->vals[it->i];
+    it->i++;
+    return 1;
+}
@@ -0,0 +1,77 @@
+#ifndef ORD_INDEX_H
+#define ORD_INDEX_H
+
+// Упорядоченный индекс "ключ -> значение" в памяти (B+дерево).
+// Листья по OI_LEAF пар связаны в двусвязный список по возрастанию
+// ключей, поэтому диапазон [lo, hi] обходится спуском за O(log n)
+// и последовательным проходом по листьям, а наименьший и наибольший
+// ключи — крайние пары крайних листьев. Вставка и удаление меняют
+// дерево на месте; пустые узлы удаляются, неполные не объединяются.
+// Вставка ключей по возрастанию оставляет левые листья полными.
+
+#define OI_LEAF 64 // пар в листе
+#define OI_FAN  64 // потомков внутреннего узла
+
+typedef struct OiLeaf OiLeaf;
+
+typedef struct {
+    void *root;   // корень (при height == 0 — лист) или NULL — индекс пуст
+    int   height; // уровней внутренних узлов над листьями
+    int   count;  // число ключей
+} OrdIndex;
+
+// Позиция обхода диапазона
+typedef struct {
+    const OiLeaf *leaf; // текущий лист, NULL — обход закончен
+    int           i;    // следующая пара листа
+    int           hi;   // последний ключ диапазона
+} OiIter;
+
+/*
+ * Инициализация пустого индекса (без памяти).
+ */
+void oi_init(OrdIndex *o);
+
+/*
+ * Освобождение памяти индекса.
+ */
+void oi_free(OrdIndex *o);
+
+/*
+ * Построить пустой индекс из n пар, ключи keys строго возрастают
+ * (быстрее n вставок). Возвращает 0 или -1 при нехватке памяти
+ * (индекс остаётся пустым).
+ */
+int oi_build(OrdIndex *o, const int *keys, const int *vals, int n);
+
+/*
+ * Вставить key -> val или заменить значение существующего ключа.
+ * Возвращает 0 или -1 при нехватке памяти (индекс не изменён).
+ */
+int oi_put(OrdIndex *o, int key, int val);
+
+/*
+ * Удалить ключ. Возвращает 1 — удалён, 0 — ключа нет.
+ */
+int oi_del(OrdIndex *o, int key);
+
+/*
+ * Наименьший (oi_min) или наибольший (oi_max) ключ и его значение
+ * (key и val могут быть NULL). Возвращает 1 или 0, если индекс пуст.
+ */
+int oi_min(const OrdIndex *o, int *key, int *val);
+int oi_max(const OrdIndex *o, int *key, int *val);
+
+/*
+ * Начать обход ключей из [lo, hi] по возрастанию.
+ * Индекс нельзя изменять, пока обход не закончен.
+ */
+void oi_seek(OiIter *it, const OrdIndex *o, int lo, int hi);
+
+/*
+ * Следующая пара (key и val могут быть NULL).
+ * Возвращает 1 или 0, если пар в диапазоне больше нет.
+ */
+int oi_next(OiIter *it, int *key, int *val);
+
+#endif // ORD_INDEX_H
@@ -0,0 +1,114 @@
+#include "outbuf.h"
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+void ob_init(OutBuf *o, FILE *f, size_t cap) {
+    o->buf = malloc(cap > 0 ? cap : 1);
+    o->len = 0;
+    o->cap = o->buf ? (cap > 0 ? cap : 1) : 0;
+    o->f   = f;
+    o->err = o->buf ? 0 : 1;
+}
+
+// writes the buffer out to the file
+static void drain(OutBuf *o) {
+    if (o->len > 0 && fwrite(o->buf, 1, o->len, o->f) != o->len) o->err = 1;
+    o->len = 0;
+}
+
+// makes room for n more bytes; returns 0 or -1
+static int room(OutBuf *o, size_t n) {
+    if (o->err) return -1;
+    if (o->len + n <= o->cap) return 0;
+    if (o->f) {
+        drain(o);
+        if (n <= o->cap) return o->err ? -1 : 0;
+    }
+    size_t cap = o->cap ? o->cap : 64;
+    while (cap < o->len + n) cap *= 2;
+    char *p = realloc(o->buf, cap);
+    if (!p) {
+        o->err = 1;
+        return -1;
+    }
+    o->buf = p;
+    o->cap = cap;
+    return 0;
+}
+
+void ob_str(OutBuf *o, const char *s, size_t n) {
+    if (n == 0) return; // s may be NULL, e.g. an empty part buffer
+    if (o->f && !o->err && n > o->cap) {
+        // larger than the whole buffer: straight to the file
+        drain(o);
+        if (!o->err && fwrite(s, 1, n, o->f) != n) o->err = 1;
+        return;
+    }
+    if (room(o, n) != 0) return;
+    memcpy(o->buf + o->len, s, n);
+    o->len += n;
+}
+
+void ob_cstr(OutBuf *o, const char *s) {
+    ob_str(o, s, strlen(s));
+}
+
+void ob_int(OutBuf *o, long v) {
+    char tmp[24];
+    char *p = tmp + sizeof(tmp);
+    unsigned long u = v < 0 ? 0UL - (unsigned long)v : (unsigned long)v;
+    do {
+        *--p = (char)('0' + u % 10);
+        u /= 10;
+    } while (u);
+    if (v < 0) *--p = '-';
+    ob_str(o, p, (size_t)(tmp + sizeof(tmp) - p));
+}
+
+void ob_quoted(OutBuf *o, const char *s) {
+    // copies runs between the characters that need a backslash
+    for (;;) {
+        size_t n = strcspn(s, "\"\\");
+        ob_str(o, s, n);
+        if (!s[n]) return;
+        char esc[2] = { '\\', s[n] };
+        ob_str(o, esc, 2);
+        s += n + 1;
+    }
+}
+
+void ob_printf(OutBuf *o, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(NULL, 0, fmt, ap);
+    va_end(ap);
+    if (n < 0) {
+        o->err = 1;
+        return;
+    }
+    if (room(o, (size_t)n + 1) != 0) return;
+    va_start(ap, fmt);
+    vsnprintf(o->buf + o->len, o->cap - o->len, fmt, ap);
+    va_end(ap);
+    o->len += (size_t)n;
+}
+
+int ob_flush(OutBuf *o) {
+    if (o->f && !o->err) {
+        drain(o);
+        if (fflush(o->f) != 0) o->err = 1;
+    }
+    return o->err ? -1 : 0;
+}
+
+void ob_free(OutBuf *o) {
+    free(o->buf);
+    o->buf = NULL;
+    o->len = 0;
+    o->cap = 0;
+}
+
+int dot_filtered(const DotFilter *flt) {
+    return flt && (flt->root != 0 || flt->max_depth > 0 || flt->max_nodes > 0);
+}
@@ -0,0 +1,76 @@
+#ifndef OUTBUF_H
+#define OUTBUF_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+// Буферизованный вывод строк таблиц (печать и экспорт DOT).
+// С файлом f данные копятся в буфере и сбрасываются в f одним fwrite,
+// когда буфер заполнен, поэтому запись в канал (popen) идёт потоком.
+// Без файла буфер растёт и хранит весь вывод (параллельное
+// форматирование частей таблицы). Целые числа форматируются вручную.
+
+#define OB_CAP (1 << 20) // размер буфера вывода в файл
+
+typedef struct {
+    char  *buf;
+    size_t len;
+    size_t cap;
+    FILE  *f;    // куда сбрасывать буфер или NULL — копить в памяти
+    int    err;  // ошибка записи или нехватка памяти
+} OutBuf;
+
+// Ограничения экспорта DOT; нулевые поля — без ограничений
+typedef struct {
+    int  root;       // ключ корня выводимого поддерева, 0 — вся таблица
+    int  max_depth;  // глубина относительно корня (корень — 1), 0 — любая
+    long max_nodes;  // не больше стольких узлов, 0 — любое число
+    int  sorted;     // 1 — без ограничений выводить узлы по возрастанию ключей
+} DotFilter;
+
+/*
+ * Инициализация: f — файл для сброса (или NULL), cap — начальный размер буфера.
+ */
+void ob_init(OutBuf *o, FILE *f, size_t cap);
+
+/*
+ * Дописать n байт s.
+ */
+void ob_str(OutBuf *o, const char *s, size_t n);
+
+/*
+ * Дописать C-строку.
+ */
+void ob_cstr(OutBuf *o, const char *s);
+
+/*
+ * Дописать целое в десятичной записи.
+ */
+void ob_int(OutBuf *o, long v);
+
+/*
+ * Дописать строку s для кавычек DOT ('"' и '\' экранируются).
+ */
+void ob_quoted(OutBuf *o, const char *s);
+
+/*
+ * Дописать отформатированную строку (printf).
+ */
+void ob_printf(OutBuf *o, const char *fmt, ...);
+
+/*
+ * Сбросить накопленное в f и вызвать fflush. Возвращает 0 или -1.
+ */
+int ob_flush(OutBuf *o);
+
+/*
+ * Освобождение буфера (без сброса).
+ */
+void ob_free(OutBuf *o);
+
+/*
+ * 1, если фильтр что-то ограничивает (flt может быть NULL).
+ */
+int dot_filtered(const DotFilter *flt);
+
+#endif // OUTBUF_H
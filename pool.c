@@ -0,0 +1,114 @@
+#include "pool.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+struct Pool {
+    pthread_t      *th;
+    pthread_mutex_t run;     // one job at a time
+    int             n;       // worker threads (the caller is not counted)
+    pthread_mutex_t lock;
+    pthread_cond_t  work;    // a new job or shutdown
+    pthread_cond_t  done;    // the last part of the job finished
+    PoolFn          fn;
+    void           *ctx;
+    int             parts;
+    int             next;    // next part to hand out
+    int             left;    // parts not finished yet
+    unsigned        job;     // job number, so a worker runs each job once
+    int             stop;
+};
+
+// takes parts of the current job until there are none left
+static void drain(Pool *p) {
+    for (;;) {
+        pthread_mutex_lock(&p->lock);
+        if (p->next >= p->parts) {
+            pthread_mutex_unlock(&p->lock);
+            return;
+        }
+        int part = p->next++;
+        PoolFn fn = p->fn; // the job cannot change before its parts are done
+        void *ctx = p->ctx;
+        pthread_mutex_unlock(&p->lock);
+        fn(ctx, part);
+        pthread_mutex_lock(&p->lock);
+        if (--p->left == 0) pthread_cond_signal(&p->done);
+        pthread_mutex_unlock(&p->lock);
+    }
+}
+
+static void *worker(void *arg) {
+    Pool *p = arg;
+    unsigned seen = 0;
+    pthread_mutex_lock(&p->lock);
+    for (;;) {
+        while (!p->stop && p->job == seen) pthread_cond_wait(&p->work, &p->lock);
+        if (p->stop) break;
+        seen = p->job;
+        pthread_mutex_unlock(&p->lock);
+        drain(p);
+        pthread_mutex_lock(&p->lock);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+Pool *pool_create(int threads) {
+    if (threads <= 0) threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads < 1) threads = 1;
+    Pool *p = calloc(1, sizeof(Pool));
+    if (!p) return NULL;
+    p->th = malloc((size_t)threads * sizeof(pthread_t));
+    if (!p->th) {
+        free(p);
+        return NULL;
+    }
+    pthread_mutex_init(&p->run, NULL);
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->work, NULL);
+    pthread_cond_init(&p->done, NULL);
+    for (int i = 0; i < threads - 1; i++) {
+        if (pthread_create(&p->th[i], NULL, worker, p) != 0) break;
+        p->n++;
+    }
+    return p;
+}
+
+int pool_size(const Pool *p) {
+    return p->n + 1;
+}
+
+void pool_run(Pool *p, PoolFn fn, void *ctx, int parts) {
+    if (parts <= 0) return;
+    pthread_mutex_lock(&p->run);
+    pthread_mutex_lock(&p->lock);
+    p->fn = fn;
+    p->ctx = ctx;
+    p->parts = parts;
+    p->next = 0;
+    p->left = parts;
+    p->job++;
+    pthread_cond_broadcast(&p->work);
+    pthread_mutex_unlock(&p->lock);
+    drain(p); // the caller works too
+    pthread_mutex_lock(&p->lock);
+    while (p->left > 0) pthread_cond_wait(&p->done, &p->lock);
+    pthread_mutex_unlock(&p->lock);
+    pthread_mutex_unlock(&p->run);
+}
+
+void pool_free(Pool *p) {
+    if (!p) return;
+    pthread_mutex_lock(&p->lock);
+    p->stop = 1;
+    pthread_cond_broadcast(&p->work);
+    pthread_mutex_unlock(&p->lock);
+    for (int i = 0; i < p->n; i++) pthread_join(p->th[i], NULL);
+    pthread_cond_destroy(&p->work);
+    pthread_cond_destroy(&p->done);
+    pthread_mutex_destroy(&p->lock);
+    pthread_mutex_destroy(&p->run);
+    free(p->th);
+    free(p);
+}
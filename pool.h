@@ -0,0 +1,37 @@
+#ifndef POOL_H
+#define POOL_H
+
+// Пул потоков для параллельных обходов таблицы.
+// Задание делится на части 0 .. parts-1; потоки пула и вызывающий
+// поток разбирают части по одной, pool_run возвращается, когда
+// выполнены все части. Порядок выполнения частей не определён,
+// поэтому результаты собираются по номеру части.
+
+typedef struct Pool Pool;
+
+// Обработка одной части задания
+typedef void (*PoolFn)(void *ctx, int part);
+
+/*
+ * Создать пул на threads потоков (вместе с вызывающим; <= 0 — по числу
+ * процессоров). Возвращает NULL при ошибке.
+ */
+Pool *pool_create(int threads);
+
+/*
+ * Число потоков пула (вместе с вызывающим).
+ */
+int pool_size(const Pool *p);
+
+/*
+ * Выполнить fn(ctx, part) для всех part из [0, parts) и дождаться окончания.
+ * Одновременные вызовы pool_run из разных потоков выполняются по очереди.
+ */
+void pool_run(Pool *p, PoolFn fn, void *ctx, int parts);
+
+/*
+ * Остановить потоки и освободить пул (NULL допустим).
+ */
+void pool_free(Pool *p);
+
+#endif // POOL_H
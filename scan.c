@@ -0,0 +1,118 @@
+#include "scan.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+static uint64_t eq64_scalar(const int *col, int value) {
+    uint64_t m = 0;
+    for (int i = 0; i < SCAN_BLOCK; i++) {
+        m |= (uint64_t)(col[i] == value) << i;
+    }
+    return m;
+}
+
+#ifdef SCAN_X86
+__attribute__((target("avx2")))
+static uint64_t eq64_avx2(const int *col, int value) {
+    __m256i v = _mm256_set1_epi32(value);
+    uint64_t m = 0;
+    for (int i = 0; i < SCAN_BLOCK; i += 8) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(col + i));
+        __m256i c = _mm256_cmpeq_epi32(x, v);
+        m |= (uint64_t)(unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(c)) << i;
+    }
+    return m;
+}
+
+// equality compare of 32-bit lanes only needs SSE2, which every x86-64 has
+__attribute__((target("sse2")))
+static uint64_t eq64_sse2(const int *col, int value) {
+    __m128i v = _mm_set1_epi32(value);
+    uint64_t m = 0;
+    for (int i = 0; i < SCAN_BLOCK; i += 4) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(col + i));
+        __m128i c = _mm_cmpeq_epi32(x, v);
+        m |= (uint64_t)(unsigned)_mm_movemask_ps(_mm_castsi128_ps(c)) << i;
+    }
+    return m;
+}
+#endif
+
+static int popcount64(uint64_t x) {
+#ifdef __GNUC__
+    return __builtin_popcountll(x);
+#else
+    int n = 0;
+    for (; x; x &= x - 1) n++;
+    return n;
+#endif
+}
+
+typedef uint64_t (*eq64_fn)(const int *col, int value);
+
+static uint64_t eq64_dispatch(const int *col, int value);
+static eq64_fn eq64 = eq64_dispatch;
+
+// picks the widest kernel the CPU supports on the first call
+static uint64_t eq64_dispatch(const int *col, int value) {
+    eq64_fn fn = eq64_scalar;
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) fn = eq64_avx2;
+    else if (__builtin_cpu_supports("sse2")) fn = eq64_sse2;
+#endif
+#ifdef __GNUC__
+    __atomic_store_n(&eq64, fn, __ATOMIC_RELAXED);
+#else
+    eq64 = fn;
+#endif
+    return fn(col, value);
+}
+
+// concurrent readers may all run the dispatcher; they store the same
+// pointer, and atomic accesses keep that well-defined
+static eq64_fn kernel(void) {
+#ifdef __GNUC__
+    return __atomic_load_n(&eq64, __ATOMIC_RELAXED);
+#else
+    return eq64;
+#endif
+}
+
+uint64_t scan_eq64(const int *col, int base, int value) {
+    return kernel()(col + base, value);
+}
+
+int scan_count_eq(const int *col, const uint64_t *busy, int nwords, int value) {
+    int n = 0;
+    eq64_fn fn = kernel();
+    for (int w = 0; w < nwords; w++) {
+        if (!busy[w]) continue; // empty block, nothing to compare
+        n += popcount64(fn(col + w * SCAN_BLOCK, value) & busy[w]);
+    }
+    return n;
+}
+
+int scan_next_busy(const uint64_t *busy, int nwords, int from) {
+    if (from < 0) from = 0;
+    int w = from / SCAN_BLOCK;
+    if (w >= nwords) return -1;
+    uint64_t bits = busy[w] & (~(uint64_t)0 << (from % SCAN_BLOCK));
+    while (!bits) {
+        if (++w >= nwords) return -1;
+        bits = busy[w];
+    }
+    return w * SCAN_BLOCK + scan_ctz(bits);
+}
+
+int scan_ctz(uint64_t mask) {
+#ifdef __GNUC__
+    return __builtin_ctzll(mask);
+#else
+    int n = 0;
+    while (!(mask & 1)) { mask >>= 1; n++; }
+    return n;
+#endif
+}
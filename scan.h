@@ -0,0 +1,36 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stdint.h>
+
+// Ядра сканирования столбцов таблицы.
+// Столбцы обрабатываются блоками по 64 слота: бит i результата
+// соответствует слоту base + i. На x86 реализация выбирается при первом
+// вызове (AVX2 или SSE2), на остальных платформах — скалярный вариант.
+
+#define SCAN_BLOCK 64
+
+/*
+ * Маска слотов блока [base, base + 64), у которых col[i] == value.
+ * Столбец должен содержать не менее base + 64 элементов.
+ */
+uint64_t scan_eq64(const int *col, int base, int value);
+
+/*
+ * Число занятых слотов (по битовой карте busy из nwords слов)
+ * со значением value в столбце col.
+ */
+int scan_count_eq(const int *col, const uint64_t *busy, int nwords, int value);
+
+/*
+ * Номер следующего занятого слота, начиная с from, или -1.
+ * nwords — длина битовой карты в 64-битных словах.
+ */
+int scan_next_busy(const uint64_t *busy, int nwords, int from);
+
+/*
+ * Номер младшего установленного бита (mask != 0).
+ */
+int scan_ctz(uint64_t mask);
+
+#endif // SCAN_H
@@ -0,0 +1,516 @@
+#include "script.h"
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#define READ_CHUNK (64 * 1024)
+
+// line reader over fread: lines of any length, '\n' or "\r\n" endings
+typedef struct {
+    FILE  *f;
+    char  *buf;   // cap bytes plus one for the terminating NUL
+    size_t cap;
+    size_t len;   // bytes in buf
+    size_t pos;   // start of the next line
+    int    eof;
+    int    err;
+} Lines;
+
+static int lines_init(Lines *r, FILE *f) {
+    r->f   = f;
+    r->buf = malloc(READ_CHUNK + 1);
+    r->cap = READ_CHUNK;
+    r->len = 0;
+    r->pos = 0;
+    r->eof = 0;
+    r->err = 0;
+    return r->buf ? 0 : -1;
+}
+
+// returns the next line without its ending (NUL-terminated) or NULL at the end
+static char *lines_next(Lines *r) {
+    for (;;) {
+        char *start = r->buf + r->pos;
+        char *nl = memchr(start, '\n', r->len - r->pos);
+        if (nl || (r->eof && r->pos < r->len)) {
+            char *end = nl ? nl : r->buf + r->len;
+            r->pos = nl ? (size_t)(nl - r->buf) + 1 : r->len;
+            if (end > start && end[-1] == '\r') end--;
+            *end = '\0'; // buf always has one spare byte for this
+            return start;
+        }
+        if (r->eof) return NULL;
+        // move the partial line to the front and read more
+        memmove(r->buf, start, r->len - r->pos);
+        r->len -= r->pos;
+        r->pos = 0;
+        if (r->len == r->cap) {
+            char *p = realloc(r->buf, r->cap * 2 + 1);
+            if (!p) {
+                r->err = 1;
+                return NULL;
+            }
+            r->buf = p;
+            r->cap *= 2;
+        }
+        size_t n = fread(r->buf + r->len, 1, r->cap - r->len, r->f);
+        r->len += n;
+        if (n == 0) {
+            r->eof = 1;
+            if (ferror(r->f)) r->err = 1;
+        }
+    }
+}
+
+static char *skip_space(char *p) {
+    while (*p == ' ' || *p == '\t') p++;
+    return p;
+}
+
+// next whitespace-separated word; NUL-terminates it and advances *p
+static char *word(char **p) {
+    char *s = skip_space(*p), *e = s;
+    while (*e && *e != ' ' && *e != '\t') e++;
+    if (*e) *e++ = '\0';
+    *p = e;
+    return s;
+}
+
+// parses a decimal int at *p (leading blanks allowed); returns 0 on success
+static int parse_int(char **p, int *out) {
+    char *s = skip_space(*p);
+    int neg = (*s == '-');
+    if (*s == '-' || *s == '+') s++;
+    if (*s < '0' || *s > '9') return -1;
+    long v = 0;
+    for (; *s >= '0' && *s <= '9'; s++) {
+        v = v * 10 + (*s - '0');
+        if (v > (long)INT_MAX + 1) return -1;
+    }
+    if (neg) v = -v;
+    if (v > INT_MAX || v < INT_MIN) return -1;
+    *out = (int)v;
+    *p = s;
+    return 0;
+}
+
+// parses an int that must be followed by a blank or the end of the line
+static int parse_field(char **p, int *out) {
+    if (parse_int(p, out) != 0) return -1;
+    return (**p == '\0' || **p == ' ' || **p == '\t') ? 0 : -1;
+}
+
+typedef struct {
+    Table  *tm;
+    FTable *ft;
+    FILE   *out;
+    int     quiet;
+    ScriptStats st;
+} Run;
+
+static const char *errstr(const Run *r, int code) {
+    return r->tm ? tm_errstr(code) : tf_errstr(code);
+}
+
+// ERR line; only the first line of the (possibly multi-line) message
+static void fail(Run *r, int code, const char *msg) {
+    if (!msg) msg = errstr(r, code);
+    const char *nl = strchr(msg, '\n');
+    fprintf(r->out, "ERR\t%d\t%.*s\n", code,
+            (int)(nl ? nl - msg : (long)strlen(msg)), msg);
+    r->st.errors++;
+}
+
+static void done(Run *r, int code) {
+    if (code != TM_OK) fail(r, code, NULL);
+    else if (!r->quiet) fputs("OK\n", r->out);
+}
+
+static int invalid(const Run *r) {
+    return r->tm ? TM_ERR_INVALID : TMF_ERR_INVALID;
+}
+
+static void do_search(Run *r, int par) {
+    if (r->tm) {
+        TmCursor c;
+        TmRow row;
+        tm_read_lock(r->tm);
+        tm_cursor_open(&c, r->tm, par);
+        fprintf(r->out, "ROWS\t%d\n", c.total);
+        while (tm_cursor_next(&c, &row))
+            fprintf(r->out, "%d\t%d\t%s\n", row.key, row.par, row.info);
+        tm_read_unlock(r->tm);
+        r->st.rows += c.total;
+        return;
+    }
+    TfCursor c;
+    TfRow row;
+    tf_read_lock(r->ft);
+    tf_cursor_open(&c, r->ft, par);
+    fprintf(r->out, "ROWS\t%d\n", c.total);
+    while (tf_cursor_next(&c, &row)) {
+        fprintf(r->out, "%d\t%d\t%s\n", row.key, row.par, row.info);
+        r->st.rows++;
+    }
+    int err = c.err;
+    tf_cursor_close(&c);
+    tf_read_unlock(r->ft);
+    if (err != TMF_OK) fail(r, err, NULL);
+}
+
+// query rows are buffered, since ROWS comes before them
+typedef struct {
+    OutBuf o;
+    long   n;
+} Rows;
+
+static void add_row(Rows *rs, int key, int par, const char *info) {
+    ob_int(&rs->o, key);
+    ob_str(&rs->o, "\t", 1);
+    ob_int(&rs->o, par);
+    ob_str(&rs->o, "\t", 1);
+    ob_cstr(&rs->o, info);
+    ob_str(&rs->o, "\n", 1);
+    rs->n++;
+}
+
+static int tm_row(const TmRow *row, void *ctx) {
+    add_row(ctx, row->key, row->par, row->info);
+    return 0;
+}
+
+static int tf_row(const TfRow *row, void *ctx) {
+    add_row(ctx, row->key, row->par, row->info);
+    return 0;
+}
+
+// ROWS and the buffered rows, or the error of the query that collected them
+static void put_rows(Run *r, Rows *rs, int res) {
+    if (res == TM_OK && rs->o.err) {
+        fail(r, r->tm ? TM_ERR_FULL : TMF_ERR_READ, "Out of memory");
+    } else if (res != TM_OK) {
+        fail(r, res, NULL);
+    } else {
+        fprintf(r->out, "ROWS\t%ld\n", rs->n);
+        fwrite(rs->o.buf, 1, rs->o.len, r->out);
+        r->st.rows += rs->n;
+    }
+    ob_free(&rs->o);
+}
+
+static void do_descendants(Run *r, int key) {
+    Rows rs;
+    ob_init(&rs.o, NULL, READ_CHUNK);
+    rs.n = 0;
+    put_rows(r, &rs, r->tm ? tm_descendants(r->tm, key, tm_row, &rs) : tf_descendants(r->ft, key, tf_row, &rs));
+}
+
+static void do_find(Run *r, const char *text, int prefix) {
+    Rows rs;
+    int res;
+    ob_init(&rs.o, NULL, READ_CHUNK);
+    rs.n = 0;
+    if (r->tm) res = prefix ? tm_find_prefix(r->tm, text, tm_row, &rs) : tm_find_substr(r->tm, text, tm_row, &rs);
+    else res = prefix ? tf_find_prefix(r->ft, text, tf_row, &rs) : tf_find_substr(r->ft, text, tf_row, &rs);
+    put_rows(r, &rs, res);
+}
+
+static void do_range(Run *r, int lo, int hi) {
+    Rows rs;
+    ob_init(&rs.o, NULL, READ_CHUNK);
+    rs.n = 0;
+    put_rows(r, &rs, r->tm ? tm_range(r->tm, lo, hi, tm_row, &rs) : tf_range(r->ft, lo, hi, tf_row, &rs));
+}
+
+// min / max: the row is read back by its key, so the file table delivers its info too
+static void do_edge(Run *r, int last) {
+    Rows rs;
+    int res;
+    ob_init(&rs.o, NULL, READ_CHUNK);
+    rs.n = 0;
+    if (r->tm) {
+        TmRow row;
+        res = last ? tm_max(r->tm, &row) : tm_min(r->tm, &row);
+        if (res == TM_OK) add_row(&rs, row.key, row.par, row.info);
+    } else {
+        FItem it;
+        res = last ? tf_max(r->ft, &it) : tf_min(r->ft, &it);
+        if (res == TMF_OK) res = tf_range(r->ft, it.key, it.key, tf_row, &rs);
+    }
+    put_rows(r, &rs, res);
+}
+
+static void do_ancestors(Run *r, int key) {
+    int path[64];
+    int *keys = path;
+    int n = r->tm ? tm_ancestors(r->tm, key, path, 64) : tf_ancestors(r->ft, key, path, 64);
+    if (n > 64) {
+        // deeper than the stack buffer: ask again with room for the whole path
+        keys = malloc((size_t)n * sizeof(int));
+        if (!keys) {
+            fail(r, r->tm ? TM_ERR_FULL : TMF_ERR_READ, "Out of memory");
+            return;
+        }
+        n = r->tm ? tm_ancestors(r->tm, key, keys, n) : tf_ancestors(r->ft, key, keys, n);
+    }
+    if (n < 0) {
+        fail(r, r->tm ? TM_ERR_NOT_FOUND : TMF_ERR_NOT_FOUND, NULL);
+    } else {
+        fprintf(r->out, "ROWS\t%d\n", n);
+        for (int i = 0; i < n; i++) fprintf(r->out, "%d\n", keys[i]);
+        r->st.rows += n;
+    }
+    if (keys != path) free(keys);
+}
+
+// appends the memory table to a file table opened with default options;
+// errors carry TMF_* codes
+static void do_to_file(Run *r, const char *path) {
+    FTable ft;
+    int loaded = 0;
+    int res = tf_open(&ft, path, 0);
+    if (res == TMF_OK) {
+        res = tf_load_table(&ft, r->tm, &loaded);
+        tf_close(&ft);
+    }
+    if (res != TMF_OK) fail(r, res, tf_errstr(res));
+    else fprintf(r->out, "OK\t%d\n", loaded);
+}
+
+// inserts rows[0..n) with one batch call; returns the number inserted
+static int load_batch(Run *r, const BatchRow *rows, int n) {
+    return r->tm ? tm_insert_batch(r->tm, rows, n, NULL)
+                 : tf_insert_batch(r->ft, rows, n, NULL);
+}
+
+static void do_load(Run *r, const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        fail(r, r->tm ? TM_ERR_INVALID : TMF_ERR_OPEN, "Cannot open CSV file");
+        return;
+    }
+    Lines in;
+    BatchRow *rows = malloc(SCRIPT_LOAD_BATCH * sizeof(BatchRow));
+    // info points into the reader's buffer, which moves on refill,
+    // so every row keeps its own copy until the batch is inserted
+    char **info = calloc(SCRIPT_LOAD_BATCH, sizeof(char *));
+    if (!rows || !info || lines_init(&in, f) != 0) {
+        free(rows);
+        free(info);
+        fclose(f);
+        fail(r, r->tm ? TM_ERR_FULL : TMF_ERR_READ, "Out of memory");
+        return;
+    }
+    long inserted = 0, rejected = 0;
+    int n = 0, oom = 0;
+    char *line;
+    while (!oom && (line = lines_next(&in)) != NULL) {
+        char *p = skip_space(line);
+        if (*p == '\0' || *p == '#') continue;
+        int key, par;
+        if (parse_int(&p, &key) != 0 || *(p = skip_space(p)) != ',' ||
+            (p++, parse_int(&p, &par)) != 0 || *(p = skip_space(p)) != ',') {
+            rejected++;
+            continue;
+        }
+        info[n] = strdup(p + 1);
+        if (!info[n]) {
+            oom = 1;
+            break;
+        }
+        rows[n].key  = key;
+        rows[n].par  = par;
+        rows[n].info = info[n];
+        if (++n == SCRIPT_LOAD_BATCH) {
+            int k = load_batch(r, rows, n);
+            inserted += k;
+            rejected += n - k;
+            for (int i = 0; i < n; i++) free(info[i]);
+            n = 0;
+        }
+    }
+    if (n > 0) {
+        int k = oom ? 0 : load_batch(r, rows, n);
+        inserted += k;
+        rejected += n - k;
+        for (int i = 0; i < n; i++) free(info[i]);
+    }
+    int rerr = in.err;
+    free(in.buf);
+    free(rows);
+    free(info);
+    fclose(f);
+    if (oom) fail(r, r->tm ? TM_ERR_FULL : TMF_ERR_READ, "Out of memory");
+    else if (rerr) fail(r, r->tm ? TM_ERR_INVALID : TMF_ERR_READ, "CSV read error");
+    fprintf(r->out, "LOADED\t%ld\t%ld\n", inserted, rejected);
+}
+
+// export [sorted] [root=K] [depth=D] [nodes=N] <file> | "|command"
+static void do_export(Run *r, char *p) {
+    DotFilter flt = { 0, 0, 0, 0 };
+    for (;;) {
+        p = skip_space(p);
+        if (!strncmp(p, "sorted", 6) && (p[6] == ' ' || p[6] == '\t')) {
+            flt.sorted = 1;
+            p += 6;
+            continue;
+        }
+        int *field = !strncmp(p, "root=", 5) ? &flt.root : !strncmp(p, "depth=", 6) ? &flt.max_depth : NULL;
+        int nodes;
+        if (!field && strncmp(p, "nodes=", 6) != 0) break;
+        p = strchr(p, '=') + 1;
+        if (parse_field(&p, field ? field : &nodes) != 0) {
+            fail(r, invalid(r), NULL);
+            return;
+        }
+        if (!field) flt.max_nodes = nodes;
+    }
+    if (!*p) {
+        fail(r, invalid(r), NULL);
+        return;
+    }
+    // "|command": stream into a pipe, e.g. "|dot -Tsvg -o tree.svg"
+    int pipe = (*p == '|');
+    FILE *f = pipe ? popen(skip_space(p + 1), "w") : fopen(p, "w");
+    if (!f) {
+        fail(r, r->tm ? TM_ERR_WRITE : TMF_ERR_OPEN, "Cannot open export target");
+        return;
+    }
+    int res = r->tm ? tm_export_dot_ex(r->tm, f, &flt) : tf_export_dot_ex(r->ft, f, &flt);
+    int closed = pipe ? pclose(f) : fclose(f);
+    if (res == TM_OK && closed != 0) res = r->tm ? TM_ERR_WRITE : TMF_ERR_WRITE;
+    done(r, res);
+}
+
+static void command(Run *r, char *line) {
+    char *p = skip_space(line);
+    if (*p == '\0' || *p == '#') return;
+    char *cmd = word(&p);
+    int key, par;
+    r->st.ops++;
+    if (!strcmp(cmd, "insert")) {
+        if (parse_field(&p, &key) != 0 || parse_field(&p, &par) != 0) {
+            fail(r, invalid(r), NULL);
+            return;
+        }
+        // info is the rest of the line after one separator
+        if (*p) p++;
+        done(r, r->tm ? tm_insert(r->tm, key, par, p) : tf_insert(r->ft, key, par, p));
+    } else if (!strcmp(cmd, "remove")) {
+        if (parse_field(&p, &key) != 0) {
+            fail(r, invalid(r), NULL);
+            return;
+        }
+        done(r, r->tm ? tm_remove(r->tm, key) : tf_remove(r->ft, key));
+    } else if (!strcmp(cmd, "search")) {
+        if (parse_field(&p, &par) != 0) {
+            fail(r, invalid(r), NULL);
+            return;
+        }
+        do_search(r, par);
+    } else if (!strcmp(cmd, "descendants") || !strcmp(cmd, "ancestors")) {
+        if (parse_field(&p, &key) != 0) {
+            fail(r, invalid(r), NULL);
+            return;
+        }
+        if (cmd[0] == 'd') do_descendants(r, key);
+        else do_ancestors(r, key);
+    } else if (!strcmp(cmd, "is_ancestor")) {
+        if (parse_field(&p, &par) != 0 || parse_field(&p, &key) != 0) {
+            fail(r, invalid(r), NULL);
+            return;
+        }
+        int res = r->tm ? tm_is_ancestor(r->tm, par, key) : tf_is_ancestor(r->ft, par, key);
+        if (res < 0) fail(r, r->tm ? TM_ERR_NOT_FOUND : TMF_ERR_NOT_FOUND, NULL);
+        else fprintf(r->out, "OK\t%d\n", res);
+    } else if (!strcmp(cmd, "range")) {
+        if (parse_field(&p, &key) != 0 || parse_field(&p, &par) != 0) {
+            fail(r, invalid(r), NULL);
+            return;
+        }
+        do_range(r, key, par);
+    } else if (!strcmp(cmd, "min") || !strcmp(cmd, "max")) {
+        do_edge(r, cmd[1] == 'a');
+    } else if (!strcmp(cmd, "prefix") || !strcmp(cmd, "substr")) {
+        // the text is the rest of the line after one separator (word() took it)
+        do_find(r, p, cmd[0] == 'p');
+    } else if (!strcmp(cmd, "info_index")) {
+        char *arg = word(&p);
+        int on = !strcmp(arg, "on");
+        if (!on && strcmp(arg, "off")) {
+            fail(r, invalid(r), NULL);
+            return;
+        }
+        done(r, r->tm ? tm_set_info_index(r->tm, on) : tf_set_info_index(r->ft, on));
+    } else if (!strcmp(cmd, "print")) {
+        char *arg = word(&p);
+        int sorted = !strcmp(arg, "sorted");
+        if (!sorted && *arg) {
+            fail(r, invalid(r), NULL);
+            return;
+        }
+        // the table functions write to stdout
+        fflush(r->out);
+        if (r->tm && sorted) tm_print_sorted(r->tm);
+        else if (r->tm) tm_print(r->tm);
+        else if (sorted) tf_print_sorted(r->ft);
+        else tf_print(r->ft);
+        fflush(stdout);
+    } else if (!strcmp(cmd, "export")) {
+        do_export(r, p);
+    } else if (!strcmp(cmd, "load")) {
+        char *path = word(&p);
+        if (!*path) {
+            fail(r, invalid(r), NULL);
+            return;
+        }
+        do_load(r, path);
+    } else if (!strcmp(cmd, "stats")) {
+        TableStats st;
+        int res = r->tm ? tm_stats(r->tm, &st) : tf_stats(r->ft, &st);
+        if (res != TM_OK) fail(r, res, "Statistics are off (build with -DTABLE_STATS)");
+        else st_print(&st, r->out);
+    } else if (!strcmp(cmd, "snapshot") && r->tm) {
+        char *path = word(&p);
+        done(r, *path ? tm_save_snapshot(r->tm, path) : TM_ERR_INVALID);
+    } else if (!strcmp(cmd, "to_file") && r->tm) {
+        char *path = word(&p);
+        if (!*path) {
+            fail(r, TM_ERR_INVALID, NULL);
+            return;
+        }
+        do_to_file(r, path);
+    } else if (!strcmp(cmd, "sync") && r->ft) {
+        done(r, tf_sync(r->ft));
+    } else if (!strcmp(cmd, "compact") && r->ft) {
+        int order = 0;
+        long reclaimed = 0;
+        if (*skip_space(p) && parse_field(&p, &order) != 0) {
+            fail(r, invalid(r), NULL);
+            return;
+        }
+        int res = tf_compact(r->ft, order, &reclaimed);
+        if (res != TMF_OK) fail(r, res, NULL);
+        else fprintf(r->out, "OK\t%ld\n", reclaimed);
+    } else {
+        fail(r, invalid(r), "Unknown command");
+    }
+}
+
+int script_run(Table *tm, FTable *ft, FILE *in, FILE *out, int quiet,
+               ScriptStats *st) {
+    Run r = { tm, ft, out, quiet, { 0, 0, 0 } };
+    Lines rd;
+    if (lines_init(&rd, in) != 0) return -1;
+    char *line;
+    while ((line = lines_next(&rd)) != NULL) {
+        command(&r, line);
+        // a failed reopen in tf_compact leaves no table to work with
+        if (ft && !ft->f) break;
+    }
+    int err = rd.err;
+    free(rd.buf);
+    fflush(out);
+    if (st) *st = r.st;
+    return err ? -1 : 0;
+}
@@ -0,0 +1,64 @@
+#ifndef SCRIPT_H
+#define SCRIPT_H
+
+#include <stdio.h>
+#include "table_mem.h"
+#include "table_file.h"
+#include "convert.h"
+
+// Пакетный режим: команды читаются построчно из файла или stdin,
+// результаты пишутся в out без цветов, поля разделены табуляцией.
+// Команды (поля через пробелы, info — остаток строки, пробелы допустимы,
+// длина не ограничена; пустые строки и строки с '#' пропускаются):
+//   insert <key> <par> <info>  -> OK
+//   remove <key>               -> OK
+//   search <par>               -> ROWS <n>, затем n строк <key> <par> <info>
+//   descendants <key>          -> ROWS <n>, затем n строк <key> <par> <info>
+//                                 (всё поддерево в прямом порядке)
+//   ancestors <key>            -> ROWS <n>, затем n ключей от родителя к корню
+//   is_ancestor <anc> <key>    -> OK 1 или OK 0
+//   info_index on|off          -> OK (вторичный индекс по info, см. info_index.h)
+//   prefix <text>              -> ROWS <n>, затем n строк <key> <par> <info>
+//                                 (info начинается с text; с индексом —
+//                                 по возрастанию info)
+//   substr <text>              -> ROWS <n>, затем строки, info которых
+//                                 содержит text
+//   range <lo> <hi>            -> ROWS <n>, затем строки с ключами из
+//                                 [lo, hi] по возрастанию ключей
+//   min | max                  -> ROWS 1, затем строка с наименьшим
+//                                 (наибольшим) ключом
+//   print [sorted]             -> вывод tm_print / tf_print
+//                                 (sorted — по возрастанию ключей)
+//   export [sorted] [root=K] [depth=D] [nodes=N] <file>
+//                              -> OK (Graphviz DOT; поддерево K не глубже D
+//                                 уровней и не больше N узлов; sorted без
+//                                 ограничений — узлы по возрастанию ключей;
+//                                 "|команда" вместо файла — вывод в канал,
+//                                 например "|dot -Tsvg -o tree.svg")
+//   load <file.csv>            -> LOADED <вставлено> <отклонено>
+//                                 (строки key,par,info; пакетами)
+//   stats                      -> строки "<имя> <значение>" (см. st_print)
+//   snapshot <file>            -> OK (только таблица в памяти, см. tm_save_snapshot)
+//   to_file <file.dat>         -> OK <записано> (только таблица в памяти:
+//                                 элементы дописываются в файловую таблицу)
+//   sync                       -> OK (только файловая таблица)
+//   compact [order]            -> OK <освобождено байт> (только файловая)
+// Ошибка команды: ERR <код> <сообщение>. С quiet строки OK не выводятся.
+
+#define SCRIPT_LOAD_BATCH 4096 // строк CSV в одном пакете вставки
+
+// Итоги выполнения
+typedef struct {
+    long ops;     // выполнено команд
+    long errors;  // из них с ошибкой
+    long rows;    // строк выдано поиском
+} ScriptStats;
+
+/*
+ * Выполнить команды из in над таблицей tm или ft (ровно одна не NULL).
+ * st (может быть NULL) — итоги. Возвращает 0 или -1 при ошибке чтения in.
+ */
+int script_run(Table *tm, FTable *ft, FILE *in, FILE *out, int quiet,
+               ScriptStats *st);
+
+#endif // SCRIPT_H
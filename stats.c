@@ -0,0 +1,62 @@
+#include "stats.h"
+#include <time.h>
+
+static const char *op_names[ST_OPS] = { "insert", "remove", "search", "print", "export" };
+
+const char *st_op_name(int op) {
+    return op >= 0 && op < ST_OPS ? op_names[op] : "unknown";
+}
+
+long st_quantile(const TableStats *s, int op, double q) {
+    long n = s->ops[op];
+    if (n == 0) return 0;
+    long want = (long)(q * n + 0.5), seen = 0;
+    if (want < 1) want = 1;
+    for (int b = 0; b < ST_BUCKETS; b++) {
+        seen += s->hist[op][b];
+        if (seen >= want) return 1L << (b + 1);
+    }
+    return 1L << ST_BUCKETS;
+}
+
+void st_print(const TableStats *s, FILE *f) {
+    fprintf(f, "slots %ld\n", s->slots);
+    fprintf(f, "seeks %ld\n", s->seeks);
+    fprintf(f, "reads %ld\n", s->reads);
+    fprintf(f, "writes %ld\n", s->writes);
+    fprintf(f, "bytes_read %ld\n", s->bytes_read);
+    fprintf(f, "bytes_written %ld\n", s->bytes_written);
+    fprintf(f, "allocs %ld\n", s->allocs);
+    for (int op = 0; op < ST_OPS; op++) {
+        if (s->ops[op] == 0) continue;
+        fprintf(f, "%s count=%ld avg_ns=%ld p50_ns<=%ld p99_ns<=%ld\n",
+                op_names[op], s->ops[op], s->ns[op] / s->ops[op],
+                st_quantile(s, op, 0.50), st_quantile(s, op, 0.99));
+    }
+}
+
+#ifdef TABLE_STATS
+
+long st_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+void st_record(TableStats *s, int op, long ns) {
+    int b = 0;
+    for (unsigned long v = ns > 1 ? (unsigned long)ns : 1; v > 1 && b < ST_BUCKETS - 1; v >>= 1) b++;
+    __atomic_fetch_add(&s->ops[op], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&s->ns[op], ns, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&s->hist[op][b], 1, __ATOMIC_RELAXED);
+}
+
+void st_copy(TableStats *dst, const TableStats *src) {
+    // TableStats holds nothing but longs
+    const long *from = (const long *)src;
+    long *to = (long *)dst;
+    for (size_t i = 0; i < sizeof(TableStats) / sizeof(long); i++)
+        to[i] = __atomic_load_n(&from[i], __ATOMIC_RELAXED);
+}
+
+#endif // TABLE_STATS
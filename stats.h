@@ -0,0 +1,85 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+
+// Статистика операций таблиц (Table и FTable).
+// Счётчики и гистограммы задержек ведутся только в сборке с
+// -DTABLE_STATS: без него макросы ST_* пусты, поля stats в таблицах нет,
+// а tm_stats / tf_stats возвращают нули и TM_ERR_INVALID / TMF_ERR_INVALID.
+// Все единицы трансляции должны собираться с одним и тем же TABLE_STATS.
+// Счётчики увеличиваются атомарно, поэтому их можно вести и в
+// параллельном режиме таблиц.
+
+// Операции с замером задержки
+#define ST_INSERT 0
+#define ST_REMOVE 1
+#define ST_SEARCH 2
+#define ST_PRINT  3
+#define ST_EXPORT 4
+#define ST_OPS    5
+
+#define ST_BUCKETS 40 // корзина i — задержки [2^i, 2^(i+1)) нс, последняя — всё больше
+
+typedef struct {
+    long slots;          // просмотрено слотов (списки потомков, сканирование, обходы)
+    long seeks;          // вызовов fseek
+    long reads;          // вызовов чтения (pread; в режиме mmap — копирований)
+    long writes;         // вызовов записи (fwrite, pwrite)
+    long bytes_read;     // прочитано байт
+    long bytes_written;  // записано байт
+    long allocs;         // выделений памяти (malloc, calloc, realloc)
+    long ops[ST_OPS];    // выполнено операций
+    long ns[ST_OPS];     // суммарное время операций, нс
+    long hist[ST_OPS][ST_BUCKETS]; // гистограмма задержек
+} TableStats;
+
+/*
+ * Название операции ST_* ("insert", "remove", ...).
+ */
+const char *st_op_name(int op);
+
+/*
+ * Оценка квантиля q (0..1) задержки операции op в нс по гистограмме
+ * (верхняя граница корзины) или 0, если операций не было.
+ */
+long st_quantile(const TableStats *s, int op, double q);
+
+/*
+ * Вывести статистику в f в виде строк "имя значение".
+ */
+void st_print(const TableStats *s, FILE *f);
+
+#ifdef TABLE_STATS
+
+/*
+ * Монотонное время в нс.
+ */
+long st_now(void);
+
+/*
+ * Учесть операцию op длительностью ns.
+ */
+void st_record(TableStats *s, int op, long ns);
+
+/*
+ * Копия счётчиков src, которые могут увеличиваться другими потоками
+ * (каждый счётчик читается атомарно, вместе они не согласованы).
+ */
+void st_copy(TableStats *dst, const TableStats *src);
+
+// s — указатель на TableStats (у константной таблицы тоже изменяемый)
+#define ST_ADD(s, field, n) \
+    __atomic_fetch_add(&((TableStats *)(s))->field, (long)(n), __ATOMIC_RELAXED)
+#define ST_BEGIN(t0)      long t0 = st_now()
+#define ST_END(s, op, t0) st_record((TableStats *)(s), op, st_now() - (t0))
+
+#else
+
+#define ST_ADD(s, field, n) ((void)0)
+#define ST_BEGIN(t0)        ((void)0)
+#define ST_END(s, op, t0)   ((void)0)
+
+#endif // TABLE_STATS
+
+#endif // STATS_H
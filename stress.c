@@ -0,0 +1,686 @@
+// Стресс-тест параллельного режима Table и FTable (отдельная программа
+// со своим main). Один поток-писатель меняет таблицу:
+//   - вставляет и удаляет элементы и поддеревья, по одному и пакетами;
+//   - включает и выключает индекс по info;
+//   - сбрасывает FTable на диск.
+// Одновременно N потоков-читателей выполняют запросы:
+//   - поиск по родителю обработчиком, курсором и в буфер, а по FItem
+//     из буфера — tf_read_info;
+//   - обход потомков, список предков и проверку "является ли предком";
+//   - поиск по префиксу и подстроке info;
+//   - диапазоны ключей и min/max.
+// Каждый ответ проверяется:
+//   - par и info строки — те, с которыми вставлялся её ключ;
+//   - у строк поиска по родителю par равен искомому;
+//   - потомки идут в прямом порядке: родитель строки — корень обхода
+//     или уже выданная строка; предки идут от родителя к корню;
+//   - info начинается с префикса или содержит подстроку;
+//   - ключи диапазона возрастают и лежат в [lo, hi], min всегда равен 1;
+//   - ключи 1..S ("постоянные") писатель не трогает, поэтому каждый ответ
+//     содержит все подходящие постоянные строки, а tf_read_info по их
+//     FItem возвращает их info.
+// FTable проверяется в режимах обычном, mmap, с журналом, страничном
+// и со сжатием. Режим crash проверяет восстановление: процесс-писатель
+// завершается без tf_close, а строки после воспроизведения журнала
+// и новых вставок должны остаться теми же. Код возврата: 0 — нарушений
+// нет, 1 — найдены (первые выводятся в stderr), 2 — неверные параметры
+// или ошибка открытия.
+//
+//   stress [--mode=mem|file|mmap|wal|paged|zip|crash|all] [--readers=N]
+//          [--keys=N] [--ops=N] [--file=path] [--seed=N]
+//
+// Сборка (все .c, кроме программ со своим main):
+//   cc -O2 -o stress stress.c $(ls *.c | grep -v -e '^main.c$' -e '^bench.c$' -e '^stress.c$') -lpthread -lm
+// Проверка гонок — та же команда с -O1 -g -fsanitize=thread вместо -O2.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "table_mem.h"
+#include "table_file.h"
+
+#define FAN         8   // потомков у узла: родитель ключа k > FAN — k / FAN
+#define INFO_MAX    96  // info ключа вместе с '\0'
+#define MAX_RANGE   200 // наибольшая длина запроса диапазона
+#define MAX_DEPTH   32  // предков у ключа (log_FAN числа ключей)
+#define BATCH       16  // строк в пакете писателя
+#define MAX_REPORT  20  // нарушений, выводимых в stderr
+
+static const char *mode_name[] = { "mem", "file", "mmap", "wal", "paged", "zip", "crash" };
+#define MODES (int)(sizeof(mode_name) / sizeof(mode_name[0]))
+
+// Общее состояние одного прогона
+typedef struct {
+    const char *mode;
+    int     file;     // 0 — Table, 1 — FTable
+    Table   tm;
+    FTable  ft;
+    int     keys;     // ключи 1..keys
+    int     stable;   // ключи 1..stable писатель не удаляет
+    int     stop;     // 1 — писатель закончил (атомарно)
+    long    reads;    // выполнено запросов (атомарно)
+} Ctx;
+
+// Вид проверки строки результата
+enum {
+    Q_SEARCH,   // поиск по родителю
+    Q_DESC,     // обход потомков
+    Q_RANGE,    // диапазон ключей
+    Q_PREFIX,   // поиск по префиксу info
+    Q_SUBSTR,   // поиск по подстроке info
+};
+
+// Проверка одного запроса
+typedef struct {
+    Ctx        *c;
+    const char *op;     // имя запроса для сообщений
+    int         kind;   // Q_*
+    int         arg;    // искомый родитель (Q_SEARCH) или корень обхода (Q_DESC)
+    int         lo, hi; // границы диапазона (Q_RANGE)
+    int         last;   // предыдущий ключ диапазона
+    const char *text;   // префикс или подстрока
+    char       *seen;   // выданные обходом ключи (Q_DESC)
+    int        *list;   // те же ключи списком, чтобы сбросить seen
+    int         rows;   // выдано строк
+    int         stable; // из них постоянных
+} Walk;
+
+// Поток-читатель
+typedef struct {
+    Ctx      *c;
+    unsigned  seed;
+    char     *seen;
+    int      *list;
+} Reader;
+
+static long violations;
+
+
+static void violation(const Ctx *c, const char *op, const char *what, int a, int b) {
+    long n = __atomic_add_fetch(&violations, 1, __ATOMIC_RELAXED);
+    if (n <= MAX_REPORT) fprintf(stderr, "stress: %s: %s: %s (%d, %d)\n", c->mode, op, what, a, b);
+}
+
+
+static int parent_of(int k) {
+    return k <= FAN ? 0 : k / FAN;
+}
+
+
+// info ключа: ключ, родитель и хвост переменной длины
+static void make_info(int k, char *buf) {
+    snprintf(buf, INFO_MAX, "k%dp%d-%.*s", k, parent_of(k), k * 7 % 40,
+             "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx");
+}
+
+
+// 1, если a — предок k
+static int ancestor_of(int a, int k) {
+    while (k > 0) {
+        k = parent_of(k);
+        if (k == a) return 1;
+    }
+    return 0;
+}
+
+
+// Число постоянных потомков p первого уровня
+static int stable_children(const Ctx *c, int p) {
+    int lo = p == 0 ? 1 : p * FAN, n = 0;
+    for (int k = lo; k < lo + FAN && k <= c->stable; k++) n += parent_of(k) == p;
+    return n;
+}
+
+
+static int stable_descendants(const Ctx *c, int a) {
+    int n = 0;
+    for (int k = a + 1; k <= c->stable; k++) n += ancestor_of(a, k);
+    return n;
+}
+
+
+// Общая проверка строки результата; возвращает 0 (продолжать обход)
+static int check_row(Walk *w, int key, int par, const char *info) {
+    const Ctx *c = w->c;
+    char want[INFO_MAX];
+    w->rows++;
+    if (key < 1 || key > c->keys) {
+        violation(c, w->op, "ключа нет в таблице", key, par);
+        return 0;
+    }
+    make_info(key, want);
+    if (par != parent_of(key) || strcmp(info, want) != 0) violation(c, w->op, "строка не соответствует ключу", key, par);
+    switch (w->kind) {
+        case Q_SEARCH:
+            if (par != w->arg) violation(c, w->op, "родитель строки не равен искомому", key, w->arg);
+            break;
+        case Q_DESC:
+            if (key == w->arg || w->seen[key] || w->rows > c->keys || (par != w->arg && !w->seen[par])) {
+                violation(c, w->op, "нарушен прямой порядок обхода", key, w->arg);
+            } else {
+                w->seen[key] = 1;
+                w->list[w->rows - 1] = key;
+            }
+            break;
+        case Q_RANGE:
+            if (key < w->lo || key > w->hi || key <= w->last) violation(c, w->op, "ключ вне диапазона или не по возрастанию", key, w->last);
+            w->last = key;
+            break;
+        case Q_PREFIX:
+            if (strncmp(info, w->text, strlen(w->text)) != 0) violation(c, w->op, "info не начинается с префикса", key, 0);
+            break;
+        case Q_SUBSTR:
+            if (!strstr(info, w->text)) violation(c, w->op, "info не содержит подстроку", key, 0);
+            break;
+    }
+    if (key <= c->stable) w->stable++;
+    return 0;
+}
+
+
+static int tm_row(const TmRow *row, void *ctx) {
+    return check_row(ctx, row->key, row->par, row->info);
+}
+
+
+static int tf_row(const TfRow *row, void *ctx) {
+    return check_row(ctx, row->key, row->par, row->info);
+}
+
+
+// Постоянные строки результата: все подходящие, не больше и не меньше
+static void expect_stable(const Walk *w, int want) {
+    if (w->stable != want) violation(w->c, w->op, "найдены не все постоянные строки", w->stable, want);
+}
+
+
+static void walk_init(Walk *w, Reader *r, const char *op, int kind) {
+    memset(w, 0, sizeof(*w));
+    w->c = r->c;
+    w->op = op;
+    w->kind = kind;
+    w->seen = r->seen;
+    w->list = r->list;
+}
+
+
+static void q_search(Reader *r, int cursor) {
+    Ctx *c = r->c;
+    Walk w;
+    walk_init(&w, r, cursor ? "cursor" : "search_each", Q_SEARCH);
+    w.arg = rand_r(&r->seed) % (c->keys / FAN + 1);
+    if (!c->file && !cursor) {
+        tm_search_each(&c->tm, w.arg, tm_row, &w);
+    } else if (!c->file) {
+        TmCursor cur;
+        TmRow row;
+        tm_read_lock(&c->tm);
+        tm_cursor_open(&cur, &c->tm, w.arg);
+        while (tm_cursor_next(&cur, &row)) tm_row(&row, &w);
+        tm_read_unlock(&c->tm);
+    } else if (!cursor) {
+        tf_search_each(&c->ft, w.arg, tf_row, &w);
+    } else {
+        TfCursor cur;
+        TfRow row;
+        tf_read_lock(&c->ft);
+        tf_cursor_open(&cur, &c->ft, w.arg);
+        while (tf_cursor_next(&cur, &row)) tf_row(&row, &w);
+        if (cur.err != TMF_OK) violation(c, w.op, "ошибка чтения", cur.err, w.arg);
+        tf_cursor_close(&cur);
+        tf_read_unlock(&c->ft);
+    }
+    expect_stable(&w, stable_children(c, w.arg));
+}
+
+
+static void q_descendants(Reader *r) {
+    Ctx *c = r->c;
+    Walk w;
+    walk_init(&w, r, "descendants", Q_DESC);
+    w.arg = 1 + rand_r(&r->seed) % c->keys;
+    int res = c->file ? tf_descendants(&c->ft, w.arg, tf_row, &w) : tm_descendants(&c->tm, w.arg, tm_row, &w);
+    int ok = c->file ? TMF_OK : TM_OK, missing = c->file ? TMF_ERR_NOT_FOUND : TM_ERR_NOT_FOUND;
+    if (res != ok && (res != missing || w.arg <= c->stable)) violation(c, w.op, "неожиданный результат", res, w.arg);
+    if (w.arg <= c->stable) expect_stable(&w, stable_descendants(c, w.arg));
+    for (int i = 0; i < w.rows; i++) {
+        if (w.list[i] > 0 && w.list[i] <= c->keys) w.seen[w.list[i]] = 0;
+        w.list[i] = 0;
+    }
+}
+
+
+static void q_range(Reader *r) {
+    Ctx *c = r->c;
+    Walk w;
+    walk_init(&w, r, "range", Q_RANGE);
+    w.lo = 1 + rand_r(&r->seed) % c->keys;
+    w.hi = w.lo + rand_r(&r->seed) % MAX_RANGE;
+    int res = c->file ? tf_range(&c->ft, w.lo, w.hi, tf_row, &w) : tm_range(&c->tm, w.lo, w.hi, tm_row, &w);
+    if (res != 0) violation(c, w.op, "неожиданный результат", res, w.lo);
+    int top = w.hi < c->stable ? w.hi : c->stable;
+    expect_stable(&w, top >= w.lo ? top - w.lo + 1 : 0);
+}
+
+
+static void q_text(Reader *r, int substr) {
+    Ctx *c = r->c;
+    Walk w;
+    char text[32], info[INFO_MAX];
+    walk_init(&w, r, substr ? "find_substr" : "find_prefix", substr ? Q_SUBSTR : Q_PREFIX);
+    // подстрока "p<родитель>-" есть ровно у потомков первого уровня
+    if (substr) snprintf(text, sizeof(text), "p%d-", rand_r(&r->seed) % (c->keys / FAN + 1));
+    else snprintf(text, sizeof(text), "k%d", 1 + rand_r(&r->seed) % 999);
+    w.text = text;
+    int res;
+    if (c->file) res = substr ? tf_find_substr(&c->ft, text, tf_row, &w) : tf_find_prefix(&c->ft, text, tf_row, &w);
+    else res = substr ? tm_find_substr(&c->tm, text, tm_row, &w) : tm_find_prefix(&c->tm, text, tm_row, &w);
+    if (res != 0) violation(c, w.op, "неожиданный результат", res, 0);
+    int want = 0;
+    for (int k = 1; k <= c->stable; k++) {
+        make_info(k, info);
+        want += substr ? strstr(info, text) != NULL : strncmp(info, text, strlen(text)) == 0;
+    }
+    expect_stable(&w, want);
+}
+
+
+static void q_ancestor(Reader *r) {
+    Ctx *c = r->c;
+    int k = 1 + rand_r(&r->seed) % c->keys;
+    // родитель или дед ключа либо случайный ключ, поровну
+    int a = 1 + rand_r(&r->seed) % c->keys;
+    if (rand_r(&r->seed) % 2 && parent_of(k) > 0) {
+        a = parent_of(k);
+        if (rand_r(&r->seed) % 2 && parent_of(a) > 0) a = parent_of(a);
+    }
+    int want = ancestor_of(a, k);
+    int res = c->file ? tf_is_ancestor(&c->ft, a, k) : tm_is_ancestor(&c->tm, a, k);
+    // -1 (ключа нет) возможно только у ключей, которые удаляет писатель
+    if (res != want && (res != -1 || (k <= c->stable && a <= c->stable))) violation(c, "is_ancestor", "неверный ответ", a, k);
+
+    int chain[MAX_DEPTH];
+    int n = c->file ? tf_ancestors(&c->ft, k, chain, MAX_DEPTH) : tm_ancestors(&c->tm, k, chain, MAX_DEPTH);
+    if (n < 0 && k <= c->stable) violation(c, "ancestors", "постоянного ключа нет", k, n);
+    for (int i = 0, p = parent_of(k); i < n && i < MAX_DEPTH; i++, p = parent_of(p)) {
+        if (chain[i] != p) {
+            violation(c, "ancestors", "неверный предок", k, chain[i]);
+            break;
+        }
+    }
+}
+
+
+// tf_read_info по FItem: info каждого ключа известна заранее
+static void check_item(Reader *r, const char *op, const FItem *it) {
+    Ctx *c = r->c;
+    char buf[INFO_MAX], want[INFO_MAX];
+    int res = tf_read_info(&c->ft, it, buf, sizeof(buf));
+    // копия изменяемой строки могла устареть: строку удалили или вставили заново
+    if (res == TMF_ERR_NOT_FOUND && it->key > c->stable) return;
+    make_info(it->key, want);
+    if (res != TMF_OK || strcmp(buf, want) != 0 || it->par != parent_of(it->key)) violation(c, op, "tf_read_info вернул не ту info", it->key, res);
+}
+
+
+// Поиск в буфер. У Table проверяются только ключи: info строк указывает
+// в таблицу и после возврата может быть уже освобождена
+static void q_fill(Reader *r) {
+    Ctx *c = r->c;
+    int p = rand_r(&r->seed) % (c->keys / FAN + 1), n, stable = 0;
+    if (!c->file) {
+        TmRow rows[2 * FAN];
+        n = tm_search_fill(&c->tm, p, rows, 2 * FAN);
+        for (int i = 0; i < n && i < 2 * FAN; i++) {
+            if (rows[i].par != p || parent_of(rows[i].key) != p) violation(c, "search_fill", "родитель строки не равен искомому", rows[i].key, p);
+            stable += rows[i].key <= c->stable;
+        }
+    } else {
+        FItem items[2 * FAN];
+        n = tf_search_fill(&c->ft, p, items, 2 * FAN);
+        for (int i = 0; i < n && i < 2 * FAN; i++) {
+            if (items[i].par != p) violation(c, "search_fill", "родитель строки не равен искомому", items[i].key, p);
+            check_item(r, "search_fill", &items[i]);
+            stable += items[i].key <= c->stable;
+        }
+    }
+    if (n > FAN) violation(c, "search_fill", "строк больше, чем потомков", n, p);
+    if (stable != stable_children(c, p)) violation(c, "search_fill", "найдены не все постоянные строки", stable, stable_children(c, p));
+}
+
+
+static void q_edges(Reader *r) {
+    Ctx *c = r->c;
+    if (!c->file) {
+        TmRow lo = { 0, 0, NULL }, hi = { 0, 0, NULL };
+        if (tm_min(&c->tm, &lo) != TM_OK || lo.key != 1) violation(c, "min", "наименьший ключ не 1", lo.key, 0);
+        if (tm_max(&c->tm, &hi) != TM_OK || hi.key < c->stable || hi.key > c->keys) violation(c, "max", "неверный наибольший ключ", hi.key, 0);
+        return;
+    }
+    FItem lo, hi;
+    memset(&lo, 0, sizeof(lo));
+    memset(&hi, 0, sizeof(hi));
+    if (tf_min(&c->ft, &lo) != TMF_OK || lo.key != 1) violation(c, "min", "наименьший ключ не 1", lo.key, 0);
+    else check_item(r, "min", &lo);
+    if (tf_max(&c->ft, &hi) != TMF_OK || hi.key < c->stable || hi.key > c->keys) violation(c, "max", "неверный наибольший ключ", hi.key, 0);
+    else check_item(r, "max", &hi);
+}
+
+
+static void *reader_main(void *arg) {
+    Reader *r = arg;
+    Ctx *c = r->c;
+    while (!__atomic_load_n(&c->stop, __ATOMIC_ACQUIRE)) {
+        // поиск по info без индекса сканирует всю таблицу, поэтому он реже
+        switch (rand_r(&r->seed) % 16) {
+            case 0: case 1: q_search(r, 0); break;
+            case 2: case 3: q_search(r, 1); break;
+            case 4: case 5: q_descendants(r); break;
+            case 6: case 7: q_range(r); break;
+            case 8: q_text(r, 0); break;
+            case 9: q_text(r, 1); break;
+            case 10: case 11: case 12: q_ancestor(r); break;
+            case 13: q_edges(r); break;
+            default: q_fill(r); break;
+        }
+        __atomic_add_fetch(&c->reads, 1, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+
+// Неожиданная ошибка изменения: ожидаемы только "уже есть" и "нет ключа или родителя"
+static void check_write(const Ctx *c, const char *op, int res, int key) {
+    int bad = c->file ? res == TMF_ERR_OPEN || res == TMF_ERR_WRITE || res == TMF_ERR_READ
+                      : res == TM_ERR_FULL;
+    if (bad) violation(c, op, "ошибка изменения", res, key);
+}
+
+
+static void writer(Ctx *c, int ops, unsigned seed) {
+    char infos[BATCH][INFO_MAX], info[INFO_MAX];
+    BatchRow rows[BATCH];
+    int keys[BATCH], errs[BATCH], index_on = 0;
+    for (int i = 0; i < ops; i++) {
+        int k = c->stable + 1 + rand_r(&seed) % (c->keys - c->stable);
+        int what = rand_r(&seed) % 100;
+        if (what < 45) {
+            make_info(k, info);
+            check_write(c, "insert", c->file ? tf_insert(&c->ft, k, parent_of(k), info) : tm_insert(&c->tm, k, parent_of(k), info), k);
+        } else if (what < 90) {
+            check_write(c, "remove", c->file ? tf_remove(&c->ft, k) : tm_remove(&c->tm, k), k);
+        } else if (what < 95) {
+            // подряд идущие ключи: родители части строк приходят в том же пакете
+            int n = 0;
+            for (int j = 0; j < BATCH && k + j <= c->keys; j++, n++) {
+                make_info(k + j, infos[j]);
+                rows[j].key = k + j;
+                rows[j].par = parent_of(k + j);
+                rows[j].info = infos[j];
+            }
+            if (c->file) tf_insert_batch(&c->ft, rows, n, errs);
+            else tm_insert_batch(&c->tm, rows, n, errs);
+            for (int j = 0; j < n; j++) check_write(c, "insert_batch", errs[j], rows[j].key);
+        } else {
+            for (int j = 0; j < BATCH; j++) keys[j] = c->stable + 1 + rand_r(&seed) % (c->keys - c->stable);
+            if (c->file) tf_remove_batch(&c->ft, keys, BATCH, errs);
+            else tm_remove_batch(&c->tm, keys, BATCH, errs);
+            for (int j = 0; j < BATCH; j++) check_write(c, "remove_batch", errs[j], keys[j]);
+        }
+        if (i % (ops / 4 + 1) == ops / 8) {
+            index_on = !index_on;
+            int res = c->file ? tf_set_info_index(&c->ft, index_on) : tm_set_info_index(&c->tm, index_on);
+            if (res != 0) violation(c, "info_index", "ошибка построения", res, index_on);
+        }
+        if (c->file && i % 1000 == 999 && tf_sync(&c->ft) != TMF_OK) violation(c, "sync", "ошибка сброса", i, 0);
+    }
+}
+
+
+static int count_tm(const TmRow *row, void *ctx) {
+    (void)row;
+    ++*(int *)ctx;
+    return 0;
+}
+
+
+static int count_tf(const TfRow *row, void *ctx) {
+    (void)row;
+    ++*(int *)ctx;
+    return 0;
+}
+
+
+// Вставка всех ключей по возрастанию: родитель всегда вставлен раньше
+static void fill(Ctx *c) {
+    char info[INFO_MAX];
+    for (int k = 1; k <= c->keys; k++) {
+        make_info(k, info);
+        int res = c->file ? tf_insert(&c->ft, k, parent_of(k), info) : tm_insert(&c->tm, k, parent_of(k), info);
+        if (res != 0) violation(c, "insert", "ошибка начального заполнения", res, k);
+    }
+}
+
+
+// Один прогон: таблица, readers читателей, ops изменений.
+// Возвращает 0 или 2 (таблицу не удалось открыть)
+static int run_mode(int mode, const char *path, int readers, int keys, int ops, unsigned seed) {
+    Ctx c;
+    memset(&c, 0, sizeof(c));
+    c.mode = mode_name[mode];
+    c.file = mode > 0;
+    c.keys = keys;
+    c.stable = keys / 4;
+    if (c.file) {
+        char wal[4096];
+        snprintf(wal, sizeof(wal), "%s.wal", path);
+        remove(path);
+        remove(wal);
+        TfOptions opt;
+        memset(&opt, 0, sizeof(opt));
+        opt.concurrent   = 1;
+        opt.use_mmap     = mode == 2;
+        opt.use_wal      = mode == 3;
+        opt.wal_group_ms = 1;
+        opt.use_btree    = mode == 4;
+        opt.page_cache   = 16; // вытеснение страниц под нагрузкой
+        opt.compress     = mode == 5;
+        int res = tf_open_ex(&c.ft, path, &opt);
+        if (res != TMF_OK) {
+            fprintf(stderr, "stress: %s: %s\n", path, tf_errstr(res));
+            return 2;
+        }
+    } else {
+        tm_init(&c.tm, 1024);
+        tm_set_concurrent(&c.tm, 1);
+    }
+    fill(&c);
+
+    pthread_t *th = malloc((size_t)readers * sizeof(pthread_t));
+    Reader *rd = calloc((size_t)readers, sizeof(Reader));
+    int started = 0;
+    for (int i = 0; th && rd && i < readers; i++) {
+        rd[i].c = &c;
+        rd[i].seed = seed + 7919u * (unsigned)(i + 1);
+        rd[i].seen = calloc((size_t)keys + 1, 1);
+        rd[i].list = calloc((size_t)keys + 1, sizeof(int));
+        if (!rd[i].seen || !rd[i].list || pthread_create(&th[i], NULL, reader_main, &rd[i]) != 0) {
+            free(rd[i].seen);
+            free(rd[i].list);
+            break;
+        }
+        started++;
+    }
+    if (started < readers) violation(&c, "start", "не удалось запустить читателей", started, readers);
+
+    writer(&c, ops, seed);
+    __atomic_store_n(&c.stop, 1, __ATOMIC_RELEASE);
+    for (int i = 0; i < started; i++) {
+        pthread_join(th[i], NULL);
+        free(rd[i].seen);
+        free(rd[i].list);
+    }
+    free(th);
+    free(rd);
+
+    // без читателей: обход всех строк и постоянные ключи сходятся со счётчиком
+    int all = 0, stable = 0, count;
+    if (c.file) {
+        tf_descendants(&c.ft, 0, count_tf, &all);
+        tf_range(&c.ft, 1, c.stable, count_tf, &stable);
+        count = c.ft.count;
+    } else {
+        tm_descendants(&c.tm, 0, count_tm, &all);
+        tm_range(&c.tm, 1, c.stable, count_tm, &stable);
+        count = c.tm.count;
+    }
+    if (all != count) violation(&c, "descendants", "обход всех строк не сходится со счётчиком", all, count);
+    if (stable != c.stable) violation(&c, "range", "пропали постоянные ключи", stable, c.stable);
+
+    printf("%s: readers %d, reads %ld, writes %d, rows %d, violations %ld\n",
+           c.mode, started, c.reads, ops, count, __atomic_load_n(&violations, __ATOMIC_RELAXED));
+    if (c.file) tf_close(&c.ft);
+    else tm_free(&c.tm);
+    return 0;
+}
+
+
+// Все строки FTable по родителям; возвращает их число
+static int check_all(Ctx *c, const char *op) {
+    Reader r = { c, 0, NULL, NULL };
+    Walk w;
+    int rows = 0;
+    for (int p = 0; p <= c->keys / FAN; p++) {
+        walk_init(&w, &r, op, Q_SEARCH);
+        w.arg = p;
+        tf_search_each(&c->ft, p, tf_row, &w);
+        expect_stable(&w, stable_children(c, p));
+        rows += w.rows;
+    }
+    return rows;
+}
+
+
+// Восстановление после сбоя. Дочерний процесс заполняет таблицу
+// с журналом, выполняет ops изменений и завершается без tf_close.
+// Каждая операция — отдельная группа журнала, поэтому удаления
+// и вставки в освобождённые ими участки воспроизводятся вперемешку.
+// После открытия проверяются все строки, затем таблица заполняется
+// заново (новые info занимают свободные участки) и проверяется ещё раз.
+// Возвращает 0 или 2 (таблицу не удалось открыть)
+static int run_crash(const char *path, int keys, int ops, unsigned seed) {
+    Ctx c;
+    memset(&c, 0, sizeof(c));
+    c.mode = "crash";
+    c.file = 1;
+    c.keys = keys;
+    c.stable = keys / 4;
+    char wal[4096];
+    snprintf(wal, sizeof(wal), "%s.wal", path);
+    remove(path);
+    remove(wal);
+    TfOptions opt;
+    memset(&opt, 0, sizeof(opt));
+    opt.use_wal       = 1;
+    opt.wal_group_ops = 1;
+    opt.cache_bytes   = -1; // info читаются только из файла
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("stress: fork");
+        return 2;
+    }
+    if (pid == 0) {
+        if (tf_open_ex(&c.ft, path, &opt) != TMF_OK) _exit(2);
+        fill(&c);
+        writer(&c, ops, seed);
+        _exit(violations > 0 ? 1 : 0);
+    }
+    int status;
+    if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) == 2) {
+        fprintf(stderr, "stress: crash: процесс-писатель завершился с ошибкой\n");
+        return 2;
+    }
+    if (WEXITSTATUS(status) != 0) violation(&c, "writer", "нарушения до сбоя", WEXITSTATUS(status), 0);
+
+    int res = tf_open_ex(&c.ft, path, &opt);
+    if (res != TMF_OK) {
+        fprintf(stderr, "stress: %s: %s\n", path, tf_errstr(res));
+        return 2;
+    }
+    int replayed = check_all(&c, "replay");
+    if (replayed != c.ft.count) violation(&c, "replay", "строки не сходятся со счётчиком", replayed, c.ft.count);
+    char info[INFO_MAX];
+    for (int k = c.stable + 1; k <= keys; k++) {
+        make_info(k, info);
+        check_write(&c, "refill", tf_insert(&c.ft, k, parent_of(k), info), k);
+    }
+    int rows = check_all(&c, "refill");
+    if (rows != keys) violation(&c, "refill", "после заполнения есть не все ключи", rows, keys);
+
+    printf("crash: writes %d, replayed rows %d, rows %d, violations %ld\n",
+           ops, replayed, rows, __atomic_load_n(&violations, __ATOMIC_RELAXED));
+    tf_close(&c.ft);
+    return 0;
+}
+
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [--mode=mem|file|mmap|wal|paged|zip|crash|all] [--readers=N]\n"
+            "          [--keys=N] [--ops=N] [--file=path] [--seed=N]\n",
+            prog);
+}
+
+
+int main(int argc, char *argv[]) {
+    int modes[MODES];
+    for (int m = 0; m < MODES; m++) modes[m] = 1;
+    int readers = 4, keys = 20000, ops = 20000;
+    unsigned seed = 1;
+    const char *path = "stress_table.dat";
+
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        if (!strncmp(a, "--mode=", 7)) {
+            int all = !strcmp(a + 7, "all"), any = all;
+            for (int m = 0; m < MODES; m++) {
+                modes[m] = all || !strcmp(a + 7, mode_name[m]);
+                any |= modes[m];
+            }
+            if (!any) {
+                usage(argv[0]);
+                return 2;
+            }
+        } else if (!strncmp(a, "--readers=", 10)) {
+            readers = atoi(a + 10) > 0 ? atoi(a + 10) : 1;
+        } else if (!strncmp(a, "--keys=", 7)) {
+            keys = atoi(a + 7) > 4 * FAN ? atoi(a + 7) : 4 * FAN;
+        } else if (!strncmp(a, "--ops=", 6)) {
+            ops = atoi(a + 6) > 0 ? atoi(a + 6) : 0;
+        } else if (!strncmp(a, "--file=", 7)) {
+            path = a + 7;
+        } else if (!strncmp(a, "--seed=", 7)) {
+            seed = (unsigned)atoi(a + 7);
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    int res = 0;
+    for (int m = 0; m < MODES && res == 0; m++) {
+        if (modes[m] && strcmp(mode_name[m], "crash") == 0) res = run_crash(path, keys, ops, seed);
+        else if (modes[m]) res = run_mode(m, path, readers, keys, ops, seed);
+    }
+    char wal[4096];
+    snprintf(wal, sizeof(wal), "%s.wal", path);
+    remove(path);
+    remove(wal);
+    if (res != 0) return res;
+    return violations > 0 ? 1 : 0;
+}
@@ -1,181 +1,2008 @@
+#define _GNU_SOURCE // pthread_rwlockattr_setkind_np
 #include "table_file.h"
 #include <stdlib.h>
+#include <limits.h>
 #include <string.h>
 #include <stdio.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <pthread.h>
 
-static int read_metadata(FTable *ft) {
-    long meta_size = sizeof(int) + (long)ft->size * sizeof(FItem);
+// On-disk layout (version 2):
+//   header | FItem block | Link block | hash index block | info heap ...
+// Blocks and info strings share one heap that grows at heap_end. A block that
+// has to grow is written anew at heap_end and the header is repointed, so live
+// data is never moved. Links and the hash index are stored as well, so opening
+// a file needs no rebuild and in mmap mode costs O(1).
+// Space given up by removed infos and moved blocks is tracked in a free-extent
+// map (freemap.c); infos are allocated from it first. The map is saved with the
+// metadata and rebuilt from the gaps between live data when it is missing.
+// Paged layout (version 3): the same header and heap, but instead of the three
+// blocks the records live in two B+trees (btree.c) whose pages are allocated
+// from the heap at page-aligned offsets and read through a fixed page cache.
+// Compressed heap (either layout with TF_VERSION_ZIP set): infos are packed
+// into blocks that are stored compressed in the heap (zheap.c); FItem.offset
+// is then a virtual offset into the blocks, and the block directory is one
+// more block pointed to by the header. Readers without the flag reject the file.
+#define TF_MAGIC        "TFTB"
+#define TF_VERSION      2
+#define TF_VERSION_PAGED 3
+#define TF_VERSION_ZIP  0x100 // flag: infos live in compressed blocks
+#define TF_MIN_CAPACITY 16
+#define TF_MAP_MIN      (1L << 20) // smallest mapping; grows by doubling
+#define TF_WAL_GROUP_OPS 64   // defaults for TfOptions
+#define TF_WAL_GROUP_MS  10
+#define TF_WAL_CHECKPOINT 4096
+#define TF_BULK_WINDOW  1024 // records per bulk read in full scans
+#define TF_CACHE_BYTES  (1L << 20) // default info cache budget
+#define TF_PAGE_CACHE   256 // default page cache of the paged format, in pages
 
+typedef struct {
+    char magic[4];      // TF_MAGIC
+    int  version;       // TF_VERSION
+    int  capacity;      // number of slots in the FItem and Link blocks
+    int  count;         // number of busy slots
+    long meta_off;      // file offset of the FItem block
+    long links_off;     // file offset of the Link block
+    long idx_off;       // file offset of the hash index block
+    long heap_end;      // end of used space (a mapped file may be longer)
+    int  idx_cap;       // cells in the hash index block
+    int  idx_used;      // cells in use, tombstones included
+    int  idx_count;     // live keys in the hash index
+    int  free_head;     // first free slot
+    Link roots;         // list of root records
+    long wal_gen;       // log generation folded into this metadata
+    long free_off;      // file offset of the free-extent block, 0 — not saved
+    int  free_count;    // extents in the free-extent block
+    int  free_cap;      // capacity of the free-extent block
+    long key_root;      // paged: root page of the (key, 0) tree
+    long par_root;      // paged: root page of the (par, key) tree
+    long zdir_off;      // compressed heap: file offset of the block directory
+} FHeader;
+
+// head of the block directory of a compressed heap, followed by cap ZBlocks
+typedef struct {
+    int n;   // blocks in use
+    int cap; // entries the directory block has room for
+} ZDir;
+
+// version 1 header (FItem block only), converted on open
+typedef struct {
+    char magic[4];
+    int  version;
+    int  capacity;
+    int  count;
+    long meta_off;
+    char reserved[40];
+} FHeaderV1;
+
+// value stored in both trees of the paged format
+typedef struct {
+    long offset;
+    int  length;
+    int  par;
+    int  children; // (key, 0) tree only: number of direct children
+    int  pad;
+} PRec;
+
+static BtKey bt_key(int a, int b) {
+    BtKey k = { a, b };
+    return k;
+}
+
+// returns the Link that heads par's child list, or NULL if par does not exist
+static Link *children_head(FTable *ft, int par) {
+    if (par == 0) return &ft->roots;
+    int p = hi_find(&ft->idx, par);
+    return p >= 0 ? &ft->links[p] : NULL;
+}
+
+static const Link *children_of(const FTable *ft, int par) {
+    if (par == 0) return &ft->roots;
+    int p = hi_find(&ft->idx, par);
+    return p >= 0 ? &ft->links[p] : NULL;
+}
+
+// counter of the table statistics (stats.h); a no-op without TABLE_STATS
+#define STAT(ft, field, n) ST_ADD(&(ft)->stats, field, n)
+
+// --- raw file access: positioned stdio in buffered mode, plain memory in mmap mode ---
+
+static int file_write(FTable *ft, long off, const void *p, size_t n) {
+    STAT(ft, writes, 1);
+    STAT(ft, bytes_written, n);
+    if (ft->map) {
+        memcpy(ft->map + off, p, n);
+        return TMF_OK;
+    }
+    STAT(ft, seeks, 1);
+    if (fseek(ft->f, off, SEEK_SET) != 0 || fwrite(p, 1, n, ft->f) != n) return TMF_ERR_WRITE;
+    return TMF_OK;
+}
+
+// reads never move the stream position, so concurrent readers do not disturb each other
+static int file_read(const FTable *ft, long off, void *p, size_t n) {
+    STAT(ft, reads, 1);
+    STAT(ft, bytes_read, n);
+    if (ft->map) {
+        memcpy(p, ft->map + off, n);
+        return TMF_OK;
+    }
+    fflush(ft->f); // pread bypasses the stdio buffer
+    if (pread(fileno(ft->f), p, n, off) != (ssize_t)n) return TMF_ERR_READ;
+    return TMF_OK;
+}
+
+// --- concurrent mode: shared locks for readers, an exclusive one for writers ---
+
+// the lock is mutable state even in a const table
+static void rd_lock(const FTable *ft) {
+    if (ft->concurrent) pthread_rwlock_rdlock((pthread_rwlock_t *)&ft->lock);
+}
+
+static void unlock(const FTable *ft) {
+    if (ft->concurrent) pthread_rwlock_unlock((pthread_rwlock_t *)&ft->lock);
+}
+
+// writers also exclude the log flusher thread, which exists without concurrent mode too
+static void wr_lock(FTable *ft) {
+    if (ft->locked) pthread_rwlock_wrlock(&ft->lock);
+}
+
+static void wr_unlock(FTable *ft) {
+    if (ft->locked) pthread_rwlock_unlock(&ft->lock);
+}
+
+// a steady stream of readers must not starve the writer: with glibc waiting
+// writers go first, which also makes a nested read lock deadlock-prone
+static void init_lock(pthread_rwlock_t *lock) {
+    pthread_rwlockattr_t attr;
+    pthread_rwlockattr_init(&attr);
+#ifdef __GLIBC__
+    pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+    pthread_rwlock_init(lock, &attr);
+    pthread_rwlockattr_destroy(&attr);
+}
+
+void tf_read_lock(FTable *ft) {
+    rd_lock(ft);
+}
+
+void tf_read_unlock(FTable *ft) {
+    unlock(ft);
+}
+
+// points records, links and the hash index into the current mapping
+static void rebind(FTable *ft) {
+    ft->records = (FItem *)(ft->map + ft->meta_off);
+    ft->links = (Link *)(ft->map + ft->links_off);
+    ft->idx.entries = (HashEntry *)(ft->map + ft->idx_off);
+}
+
+// makes the file and the mapping cover at least `need` bytes
+static int map_reserve(FTable *ft, long need) {
+    if (ft->map && (long)ft->map_len >= need) return TMF_OK;
+    size_t len = ft->map_len ? ft->map_len : TF_MAP_MIN;
+    while ((long)len < need) len *= 2;
+    int fd = fileno(ft->f);
+    struct stat st;
+    if (fstat(fd, &st) != 0) return TMF_ERR_WRITE;
+    if (st.st_size < (off_t)len && ftruncate(fd, (off_t)len) != 0) return TMF_ERR_WRITE;
+    char *map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) return TMF_ERR_WRITE;
+    if (ft->map) munmap(ft->map, ft->map_len);
+    ft->map = map;
+    ft->map_len = len;
+    rebind(ft);
+    return TMF_OK;
+}
+
+// reserves n bytes at the end of the heap; blocks of structs pass align = 8
+static long heap_alloc(FTable *ft, size_t n, long align) {
+    long off = (ft->heap_end + align - 1) / align * align;
+    if (ft->map && map_reserve(ft, off + (long)n) != TMF_OK) return -1;
+    ft->heap_end = off + (long)n;
+    return off;
+}
+
+// returns [off, off + len) to the free map; a free tail shortens the heap
+static void release(FTable *ft, long off, long len) {
+    if (off <= 0 || len <= 0) return;
+    fm_put(&ft->fm, off, len);
+    ft->heap_end = fm_trim(&ft->fm, ft->heap_end);
+}
+
+// blocks of structs: best fit from the free map, 8-byte aligned, otherwise the heap end
+static long alloc_block(FTable *ft, size_t n) {
+    long off = fm_take(&ft->fm, (long)n + 7);
+    if (off < 0) return heap_alloc(ft, n, 8);
+    long at = (off + 7) / 8 * 8;
+    release(ft, off, at - off);
+    release(ft, at + (long)n, off + 7 - at);
+    return at;
+}
+
+// info bytes: best fit from the free map, otherwise appended to the heap
+static long alloc_info(FTable *ft, size_t n) {
+    long off = fm_take(&ft->fm, (long)n);
+    return off >= 0 ? off : heap_alloc(ft, n, 1);
+}
+
+// writes an info of n bytes ('\0' included): to a heap extent, or into the
+// open block of a compressed heap; returns its offset or -1
+static long store_info(FTable *ft, const char *info, size_t n) {
+    if (ft->zip) return zh_append(&ft->zh, info, (int)n);
+    long off = alloc_info(ft, n); // reuse freed space or append to the heap
+    if (off < 0 || file_write(ft, off, info, n) != TMF_OK) return -1;
+    return off;
+}
+
+// frees the info extent of a removed record; with a log the extent is held
+// back until the removal is committed, so a crash cannot expose reused bytes
+static void release_info(FTable *ft, long off, long len) {
+    if (ft->zip) {
+        zh_release(&ft->zh, off, (int)len);
+        return;
+    }
+    if (!ft->wal.f) {
+        release(ft, off, len);
+        return;
+    }
+    if (ft->limbo_n == ft->limbo_cap) {
+        int cap = ft->limbo_cap ? ft->limbo_cap * 2 : 64;
+        FmExtent *p = realloc(ft->limbo, cap * sizeof(FmExtent));
+        if (!p) return; // the extent is leaked until the map is rebuilt
+        ft->limbo = p;
+        ft->limbo_cap = cap;
+    }
+    ft->limbo[ft->limbo_n].off = off;
+    ft->limbo[ft->limbo_n].len = len;
+    ft->limbo_n++;
+}
+
+static void drain_limbo(FTable *ft) {
+    for (int i = 0; i < ft->limbo_n; i++) release(ft, ft->limbo[i].off, ft->limbo[i].len);
+    ft->limbo_n = 0;
+}
+
+// --- compressed heap: zheap callbacks into the file ---
+
+static long zip_alloc(void *ctx, size_t n) {
+    return alloc_info(ctx, n);
+}
+
+static void zip_release(void *ctx, long off, long n) {
+    release(ctx, off, n);
+}
+
+static int zip_read(void *ctx, long off, void *p, size_t n) {
+    return file_read(ctx, off, p, n) == TMF_OK ? 0 : -1;
+}
+
+static int zip_write(void *ctx, long off, void *p, size_t n) {
+    return file_write(ctx, off, p, n) == TMF_OK ? 0 : -1;
+}
+
+// marks [off, off + len) as used while replaying the log
+static void claim(FTable *ft, long off, long len) {
+    if (off + len > ft->heap_end) {
+        long end = ft->heap_end;
+        ft->heap_end = off + len;
+        if (off > end) fm_put(&ft->fm, end, off - end);
+    }
+    fm_reserve(&ft->fm, off, len);
+}
+
+// --- metadata ---
+
+static void fill_header(const FTable *ft, FHeader *h) {
+    memset(h, 0, sizeof(*h));
+    memcpy(h->magic, TF_MAGIC, 4);
+    h->version   = (ft->paged ? TF_VERSION_PAGED : TF_VERSION) | (ft->zip ? TF_VERSION_ZIP : 0);
+    h->capacity  = ft->size;
+    h->count     = ft->count;
+    h->meta_off  = ft->meta_off;
+    h->links_off = ft->links_off;
+    h->idx_off   = ft->idx_off;
+    h->heap_end  = ft->heap_end;
+    h->idx_cap   = ft->idx.cap;
+    h->idx_used  = ft->idx.used;
+    h->idx_count = ft->idx.count;
+    h->free_head = ft->free_head;
+    h->roots     = ft->roots;
+    h->wal_gen   = ft->wal_gen;
+    h->free_off  = ft->free_off;
+    h->free_count = ft->free_count;
+    h->free_cap  = ft->free_cap;
+    h->key_root  = ft->keys.root;
+    h->par_root  = ft->pars.root;
+    h->zdir_off  = ft->zdir_off;
+}
+
+// pushes slots [from, to) onto the free list, lowest slot first out
+static void push_free_range(FTable *ft, int from, int to) {
+    for (int i = to - 1; i >= from; i--) {
+        if (!ft->records[i].busy) link_push_free(ft->links, &ft->free_head, i);
+    }
+}
+
+static int alloc_slots(FTable *ft, int size) {
+    FItem *rec = realloc(ft->records, size * sizeof(FItem));
+    STAT(ft, allocs, 2);
+    if (!rec) return TMF_ERR_WRITE;
+    ft->records = rec;
+    Link *links = realloc(ft->links, size * sizeof(Link));
+    if (!links) return TMF_ERR_WRITE;
+    ft->links = links;
+    return TMF_OK;
+}
+
+// saves the free map; with a log a new block is taken before the old one is
+// released, so the map of the last checkpoint is never overwritten
+static int store_freemap(FTable *ft) {
+    if (ft->wal.f || ft->free_cap < ft->fm.count || ft->free_off == 0) {
+        long old_off = ft->free_off;
+        int old_cap = ft->free_cap;
+        // taking the block and releasing the old one add at most three extents
+        int cap = ft->fm.count + 4;
+        long off = alloc_block(ft, (size_t)cap * sizeof(FmExtent));
+        if (off < 0) return TMF_ERR_WRITE;
+        ft->free_off = off;
+        ft->free_cap = cap;
+        release(ft, old_off, (long)old_cap * (long)sizeof(FmExtent));
+    }
+    if (ft->fm.count > ft->free_cap) return TMF_ERR_WRITE;
+    FmExtent *ext = malloc((size_t)(ft->fm.count + 1) * sizeof(FmExtent));
+    if (!ext) return TMF_ERR_WRITE;
+    ft->free_count = fm_export(&ft->fm, ext);
+    int res = file_write(ft, ft->free_off, ext, (size_t)ft->free_count * sizeof(FmExtent));
+    free(ext);
+    return res;
+}
+
+// saves the directory of a compressed heap after writing out its open block;
+// the directory block moves only when it has no room for new blocks
+static int store_zdir(FTable *ft) {
+    if (zh_flush(&ft->zh) != 0) return TMF_ERR_WRITE;
+    if (ft->zdir_cap < ft->zh.n || ft->zdir_off == 0) {
+        long old_off = ft->zdir_off;
+        long old_len = (long)sizeof(ZDir) + (long)ft->zdir_cap * (long)sizeof(ZBlock);
+        int cap = ft->zh.n + ft->zh.n / 2 + 16;
+        long off = alloc_block(ft, sizeof(ZDir) + (size_t)cap * sizeof(ZBlock));
+        if (off < 0) return TMF_ERR_WRITE;
+        ft->zdir_off = off;
+        ft->zdir_cap = cap;
+        release(ft, old_off, old_len);
+    }
+    ZDir d = { ft->zh.n, ft->zdir_cap };
+    if (file_write(ft, ft->zdir_off, &d, sizeof(d)) != TMF_OK ||
+        (d.n > 0 && file_write(ft, ft->zdir_off + (long)sizeof(d), ft->zh.dir,
+                               (size_t)d.n * sizeof(ZBlock)) != TMF_OK)) {
+        return TMF_ERR_WRITE;
+    }
+    zh_dir_saved(&ft->zh);
+    return TMF_OK;
+}
+
+// persists the blocks (buffered mode) and then the header pointing to them
+static int write_metadata(FTable *ft) {
+    FHeader h;
+    if (ft->paged && pg_flush(&ft->pager) != 0) return TMF_ERR_WRITE;
+    if (!ft->map && !ft->paged) {
+        long old_idx = ft->idx_off;
+        long old_idx_len = (long)ft->idx_block * (long)sizeof(HashEntry);
+        if (ft->wal.f) {
+            // with a log the last checkpoint must survive a torn write:
+            // the blocks go to fresh space and only the header is overwritten
+            long old_meta = ft->meta_off, old_links = ft->links_off;
+            int old_block = ft->meta_block;
+            ft->meta_off = alloc_block(ft, (size_t)ft->size * sizeof(FItem));
+            ft->links_off = alloc_block(ft, (size_t)ft->size * sizeof(Link));
+            ft->meta_block = ft->size;
+            ft->idx_block = 0;
+            // the old blocks are reused only by the next checkpoint; grow() leaves
+            // them in place with a log, so they may be smaller than ft->size
+            release(ft, old_meta, (long)old_block * (long)sizeof(FItem));
+            release(ft, old_links, (long)old_block * (long)sizeof(Link));
+        }
+        if (ft->idx_block < ft->idx.cap) {
+            // the in-memory hash index outgrew its block on disk
+            long off = alloc_block(ft, (size_t)ft->idx.cap * sizeof(HashEntry));
+            if (off < 0) return TMF_ERR_WRITE;
+            ft->idx_off = off;
+            ft->idx_block = ft->idx.cap;
+            release(ft, old_idx, old_idx_len);
+        }
+        if (file_write(ft, ft->meta_off, ft->records, (size_t)ft->size * sizeof(FItem)) != TMF_OK ||
+            file_write(ft, ft->links_off, ft->links, (size_t)ft->size * sizeof(Link)) != TMF_OK ||
+            file_write(ft, ft->idx_off, ft->idx.entries, (size_t)ft->idx.cap * sizeof(HashEntry)) != TMF_OK) {
+            return TMF_ERR_WRITE;
+        }
+    }
+    if (ft->zip && store_zdir(ft) != TMF_OK) return TMF_ERR_WRITE;
+    if (store_freemap(ft) != TMF_OK) return TMF_ERR_WRITE;
+    if (!ft->map) {
+        // the blocks must be on disk before the header refers to them
+        if (fflush(ft->f) != 0 || (ft->wal.f && fsync(fileno(ft->f)) != 0)) return TMF_ERR_WRITE;
+    }
+    fill_header(ft, &h);
+    if (file_write(ft, 0, &h, sizeof(h)) != TMF_OK) return TMF_ERR_WRITE;
+    if (!ft->map && (fflush(ft->f) != 0 || (ft->wal.f && fsync(fileno(ft->f)) != 0)))
+        return TMF_ERR_WRITE;
+    return TMF_OK;
+}
+
+// commits the pending log group; info bytes reach the disk before the
+// records that point to them
+static int wal_flush(FTable *ft) {
+    if (!ft->wal.f || ft->wal.pending == 0) return TMF_OK;
+    STAT(ft, writes, 1);
+    STAT(ft, bytes_written, (long)ft->wal.pending * (long)sizeof(WalRec));
+    if (fflush(ft->f) != 0 || fsync(fileno(ft->f)) != 0) return TMF_ERR_WRITE;
+    if (wal_commit(&ft->wal) != 0) return TMF_ERR_WRITE;
+    drain_limbo(ft);
+    return TMF_OK;
+}
+
+// folds the log into the metadata: a new generation makes the old log stale
+static int checkpoint(FTable *ft) {
+    // commit first: freed extents may only be reused once their removal is durable
+    if (wal_flush(ft) != TMF_OK) return TMF_ERR_WRITE;
+    drain_limbo(ft); // everything is committed now, even with nothing pending
+    ft->wal_gen++;
+    if (write_metadata(ft) != TMF_OK) return TMF_ERR_WRITE;
+    return wal_reset(&ft->wal, ft->wal_gen) == 0 ? TMF_OK : TMF_ERR_WRITE;
+}
+
+// commits the pending group group_ms after its first record even if no
+// mutation follows, so an idle table does not keep it in memory; a failed
+// commit stays pending, is retried a period later and is reported by the
+// next mutation that commits
+static void *flusher_main(void *arg) {
+    FTable *ft = arg;
+    pthread_mutex_lock(&ft->flush_lock);
+    while (!ft->flush_stop) {
+        ft->flush_kick = 0;
+        pthread_mutex_unlock(&ft->flush_lock);
+        wr_lock(ft);
+        if (wal_wait_ms(&ft->wal) == 0) wal_flush(ft);
+        long wait = wal_wait_ms(&ft->wal);
+        if (wait == 0) wait = ft->wal.group_ms;
+        wr_unlock(ft);
+        pthread_mutex_lock(&ft->flush_lock);
+        if (ft->flush_stop || ft->flush_kick) continue;
+        if (wait < 0) {
+            // nothing pending: sleep until log_op starts a group
+            pthread_cond_wait(&ft->flush_cv, &ft->flush_lock);
+            continue;
+        }
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        long ns = ts.tv_nsec + wait % 1000 * 1000000L;
+        ts.tv_sec += wait / 1000 + ns / 1000000000L;
+        ts.tv_nsec = ns % 1000000000L;
+        pthread_cond_timedwait(&ft->flush_cv, &ft->flush_lock, &ts);
+    }
+    pthread_mutex_unlock(&ft->flush_lock);
+    return NULL;
+}
+
+// the flusher shares the table lock with the writers, so a logged table
+// has the lock even outside concurrent mode
+static int start_flusher(FTable *ft) {
+    if (!ft->locked) {
+        init_lock(&ft->lock);
+        ft->locked = 1;
+    }
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&ft->flush_cv, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_mutex_init(&ft->flush_lock, NULL);
+    ft->flush_stop = ft->flush_kick = 0;
+    if (pthread_create(&ft->flusher, NULL, flusher_main, ft) != 0) {
+        pthread_cond_destroy(&ft->flush_cv);
+        pthread_mutex_destroy(&ft->flush_lock);
+        return TMF_ERR_OPEN;
+    }
+    ft->flusher_on = 1;
+    return TMF_OK;
+}
+
+static void stop_flusher(FTable *ft) {
+    if (!ft->flusher_on) return;
+    pthread_mutex_lock(&ft->flush_lock);
+    ft->flush_stop = 1;
+    pthread_cond_signal(&ft->flush_cv);
+    pthread_mutex_unlock(&ft->flush_lock);
+    pthread_join(ft->flusher, NULL);
+    pthread_cond_destroy(&ft->flush_cv);
+    pthread_mutex_destroy(&ft->flush_lock);
+    ft->flusher_on = 0;
+}
+
+// a new group has started: the flusher waits for its deadline
+static void kick_flusher(FTable *ft) {
+    if (!ft->flusher_on) return;
+    pthread_mutex_lock(&ft->flush_lock);
+    ft->flush_kick = 1;
+    pthread_cond_signal(&ft->flush_cv);
+    pthread_mutex_unlock(&ft->flush_lock);
+}
+
+// logs a mutation that is already applied in memory
+static int log_op(FTable *ft, int op, int key, int par, long off, int length) {
+    if (!ft->wal.f) return TMF_OK;
+    if (wal_append(&ft->wal, op, key, par, off, length) != 0) return TMF_ERR_WRITE;
+    int res = TMF_OK;
+    if (ft->wal.logged >= ft->wal_checkpoint) res = checkpoint(ft);
+    else if (wal_due(&ft->wal)) res = wal_flush(ft);
+    if (ft->wal.pending == 1) kick_flusher(ft);
+    return res;
+}
+
+// applies the msync policy after a mutation in mmap mode
+static void op_done(FTable *ft) {
+    if (!ft->map) return;
+    if (ft->msync_policy != TF_MSYNC_ASYNC && ft->msync_policy != TF_MSYNC_SYNC) return;
+    FHeader h;
+    fill_header(ft, &h);
+    h.free_off = 0; // the saved free map is stale: rebuild it if this header survives a crash
+    memcpy(ft->map, &h, sizeof(h));
+    msync(ft->map, (size_t)ft->heap_end, ft->msync_policy == TF_MSYNC_SYNC ? MS_SYNC : MS_ASYNC);
+}
+
+// inserts key -> slot, moving a mapped hash index to a bigger block when needed
+static int idx_put(FTable *ft, int key, int slot) {
+    if (ft->map) {
+        int cap = hi_grow_cap(&ft->idx);
+        if (cap) {
+            long off = alloc_block(ft, (size_t)cap * sizeof(HashEntry));
+            if (off < 0) return -1;
+            memset(ft->map + off, 0, (size_t)cap * sizeof(HashEntry));
+            hi_rehash_into(&ft->idx, (HashEntry *)(ft->map + off), cap);
+            release(ft, ft->idx_off, (long)ft->idx_block * (long)sizeof(HashEntry));
+            ft->idx_off = off;
+            ft->idx_block = cap;
+        }
+    }
+    return hi_put(&ft->idx, key, slot);
+}
+
+// doubles the capacity; the FItem and Link blocks move to the end of the heap
+static int grow(FTable *ft) {
+    int old = ft->size;
+    int size = old > 0 ? old * 2 : TF_MIN_CAPACITY;
+    if (!ft->map && alloc_slots(ft, size) != TMF_OK) return TMF_ERR_WRITE;
+    if (ft->map || !ft->wal.f) {
+        // with a log the blocks are placed by the next checkpoint instead
+        long old_meta = ft->meta_off, old_links = ft->links_off;
+        long meta_off = alloc_block(ft, (size_t)size * sizeof(FItem));
+        long links_off = meta_off < 0 ? -1 : alloc_block(ft, (size_t)size * sizeof(Link));
+        if (links_off < 0) return TMF_ERR_WRITE;
+        if (ft->map) {
+            // copy within the mapping; rebind() then switches to the new blocks
+            memcpy(ft->map + meta_off, ft->records, (size_t)old * sizeof(FItem));
+            memcpy(ft->map + links_off, ft->links, (size_t)old * sizeof(Link));
+        }
+        ft->meta_off = meta_off;
+        ft->links_off = links_off;
+        ft->meta_block = size;
+        if (ft->map) rebind(ft);
+        release(ft, old_meta, (long)old * (long)sizeof(FItem));
+        release(ft, old_links, (long)old * (long)sizeof(Link));
+    }
+    ft->size = size;
+    if (ft->jumps_ok) {
+        // without memory for the labels they are rebuilt by the next query
+        STAT(ft, allocs, 3);
+        if (jump_resize(&ft->jumps, size) != 0) {
+            jump_free(&ft->jumps);
+            ft->jumps_ok = 0;
+        }
+    }
+    memset(ft->records + old, 0, (size_t)(size - old) * sizeof(FItem));
+    push_free_range(ft, old, size);
+    // with a log the new capacity reaches the file at the next checkpoint
+    if (!ft->map && !ft->wal.f && write_metadata(ft) != TMF_OK) return TMF_ERR_WRITE;
+    return TMF_OK;
+}
+
+// rebuilds links and the hash index from records (used when converting old files)
+static int build_index(FTable *ft) {
+    if (hi_init(&ft->idx, ft->count) != 0) return TMF_ERR_READ;
+    link_reset(&ft->roots, 0);
+    for (int i = 0; i < ft->size; i++) {
+        link_reset(ft->links, i);
+        if (ft->records[i].busy && hi_put(&ft->idx, ft->records[i].key, i) != 0)
+            return TMF_ERR_READ;
+    }
+    // second pass: every parent is indexed now, so children can be linked
+    for (int i = 0; i < ft->size; i++) {
+        if (!ft->records[i].busy) continue;
+        Link *head = children_head(ft, ft->records[i].par);
+        if (!head) return TMF_ERR_READ; // orphan record, corrupted index
+        link_attach(ft->links, head, i);
+    }
+    return TMF_OK;
+}
+
+static int cmp_extent(const void *a, const void *b) {
+    long x = ((const FmExtent *)a)->off, y = ((const FmExtent *)b)->off;
+    return (x > y) - (x < y);
+}
+
+// rebuilds the free map from the gaps between the header, the blocks and live
+// infos (the stored blocks and the directory of a compressed heap)
+static int rebuild_freemap(FTable *ft) {
+    int n = 0;
+    FmExtent *used = malloc((size_t)(ft->count + ft->zh.n + 5) * sizeof(FmExtent));
+    if (!used) return TMF_ERR_READ;
+    used[n].off = 0;
+    used[n++].len = sizeof(FHeader);
+    used[n].off = ft->meta_off;
+    used[n++].len = (long)ft->size * (long)sizeof(FItem);
+    used[n].off = ft->links_off;
+    used[n++].len = (long)ft->size * (long)sizeof(Link);
+    used[n].off = ft->idx_off;
+    used[n++].len = (long)ft->idx_block * (long)sizeof(HashEntry);
+    for (int i = 0; i < ft->size && !ft->zip; i++) {
+        if (!ft->records[i].busy) continue;
+        used[n].off = ft->records[i].offset;
+        used[n++].len = (long)ft->records[i].length + 1;
+    }
+    if (ft->zip) {
+        used[n].off = ft->zdir_off;
+        used[n++].len = (long)sizeof(ZDir) + (long)ft->zdir_cap * (long)sizeof(ZBlock);
+        for (int b = 0; b < ft->zh.n; b++) {
+            if (ft->zh.dir[b].off <= 0) continue;
+            used[n].off = ft->zh.dir[b].off;
+            used[n++].len = ft->zh.dir[b].zlen;
+        }
+    }
+    qsort(used, n, sizeof(FmExtent), cmp_extent);
+    fm_free(&ft->fm);
+    long pos = 0;
+    for (int i = 0; i < n; i++) {
+        if (used[i].off > pos) fm_put(&ft->fm, pos, used[i].off - pos);
+        if (used[i].off + used[i].len > pos) pos = used[i].off + used[i].len;
+    }
+    if (pos < ft->heap_end) fm_put(&ft->fm, pos, ft->heap_end - pos);
+    ft->heap_end = fm_trim(&ft->fm, ft->heap_end);
+    free(used);
+    ft->free_off = 0;
+    ft->free_cap = 0;
+    return TMF_OK;
+}
+
+// reads the saved free map or, if there is none, rebuilds it
+static int load_freemap(FTable *ft, const FHeader *h) {
+    if (h->free_off == 0) return rebuild_freemap(ft);
+    FmExtent *ext = malloc((size_t)(h->free_count + 1) * sizeof(FmExtent));
+    if (!ext) return TMF_ERR_READ;
+    int res = file_read(ft, h->free_off, ext, (size_t)h->free_count * sizeof(FmExtent));
+    for (int i = 0; res == TMF_OK && i < h->free_count; i++) {
+        if (fm_put(&ft->fm, ext[i].off, ext[i].len) != 0) res = TMF_ERR_READ;
+    }
+    free(ext);
+    ft->free_off   = h->free_off;
+    ft->free_count = h->free_count;
+    ft->free_cap   = h->free_cap;
+    return res;
+}
+
+// reads the block directory of a compressed heap and reopens its last block
+static int load_zdir(FTable *ft, const FHeader *h) {
+    ZDir d;
+    if (h->zdir_off <= 0 || file_read(ft, h->zdir_off, &d, sizeof(d)) != TMF_OK ||
+        d.n < 0 || d.n > d.cap) {
+        return TMF_ERR_READ;
+    }
+    ZBlock *dir = malloc((size_t)d.n * sizeof(ZBlock) + 1);
+    if (!dir) return TMF_ERR_READ;
+    int res = d.n > 0 ? file_read(ft, h->zdir_off + (long)sizeof(d), dir, (size_t)d.n * sizeof(ZBlock)) : TMF_OK;
+    if (res == TMF_OK && zh_load(&ft->zh, dir, d.n) != 0) res = TMF_ERR_READ;
+    free(dir);
+    ft->zdir_off = h->zdir_off;
+    ft->zdir_cap = d.cap;
+    return res;
+}
+
+// loads an FItem block of an older format and rewrites the file as version 2;
+// the new blocks go to the end of the file, the header is written last
+static int convert(FTable *ft, long rec_off, int size, int count, long file_size) {
+    if (size <= 0 || rec_off + (long)size * (long)sizeof(FItem) > file_size) return TMF_ERR_READ;
+    if (alloc_slots(ft, size) != TMF_OK) return TMF_ERR_READ;
+    ft->size = size;
+    ft->count = count;
+    if (file_read(ft, rec_off, ft->records, (size_t)size * sizeof(FItem)) != TMF_OK) return TMF_ERR_READ;
+    int res = build_index(ft);
+    if (res != TMF_OK) return res;
+    ft->heap_end = file_size;
+    ft->meta_off = heap_alloc(ft, (size_t)size * sizeof(FItem), 8);
+    ft->links_off = heap_alloc(ft, (size_t)size * sizeof(Link), 8);
+    ft->meta_block = size;
+    ft->idx_block = 0; // write_metadata allocates the hash index block
+    push_free_range(ft, 0, size);
+    // the old metadata and dead infos become free space
+    if (rebuild_freemap(ft) != TMF_OK) return TMF_ERR_READ;
+    return write_metadata(ft);
+}
+
+static int create(FTable *ft, int size) {
+    if (size < TF_MIN_CAPACITY) size = TF_MIN_CAPACITY;
+    if (alloc_slots(ft, size) != TMF_OK || hi_init(&ft->idx, size) != 0) return TMF_ERR_OPEN;
+    memset(ft->records, 0, (size_t)size * sizeof(FItem));
+    for (int i = 0; i < size; i++) link_reset(ft->links, i);
+    ft->size = size;
+    ft->count = 0;
+    ft->heap_end = sizeof(FHeader);
+    ft->meta_off = heap_alloc(ft, (size_t)size * sizeof(FItem), 8);
+    ft->links_off = heap_alloc(ft, (size_t)size * sizeof(Link), 8);
+    ft->meta_block = size;
+    ft->idx_block = 0;
+    push_free_range(ft, 0, size);
+    return write_metadata(ft);
+}
+
+// buffered mode: reads all blocks of a version 2 file into memory
+static int load(FTable *ft, const FHeader *h) {
+    if (alloc_slots(ft, h->capacity) != TMF_OK) return TMF_ERR_READ;
+    HashEntry *e = malloc((size_t)h->idx_cap * sizeof(HashEntry));
+    if (!e) return TMF_ERR_READ;
+    hi_attach(&ft->idx, e, h->idx_cap, h->idx_used, h->idx_count, 1);
+    ft->idx_block = h->idx_cap;
+    if (file_read(ft, h->meta_off, ft->records, (size_t)h->capacity * sizeof(FItem)) != TMF_OK ||
+        file_read(ft, h->links_off, ft->links, (size_t)h->capacity * sizeof(Link)) != TMF_OK ||
+        file_read(ft, h->idx_off, e, (size_t)h->idx_cap * sizeof(HashEntry)) != TMF_OK) {
+        return TMF_ERR_READ;
+    }
+    return TMF_OK;
+}
+
+// switches a buffered table to mmap mode; in-memory copies are dropped
+static int attach_map(FTable *ft) {
+    HashIndex mem = ft->idx;
+    fflush(ft->f);
+    free(ft->records);
+    free(ft->links);
+    ft->records = NULL;
+    ft->links = NULL;
+    hi_attach(&ft->idx, NULL, mem.cap, mem.used, mem.count, 0);
+    if (!mem.external) free(mem.entries);
+    if (map_reserve(ft, ft->heap_end) != TMF_OK) return TMF_ERR_OPEN;
+    return TMF_OK;
+}
+
+// pager callback: a new tree page at the end of the heap; the alignment gap
+// becomes free space for infos
+static long alloc_page(void *ctx) {
+    FTable *ft = ctx;
+    long end = ft->heap_end;
+    long off = heap_alloc(ft, BT_PAGE, BT_PAGE);
+    if (off > end) release(ft, end, off - end);
+    return off;
+}
+
+static int open_pager(FTable *ft, const TfOptions *opt) {
+    ft->paged = 1;
+    int pages = opt->page_cache > 0 ? opt->page_cache : TF_PAGE_CACHE;
+    return pg_init(&ft->pager, fileno(ft->f), pages, alloc_page, ft) == 0 ? TMF_OK : TMF_ERR_OPEN;
+}
+
+static int create_paged(FTable *ft, const TfOptions *opt) {
+    int res = open_pager(ft, opt);
+    if (res != TMF_OK) return res;
+    ft->heap_end = sizeof(FHeader);
+    if (bt_create(&ft->keys, &ft->pager, sizeof(PRec)) != 0 ||
+        bt_create(&ft->pars, &ft->pager, sizeof(PRec)) != 0) {
+        return TMF_ERR_WRITE;
+    }
+    return write_metadata(ft);
+}
+
+// paged format: only the header and the free map are read, pages come on demand
+static int load_paged(FTable *ft, const FHeader *h, const TfOptions *opt) {
+    if (opt->use_mmap || opt->use_wal) return TMF_ERR_INVALID;
+    if (h->key_root <= 0 || h->par_root <= 0) return TMF_ERR_READ;
+    int res = open_pager(ft, opt);
+    if (res != TMF_OK) return res;
+    ft->count    = h->count;
+    ft->heap_end = h->heap_end;
+    ft->roots    = h->roots;
+    bt_attach(&ft->keys, &ft->pager, h->key_root, sizeof(PRec));
+    bt_attach(&ft->pars, &ft->pager, h->par_root, sizeof(PRec));
+    if (ft->zip && load_zdir(ft, h) != TMF_OK) return TMF_ERR_READ;
+    // there are no blocks to rebuild a lost map from: without one the free
+    // space of the file is simply not reused
+    return h->free_off ? load_freemap(ft, h) : TMF_OK;
+}
+
+static int read_metadata(FTable *ft, const TfOptions *opt) {
     if (fseek(ft->f, 0, SEEK_END) != 0) return TMF_ERR_READ;
     long file_size = ftell(ft->f);
 
-    if (file_size < meta_size) {
-        // initialize metadata for a new file
-        ft->count = 0;
-        for (int i = 0; i < ft->size; i++) ft->records[i].busy = 0;
-        rewind(ft->f);
-        // write initial state to disk
-        if (fwrite(&ft->count, sizeof(int), 1, ft->f) != 1 ||
-            fwrite(ft->records, sizeof(FItem), ft->size, ft->f) != (size_t)ft->size) {
-            return TMF_ERR_WRITE;
+    if (file_size == 0) {
+        // initialize metadata for a new file
+        ft->zip = opt->compress != 0;
+        if (opt->use_btree) return create_paged(ft, opt);
+        int res = create(ft, opt->capacity);
+        return res == TMF_OK && opt->use_mmap ? attach_map(ft) : res;
+    }
+
+    FHeader h;
+    memset(&h, 0, sizeof(h));
+    rewind(ft->f);
+    size_t got = fread(&h, 1, sizeof(h), ft->f);
+    if (got < sizeof(FHeaderV1) || memcmp(h.magic, TF_MAGIC, 4) != 0) {
+        // old files: int count + fixed array of `capacity` FItems, no header
+        int count = 0;
+        memcpy(&count, &h, sizeof(int));
+        int res = convert(ft, sizeof(int), opt->capacity, count, file_size);
+        return res == TMF_OK && opt->use_mmap ? attach_map(ft) : res;
+    }
+    if (h.version == 1) {
+        FHeaderV1 v1;
+        memcpy(&v1, &h, sizeof(v1));
+        int res = convert(ft, v1.meta_off, v1.capacity, v1.count, file_size);
+        return res == TMF_OK && opt->use_mmap ? attach_map(ft) : res;
+    }
+    if (got == sizeof(h) && (h.version & TF_VERSION_ZIP)) {
+        // a compressed heap has no fixed info offsets to map or to log
+        if (opt->use_mmap || opt->use_wal) return TMF_ERR_INVALID;
+        h.version &= ~TF_VERSION_ZIP;
+        ft->zip = 1;
+    }
+    if (got == sizeof(h) && h.version == TF_VERSION_PAGED) return load_paged(ft, &h, opt);
+    if (got != sizeof(h) || h.version != TF_VERSION || h.capacity <= 0) return TMF_ERR_READ;
+
+    ft->size      = h.capacity;
+    ft->count     = h.count;
+    ft->meta_off  = h.meta_off;
+    ft->links_off = h.links_off;
+    ft->meta_block = h.capacity;
+    ft->idx_off   = h.idx_off;
+    ft->heap_end  = h.heap_end;
+    ft->free_head = h.free_head;
+    ft->roots     = h.roots;
+    ft->wal_gen   = h.wal_gen;
+    int res;
+    if (opt->use_mmap) {
+        // nothing is read: records, links and the index are used in place
+        hi_attach(&ft->idx, NULL, h.idx_cap, h.idx_used, h.idx_count, 0);
+        ft->idx_block = h.idx_cap;
+        res = map_reserve(ft, ft->heap_end);
+    } else {
+        res = load(ft, &h);
+    }
+    if (res == TMF_OK && ft->zip) res = load_zdir(ft, &h);
+    return res == TMF_OK ? load_freemap(ft, &h) : res;
+}
+
+static int remove_key(FTable *ft, int key);
+static int fill_slot(FTable *ft, int key, int par, long off, int length);
+
+// re-applies one logged mutation on top of the last checkpoint
+static int replay_op(const WalRec *r, void *ctx) {
+    FTable *ft = ctx;
+    if (r->op == WAL_OP_REMOVE) {
+        // the removal is already committed: its extents go straight to the
+        // free map, where a later replayed insert can claim them back
+        remove_key(ft, r->key);
+        drain_limbo(ft);
+        return 0;
+    }
+    if (r->op != WAL_OP_INSERT || hi_find(&ft->idx, r->key) >= 0 || !children_head(ft, r->par))
+        return -1;
+    if (ft->free_head < 0 && grow(ft) != TMF_OK) return -1;
+    claim(ft, r->offset, (long)r->length + 1);
+    return fill_slot(ft, r->key, r->par, r->offset, r->length) == TMF_OK ? 0 : -1;
+}
+
+// opens <filename>.wal, replays it and folds the result into a checkpoint
+static int open_wal(FTable *ft, const TfOptions *opt) {
+    size_t n = strlen(ft->fname);
+    char *path = malloc(n + 5);
+    if (!path) return TMF_ERR_OPEN;
+    memcpy(path, ft->fname, n);
+    memcpy(path + n, ".wal", 5);
+    int res = wal_open(&ft->wal, path,
+                       opt->wal_group_ops > 0 ? opt->wal_group_ops : TF_WAL_GROUP_OPS,
+                       opt->wal_group_ms > 0 ? opt->wal_group_ms : TF_WAL_GROUP_MS);
+    free(path);
+    if (res != 0) return TMF_ERR_OPEN;
+    ft->wal_checkpoint = opt->wal_checkpoint > 0 ? opt->wal_checkpoint : TF_WAL_CHECKPOINT;
+    int replayed = wal_replay(&ft->wal, ft->wal_gen, replay_op, ft);
+    if (replayed < 0) return TMF_ERR_READ;
+    return replayed > 0 ? checkpoint(ft) : TMF_OK;
+}
+
+// frees everything the table holds without writing anything
+static void free_state(FTable *ft) {
+    stop_flusher(ft);
+    wal_close(&ft->wal);
+    if (ft->map) {
+        munmap(ft->map, ft->map_len);
+        ft->map = NULL;
+    } else {
+        free(ft->records);
+        free(ft->links);
+    }
+    fclose(ft->f);
+    ft->f = NULL;
+    ft->records = NULL;
+    ft->links = NULL;
+    free(ft->fname);
+    ft->fname = NULL;
+    hi_free(&ft->idx);
+    jump_free(&ft->jumps);
+    ft->jumps_ok = 0;
+    oi_free(&ft->order);
+    ft->order_ok = 0;
+    if (ft->info_idx) {
+        ii_free(ft->info_idx);
+        free(ft->info_idx);
+        ft->info_idx = NULL;
+    }
+    fm_free(&ft->fm);
+    ic_free(&ft->cache);
+    pg_free(&ft->pager);
+    ft->paged = 0;
+    zh_free(&ft->zh);
+    ft->zip = 0;
+    if (ft->locked) {
+        pthread_rwlock_destroy(&ft->lock);
+        ft->locked = 0;
+    }
+    if (ft->concurrent) {
+        pthread_mutex_destroy(&ft->cache_lock);
+        ft->concurrent = 0;
+    }
+    free(ft->limbo);
+    ft->limbo = NULL;
+    ft->limbo_n = ft->limbo_cap = 0;
+}
+
+int tf_open_ex(FTable *ft, const char *filename, const TfOptions *opt) {
+    memset(ft, 0, sizeof(*ft));
+    fm_init(&ft->fm);
+    if (opt->use_mmap && opt->use_wal) return TMF_ERR_INVALID; // a mapped table is made durable by msync
+    if (opt->use_btree && (opt->use_mmap || opt->use_wal)) return TMF_ERR_INVALID;
+    if (opt->compress && (opt->use_mmap || opt->use_wal)) return TMF_ERR_INVALID;
+    zh_init(&ft->zh, zip_alloc, zip_release, zip_read, zip_write, ft);
+    link_reset(&ft->roots, 0);
+    jump_init(&ft->jumps);
+    oi_init(&ft->order);
+    ft->free_head = -1;
+    ft->opt = *opt;
+    ft->msync_policy = opt->msync_policy;
+    // mapped infos are already in memory, a cache would only copy them
+    long budget = opt->cache_bytes ? opt->cache_bytes : TF_CACHE_BYTES;
+    if (ic_init(&ft->cache, opt->use_mmap || budget < 0 ? 0 : (size_t)budget) != 0) return TMF_ERR_OPEN;
+    ft->fname = strdup(filename); // allocate memory for filename
+    if (!ft->fname) {
+        ic_free(&ft->cache);
+        return TMF_ERR_OPEN;
+    }
+
+    ft->f = fopen(filename, "r+b"); // try opening existing file
+    if (!ft->f) {
+        ft->f = fopen(filename, "w+b"); // create file if it doesn't exist
+        if (!ft->f) {
+            free(ft->fname);
+            ic_free(&ft->cache);
+            return TMF_ERR_OPEN;
+        }
+    }
+    if (opt->concurrent) {
+        init_lock(&ft->lock);
+        pthread_mutex_init(&ft->cache_lock, NULL);
+        ft->concurrent = 1;
+        ft->locked = 1;
+    }
+    int res = read_metadata(ft, opt);
+    if (res == TMF_OK && ft->paged) ft->pager.concurrent = ft->concurrent;
+    if (res == TMF_OK && opt->use_wal) res = open_wal(ft, opt);
+    if (res == TMF_OK && opt->use_wal) res = start_flusher(ft);
+    if (res != TMF_OK) free_state(ft);
+    return res;
+}
+
+int tf_open(FTable *ft, const char *filename, int size) {
+    TfOptions opt;
+    memset(&opt, 0, sizeof(opt));
+    opt.capacity = size;
+    return tf_open_ex(ft, filename, &opt);
+}
+
+int tf_sync(FTable *ft) {
+    int res;
+    wr_lock(ft);
+    if (ft->wal.f) res = wal_flush(ft);
+    else if (ft->map) res = msync(ft->map, (size_t)ft->heap_end, MS_SYNC) == 0 ? TMF_OK : TMF_ERR_WRITE;
+    else res = write_metadata(ft);
+    wr_unlock(ft);
+    return res;
+}
+
+void tf_close(FTable *ft) {
+    if (!ft || !ft->f) return;
+    stop_flusher(ft);
+    // save final metadata state before closing
+    if (ft->wal.f) {
+        checkpoint(ft);
+    } else {
+        write_metadata(ft);
+    }
+    if (ft->map) {
+        if (ft->msync_policy != TF_MSYNC_NONE) msync(ft->map, (size_t)ft->heap_end, MS_SYNC);
+        munmap(ft->map, ft->map_len);
+        ft->map = NULL;
+        ft->records = NULL; // pointed into the mapping
+        ft->links = NULL;
+    } else {
+        fflush(ft->f);
+    }
+    // drop the mapping slack and a free tail (or extend up to an empty last block)
+    if (ftruncate(fileno(ft->f), (off_t)ft->heap_end) != 0) { /* file stays as it is */ }
+    free_state(ft);
+}
+
+// --- paged format ---
+
+// 1 if key exists, 0 if not, -1 on a page read error
+static int has_key(FTable *ft, int key) {
+    if (!ft->paged) return hi_find(&ft->idx, key) >= 0;
+    return bt_find(&ft->keys, bt_key(key, 0), NULL);
+}
+
+static int has_parent(FTable *ft, int par) {
+    if (!ft->paged) return children_head(ft, par) != NULL;
+    return par == 0 || has_key(ft, par) > 0;
+}
+
+// adds delta to the child count of par
+static int count_child(FTable *ft, int par, int delta) {
+    if (par == 0) {
+        ft->roots.count += delta;
+        return TMF_OK;
+    }
+    PRec p;
+    int found = bt_find(&ft->keys, bt_key(par, 0), &p);
+    if (found != 1) return found < 0 ? TMF_ERR_READ : TMF_ERR_INVALID;
+    p.children += delta;
+    return bt_insert(&ft->keys, bt_key(par, 0), &p) == 0 ? TMF_OK : TMF_ERR_WRITE;
+}
+
+// paged counterpart of fill_slot: one entry in each tree
+static int put_paged(FTable *ft, int key, int par, long off, int length) {
+    PRec r = { off, length, par, 0, 0 };
+    int res = count_child(ft, par, 1); // also checks that the parent exists
+    if (res != TMF_OK) return res;
+    if (bt_insert(&ft->keys, bt_key(key, 0), &r) != 0 ||
+        bt_insert(&ft->pars, bt_key(par, key), &r) != 0) {
+        return TMF_ERR_WRITE;
+    }
+    ic_drop(&ft->cache, key);
+    ft->count++;
+    return TMF_OK;
+}
+
+// paged counterpart of remove_key: breadth-first over the subtree, the
+// children of a key are collected from the (par, key) tree before it goes
+static int remove_paged(FTable *ft, int key) {
+    PRec r;
+    int found = bt_find(&ft->keys, bt_key(key, 0), &r);
+    if (found != 1) return found < 0 ? TMF_ERR_READ : TMF_ERR_NOT_FOUND;
+    if (count_child(ft, r.par, -1) != TMF_OK) return TMF_ERR_WRITE;
+    int cap = 64, n = 1;
+    int *queue = malloc(cap * sizeof(int));
+    STAT(ft, allocs, 1);
+    if (!queue) return TMF_ERR_WRITE;
+    queue[0] = key;
+    int res = TMF_OK;
+    for (int q = 0; q < n && res == TMF_OK; q++) {
+        int k = queue[q];
+        BtIter it;
+        BtKey ck;
+        if (bt_seek(&it, &ft->pars, bt_key(k, 0)) != 0) res = TMF_ERR_READ;
+        while (res == TMF_OK && (found = bt_next(&it, &ck, NULL)) == 1 && ck.a == k) {
+            if (n == cap) {
+                int *p = realloc(queue, (size_t)cap * 2 * sizeof(int));
+                if (!p) {
+                    res = TMF_ERR_WRITE;
+                    break;
+                }
+                queue = p;
+                cap *= 2;
+                STAT(ft, allocs, 1);
+            }
+            queue[n++] = ck.b;
+        }
+        if (found < 0) res = TMF_ERR_READ;
+        if (res == TMF_OK && bt_find(&ft->keys, bt_key(k, 0), &r) != 1) res = TMF_ERR_READ;
+        if (res == TMF_OK &&
+            (bt_delete(&ft->keys, bt_key(k, 0)) < 0 || bt_delete(&ft->pars, bt_key(r.par, k)) < 0)) {
+            res = TMF_ERR_WRITE;
+        }
+        if (res != TMF_OK) break;
+        STAT(ft, slots, 1);
+        ft->count--;
+        ic_drop(&ft->cache, k);
+        if (ft->info_idx) ii_del(ft->info_idx, k);
+        release_info(ft, r.offset, (long)r.length + 1);
+    }
+    free(queue);
+    return res;
+}
+
+static int remove_key(FTable *ft, int key) {
+    if (ft->paged) return remove_paged(ft, key);
+    int i = hi_find(&ft->idx, key);
+    if (i < 0) return TMF_ERR_NOT_FOUND;
+    // unlink the subtree from its parent, then walk it with an explicit work list
+    link_detach(ft->links, children_head(ft, ft->records[i].par), i);
+    int work = i;
+    int s;
+    while ((s = link_pop_subtree(ft->links, &work)) >= 0) {
+        STAT(ft, slots, 1);
+        ft->records[s].busy = 0; // mark record as inactive
+        ft->count--;
+        ic_drop(&ft->cache, ft->records[s].key);
+        if (ft->info_idx) ii_del(ft->info_idx, ft->records[s].key);
+        release_info(ft, ft->records[s].offset, (long)ft->records[s].length + 1);
+        hi_del(&ft->idx, ft->records[s].key);
+        if (ft->order_ok) oi_del(&ft->order, ft->records[s].key);
+        link_push_free(ft->links, &ft->free_head, s);
+    }
+    return TMF_OK;
+}
+
+static int remove_op(FTable *ft, int key) {
+    int res = remove_key(ft, key);
+    if (res == TMF_OK) res = log_op(ft, WAL_OP_REMOVE, key, 0, 0, 0);
+    op_done(ft);
+    return res;
+}
+
+int tf_remove(FTable *ft, int key) {
+    ST_BEGIN(t0);
+    wr_lock(ft);
+    int res = remove_op(ft, key);
+    wr_unlock(ft);
+    ST_END(&ft->stats, ST_REMOVE, t0);
+    return res;
+}
+
+// takes the first free slot for a validated record whose info is already on disk
+static int fill_slot(FTable *ft, int key, int par, long off, int length) {
+    if (ft->paged) return put_paged(ft, key, par, off, length);
+    if (!children_head(ft, par)) return TMF_ERR_INVALID;
+    int free_idx = ft->free_head;
+    if (free_idx < 0 || idx_put(ft, key, free_idx) != 0) return TMF_ERR_WRITE;
+    link_pop_free(ft->links, &ft->free_head);
+    ic_drop(&ft->cache, key);
+    Link *head = children_head(ft, par); // idx_put may have remapped the file
+
+    // update index entry
+    ft->records[free_idx].busy = 1;
+    ft->records[free_idx].key = key;
+    ft->records[free_idx].par = par;
+    ft->records[free_idx].offset = off;
+    ft->records[free_idx].length = length;
+    link_reset(ft->links, free_idx);
+    link_attach(ft->links, head, free_idx);
+    if (ft->jumps_ok) jump_attach(&ft->jumps, free_idx, head == &ft->roots ? -1 : (int)(head - ft->links));
+    if (ft->order_ok && oi_put(&ft->order, key, free_idx) != 0) {
+        // like the jump labels, the order is rebuilt by the next ordered query
+        oi_free(&ft->order);
+        ft->order_ok = 0;
+    }
+    ft->count++;
+    return TMF_OK;
+}
+
+// fill_slot for a new record whose info is at hand, keeping the info index in step
+static int fill_indexed(FTable *ft, int key, int par, long off, int length, const char *info) {
+    if (ft->info_idx && ii_add(ft->info_idx, key, info) != 0) return TMF_ERR_WRITE;
+    int res = fill_slot(ft, key, par, off, length);
+    if (res != TMF_OK && ft->info_idx) ii_del(ft->info_idx, key);
+    return res;
+}
+
+static int insert_op(FTable *ft, int key, int par, const char *info) {
+    // verify key uniqueness and ensure parent node exists
+    int found = has_key(ft, key);
+    if (found < 0) return TMF_ERR_READ;
+    if (found || !has_parent(ft, par)) return TMF_ERR_INVALID;
+
+    // table capacity reached: grow before writing anything
+    if (!ft->paged && ft->free_head < 0 && grow(ft) != TMF_OK) return TMF_ERR_WRITE;
+
+    int len = (int)strlen(info) + 1;
+    long off = store_info(ft, info, len);
+    if (off < 0) return TMF_ERR_WRITE;
+    // with a log the group commit flushes; without it keep the old per-insert flush
+    if (!ft->map && !ft->wal.f) fflush(ft->f);
+    int res = fill_indexed(ft, key, par, off, len - 1, info);
+    if (res != TMF_OK) release_info(ft, off, len); // no record points to the info
+    else res = log_op(ft, WAL_OP_INSERT, key, par, off, len - 1);
+    op_done(ft);
+    return res;
+}
+
+int tf_insert(FTable *ft, int key, int par, const char *info) {
+    if (key <= 0 || !info) return TMF_ERR_INVALID;
+    ST_BEGIN(t0);
+    wr_lock(ft);
+    int res = insert_op(ft, key, par, info);
+    wr_unlock(ft);
+    ST_END(&ft->stats, ST_INSERT, t0);
+    return res;
+}
+
+static int key_exists(void *ctx, int key) {
+    return has_key(ctx, key) > 0;
+}
+
+int tf_insert_batch(FTable *ft, const BatchRow *rows, int n, int *errs) {
+    if (n <= 0) return 0;
+    int *order = malloc(n * sizeof(int));
+    int *codes = errs ? errs : malloc(n * sizeof(int));
+    if (!order || !codes) {
+        free(order);
+        if (codes != errs) free(codes);
+        return 0;
+    }
+    wr_lock(ft);
+    STAT(ft, allocs, errs ? 1 : 2);
+    int m = batch_order(rows, n, key_exists, ft, order, codes);
+    for (int i = 0; i < n; i++) {
+        // tf_insert reports duplicates and missing parents as TMF_ERR_INVALID too
+        codes[i] = m < 0 ? TMF_ERR_WRITE : (codes[i] == BATCH_OK ? TMF_OK : TMF_ERR_INVALID);
+    }
+
+    // reserve slots for the whole batch and gather all info bytes into one buffer;
+    // a compressed heap packs the infos into its blocks one by one instead
+    size_t total = 0;
+    for (int q = 0; q < m; q++) total += strlen(rows[order[q]].info) + 1;
+    char *blob = m > 0 && !ft->zip ? malloc(total) : NULL;
+    int res = m > 0 && !ft->zip && !blob ? TMF_ERR_WRITE : TMF_OK;
+    while (res == TMF_OK && !ft->paged && ft->size - ft->count < m) res = grow(ft);
+
+    long base = 0;
+    if (res == TMF_OK && m > 0 && !ft->zip) {
+        size_t pos = 0;
+        for (int q = 0; q < m; q++) {
+            size_t len = strlen(rows[order[q]].info) + 1;
+            memcpy(blob + pos, rows[order[q]].info, len);
+            pos += len;
+        }
+        // a single append and a single flush for the whole batch
+        base = alloc_info(ft, total);
+        if (base < 0) {
+            res = TMF_ERR_WRITE;
+        } else if (file_write(ft, base, blob, total) != TMF_OK ||
+                   (!ft->map && !ft->wal.f && fflush(ft->f) != 0)) {
+            release_info(ft, base, (long)total);
+            res = TMF_ERR_WRITE;
+        }
+    }
+
+    int done = 0;
+    long off = base;
+    for (int q = 0; q < m; q++) {
+        int len = (int)strlen(rows[order[q]].info);
+        int r = res;
+        if (r == TMF_OK && ft->zip && (off = zh_append(&ft->zh, rows[order[q]].info, len + 1)) < 0)
+            r = TMF_ERR_WRITE;
+        if (r == TMF_OK) {
+            r = fill_indexed(ft, rows[order[q]].key, rows[order[q]].par, off, len, rows[order[q]].info);
+            // a row that did not make it into the table gives its info bytes back;
+            // once filled it is live even if logging it fails
+            if (r != TMF_OK) release_info(ft, off, len + 1);
+            else r = log_op(ft, WAL_OP_INSERT, rows[order[q]].key, rows[order[q]].par, off, len);
+        }
+        codes[order[q]] = r;
+        if (r == TMF_OK) done++;
+        off += len + 1;
+    }
+    op_done(ft);
+    wr_unlock(ft);
+    free(blob);
+    free(order);
+    if (codes != errs) free(codes);
+    return done;
+}
+
+int tf_remove_batch(FTable *ft, const int *keys, int n, int *errs) {
+    int done = 0;
+    wr_lock(ft);
+    // validate the whole batch first: a key removed together with an
+    // ancestor from the same batch still counts as found
+    for (int i = 0; i < n; i++) {
+        int res = has_key(ft, keys[i]) > 0 ? TMF_OK : TMF_ERR_NOT_FOUND;
+        if (errs) errs[i] = res;
+        if (res == TMF_OK) done++;
+    }
+    for (int i = 0; i < n; i++) {
+        if (has_key(ft, keys[i]) > 0) remove_op(ft, keys[i]);
+    }
+    wr_unlock(ft);
+    return done;
+}
+
+static int cmp_range(const void *a, const void *b) {
+    long x = ((const BrRange *)a)->off, y = ((const BrRange *)b)->off;
+    return (x > y) - (x < y);
+}
+
+// compressed heap: copies the n infos want[] out of their blocks into b->buf;
+// they are taken in offset order, so every block is unpacked once
+static int zip_fetch(const FTable *ft, BulkRead *b, const BrRange *want, int n) {
+    BrRange by_off[TF_BULK_WINDOW];
+    if (br_reserve(b, want, n) != 0) return -1;
+    for (int j = 0; j < n; j++) {
+        by_off[j].off = want[j].off;
+        by_off[j].len = j; // index into want
+    }
+    qsort(by_off, n, sizeof(BrRange), cmp_range);
+    int res = 0;
+    ZHeap *zh = (ZHeap *)&ft->zh; // the block cache changes even on reads
+    if (ft->concurrent) pthread_mutex_lock((pthread_mutex_t *)&ft->cache_lock);
+    for (int k = 0; k < n && res == 0; k++) {
+        int j = (int)by_off[k].len;
+        res = zh_read(zh, want[j].off, b->buf + b->pos[j], (int)want[j].len);
+    }
+    if (ft->concurrent) pthread_mutex_unlock((pthread_mutex_t *)&ft->cache_lock);
+    return res;
+}
+
+// resolves the infos of n records (n <= TF_BULK_WINDOW) into info[]: mapped
+// data in mmap mode, otherwise cache hits plus one bulk request for the misses
+// (sorted by offset, merged, read with pread); cache may be NULL for scans
+static int bulk_fetch(const FTable *ft, InfoCache *cache, BulkRead *b,
+                      const FItem *recs, int n, const char **info) {
+    BrRange want[TF_BULK_WINDOW];
+    int miss[TF_BULK_WINDOW];
+    int m = 0;
+    if (cache) ic_begin(cache);
+    for (int i = 0; i < n; i++) {
+        if (ft->map) {
+            info[i] = ft->map + recs[i].offset;
+            continue;
         }
-        fflush(ft->f);
+        info[i] = cache ? ic_get(cache, recs[i].key) : NULL;
+        if (info[i]) continue;
+        want[m].off = recs[i].offset;
+        want[m].len = (long)recs[i].length + 1;
+        miss[m++] = i;
+    }
+    if (m == 0) return TMF_OK;
+    int res;
+    if (ft->zip) {
+        res = zip_fetch(ft, b, want, m);
     } else {
-        // read existing index from file into memory
-        rewind(ft->f);
-        if (fread(&ft->count, sizeof(int), 1, ft->f) != 1 ||
-            fread(ft->records, sizeof(FItem), ft->size, ft->f) != (size_t)ft->size) {
-            return TMF_ERR_READ;
-        }
+        fflush(ft->f); // pread bypasses the stdio buffer
+#ifdef TABLE_STATS
+        long reads = b->reads, bytes = b->bytes;
+#endif
+        res = br_read(b, fileno(ft->f), want, m);
+        STAT(ft, reads, b->reads - reads);
+        STAT(ft, bytes_read, b->bytes - bytes);
+    }
+    if (res != 0) return TMF_ERR_READ;
+    for (int j = 0; j < m; j++) {
+        int i = miss[j];
+        char *p = b->buf + b->pos[j];
+        p[recs[i].length] = '\0';
+        info[i] = p;
+        if (cache) ic_put(cache, recs[i].key, p, recs[i].length);
     }
     return TMF_OK;
 }
 
-int tf_open(FTable *ft, const char *filename, int size) {
-    ft->fname = strdup(filename); // allocate memory for filename
-    if (!ft->fname) return TMF_ERR_OPEN;
-    
-    ft->size = size;
-    ft->records = calloc(size, sizeof(FItem)); // allocate index array
-    if (!ft->records) {
-        free(ft->fname);
-        return TMF_ERR_OPEN;
+static FItem paged_item(int key, const PRec *r) {
+    FItem it = { 1, key, r->par, r->offset, r->length };
+    return it;
+}
+
+// number of direct children of par, or -1 on a page read error
+static int child_count(FTable *ft, int par) {
+    if (!ft->paged) {
+        const Link *head = children_of(ft, par);
+        return head ? head->count : 0;
     }
+    if (par == 0) return ft->roots.count;
+    PRec r;
+    int found = bt_find(&ft->keys, bt_key(par, 0), &r);
+    return found == 1 ? r.children : found;
+}
 
-    ft->f = fopen(filename, "r+b"); // try opening existing file
-    if (!ft->f) {
-        ft->f = fopen(filename, "w+b"); // create file if it doesn't exist
-        if (!ft->f) {
-            free(ft->records);
-            free(ft->fname);
-            return TMF_ERR_OPEN;
-        }
+// calls fn for records with their infos, reading them window by window;
+// fn returns nonzero to stop
+typedef int (*InfoFn)(const FTable *ft, const FItem *r, const char *info, void *ctx);
+
+#define SCAN_STOP (-1) // fn asked to stop the scan
+
+// one window of a full scan; full scans bypass the info cache so they
+// do not flush the hot entries
+typedef struct {
+    BulkRead     b;
+    FItem       *recs;  // TF_BULK_WINDOW records
+    const char **info;
+} Scan;
+
+static int scan_init(Scan *sc) {
+    br_init(&sc->b);
+    sc->recs = malloc(TF_BULK_WINDOW * sizeof(FItem));
+    sc->info = malloc(TF_BULK_WINDOW * sizeof(const char *));
+    return sc->recs && sc->info ? TMF_OK : TMF_ERR_READ;
+}
+
+static void scan_free(Scan *sc) {
+    br_free(&sc->b);
+    free(sc->recs);
+    free(sc->info);
+}
+
+static int scan_window(const FTable *ft, Scan *sc, int n, InfoFn fn, void *ctx) {
+    int res = bulk_fetch(ft, NULL, &sc->b, sc->recs, n, sc->info);
+    STAT(ft, slots, n);
+    for (int i = 0; res == TMF_OK && i < n; i++) {
+        if (fn(ft, &sc->recs[i], sc->info[i], ctx)) return SCAN_STOP;
     }
-    return read_metadata(ft);
+    return res;
 }
 
-void tf_close(FTable *ft) {
-    if (!ft || !ft->f) return;
-    rewind(ft->f);
-    // save final metadata state before closing
-    fwrite(&ft->count, sizeof(int), 1, ft->f);
-    fwrite(ft->records, sizeof(FItem), ft->size, ft->f);
-    fflush(ft->f);
-    fclose(ft->f);
-    free(ft->records);
-    free(ft->fname);
+// calls fn for slots[0..n)
+static int each_info(const FTable *ft, const int *slots, int n, InfoFn fn, void *ctx) {
+    Scan sc;
+    int res = scan_init(&sc);
+    STAT(ft, allocs, 2);
+    for (int w = 0; w < n && res == TMF_OK; w += TF_BULK_WINDOW) {
+        int m = n - w < TF_BULK_WINDOW ? n - w : TF_BULK_WINDOW;
+        for (int i = 0; i < m; i++) sc.recs[i] = ft->records[slots[w + i]];
+        res = scan_window(ft, &sc, m, fn, ctx);
+    }
+    scan_free(&sc);
+    return res == SCAN_STOP ? TMF_OK : res;
 }
 
-static void remove_recursive(FTable *ft, int key) {
-    for (int i = 0; i < ft->size; i++) {
-        if (ft->records[i].busy && ft->records[i].key == key) {
-            ft->records[i].busy = 0; // mark record as inactive
-            ft->count--;
-            int deleted_key = ft->records[i].key;
-            // recursively find and remove child nodes
-            for (int j = 0; j < ft->size; j++) {
-                if (ft->records[j].busy && ft->records[j].par == deleted_key) {
-                    remove_recursive(ft, ft->records[j].key);
-                }
+// paged format: every record in key order, straight from the leaves of the key tree
+static int each_paged(const FTable *ft, InfoFn fn, void *ctx) {
+    BTree *keys = (BTree *)&ft->keys; // the page cache changes even on reads
+    Scan sc;
+    BtIter it;
+    BtKey k;
+    PRec r;
+    int got = 1;
+    int res = scan_init(&sc);
+    STAT(ft, allocs, 2);
+    if (res == TMF_OK && bt_seek(&it, keys, bt_key(0, 0)) != 0) res = TMF_ERR_READ;
+    while (res == TMF_OK && got == 1) {
+        int m = 0;
+        while (m < TF_BULK_WINDOW && (got = bt_next(&it, &k, &r)) == 1) sc.recs[m++] = paged_item(k.a, &r);
+        if (got < 0) res = TMF_ERR_READ;
+        else if (m > 0) res = scan_window(ft, &sc, m, fn, ctx);
+    }
+    scan_free(&sc);
+    return res == SCAN_STOP ? TMF_OK : res;
+}
+
+// fills ord with the busy slots in the requested order (TF_COMPACT_*), returns their number
+static int slot_order(const FTable *ft, int order, int *ord) {
+    int n = 0;
+    if (order == TF_COMPACT_PARENT) {
+        // breadth-first: the children of each parent end up next to each other
+        for (int s = ft->roots.child; s >= 0; s = ft->links[s].next) ord[n++] = s;
+        for (int q = 0; q < n; q++) {
+            for (int s = ft->links[ord[q]].child; s >= 0; s = ft->links[s].next) ord[n++] = s;
+        }
+    } else if (order == TF_COMPACT_DFS) {
+        // preorder: every subtree is one contiguous run
+        int s = ft->roots.child;
+        while (s >= 0) {
+            ord[n++] = s;
+            if (ft->links[s].child >= 0) {
+                s = ft->links[s].child;
+                continue;
             }
-            break;
+            while (s >= 0 && ft->links[s].next < 0) s = hi_find(&ft->idx, ft->records[s].par);
+            if (s >= 0) s = ft->links[s].next;
+        }
+    } else {
+        for (int s = 0; s < ft->size; s++) {
+            if (ft->records[s].busy) ord[n++] = s;
         }
     }
+    return n;
 }
 
-int tf_remove(FTable *ft, int key) {
-    for (int i = 0; i < ft->size; i++) {
-        if (ft->records[i].busy && ft->records[i].key == key) {
-            remove_recursive(ft, key); // start deletion chain
-            return TMF_OK;
+// calls fn for every record: in slot order, or in key order for the paged format
+static int each_record(const FTable *ft, InfoFn fn, void *ctx) {
+    if (ft->paged) return each_paged(ft, fn, ctx);
+    int *slots = malloc((size_t)(ft->count + 1) * sizeof(int));
+    STAT(ft, allocs, 1);
+    if (!slots) return TMF_ERR_READ;
+    int res = each_info(ft, slots, slot_order(ft, TF_COMPACT_SLOT, slots), fn, ctx);
+    free(slots);
+    return res;
+}
+
+// (key, slot) pairs, sorted to build the ordered index bottom-up
+typedef struct {
+    int key;
+    int slot;
+} KeySlot;
+
+static int cmp_key_slot(const void *a, const void *b) {
+    int x = ((const KeySlot *)a)->key, y = ((const KeySlot *)b)->key;
+    return (x > y) - (x < y);
+}
+
+static int build_order(FTable *ft) {
+    int n = 0;
+    KeySlot *ks = malloc((size_t)(ft->count + 1) * sizeof(KeySlot));
+    int *keys = malloc((size_t)(ft->count + 1) * sizeof(int));
+    int *slots = malloc((size_t)(ft->count + 1) * sizeof(int));
+    STAT(ft, allocs, 3);
+    int res = ks && keys && slots ? TMF_OK : TMF_ERR_READ;
+    for (int s = 0; res == TMF_OK && s < ft->size; s++) {
+        if (!ft->records[s].busy) continue;
+        ks[n].key = ft->records[s].key;
+        ks[n++].slot = s;
+    }
+    STAT(ft, slots, ft->size);
+    if (res == TMF_OK) {
+        qsort(ks, (size_t)n, sizeof(KeySlot), cmp_key_slot);
+        for (int i = 0; i < n; i++) {
+            keys[i] = ks[i].key;
+            slots[i] = ks[i].slot;
         }
+        if (oi_build(&ft->order, keys, slots, n) != 0) res = TMF_ERR_READ;
     }
-    return TMF_ERR_NOT_FOUND;
+    free(ks);
+    free(keys);
+    free(slots);
+    return res;
 }
 
-int tf_insert(FTable *ft, int key, int par, const char *info) {
-    if (key <= 0 || !info) return TMF_ERR_INVALID;
+// slot formats: the ordered index is built from the records by the first
+// query in key order and then kept up to date by fill_slot and remove_key;
+// the build is serialized like that of the jump labels (see need_jumps)
+static int need_order(FTable *ft) {
+    if (__atomic_load_n(&ft->order_ok, __ATOMIC_ACQUIRE)) return TMF_OK;
+    int res = TMF_OK;
+    if (ft->concurrent) pthread_mutex_lock(&ft->cache_lock);
+    if (!ft->order_ok) {
+        res = build_order(ft);
+        if (res == TMF_OK) __atomic_store_n(&ft->order_ok, 1, __ATOMIC_RELEASE);
+    }
+    if (ft->concurrent) pthread_mutex_unlock(&ft->cache_lock);
+    return res;
+}
 
-    int free_idx = -1;
-    // verify key uniqueness and find empty index slot
-    for (int i = 0; i < ft->size; i++) {
-        if (ft->records[i].busy && ft->records[i].key == key) return TMF_ERR_INVALID;
-        if (free_idx == -1 && !ft->records[i].busy) free_idx = i;
+// calls fn for the records with keys in [lo, hi] in key order, a window at a time:
+// from the ordered index in the slot formats, from the key tree in the paged one
+static int each_in_range(FTable *ft, int lo, int hi, InfoFn fn, void *ctx) {
+    Scan sc;
+    OiIter oit;
+    BtIter bit;
+    int more = lo <= hi;
+    int res = scan_init(&sc);
+    STAT(ft, allocs, 2);
+    if (res == TMF_OK && !ft->paged) res = need_order(ft);
+    if (res == TMF_OK && ft->paged && bt_seek(&bit, &ft->keys, bt_key(lo, 0)) != 0) res = TMF_ERR_READ;
+    if (res == TMF_OK && !ft->paged) oi_seek(&oit, &ft->order, lo, hi);
+    while (res == TMF_OK && more) {
+        int m = 0;
+        if (ft->paged) {
+            BtKey k;
+            PRec r;
+            while (m < TF_BULK_WINDOW && (more = bt_next(&bit, &k, &r)) == 1 && k.a <= hi)
+                sc.recs[m++] = paged_item(k.a, &r);
+            if (more < 0) res = TMF_ERR_READ;
+            else if (more == 1 && k.a > hi) more = 0;
+        } else {
+            int s;
+            while (m < TF_BULK_WINDOW && (more = oi_next(&oit, NULL, &s)) == 1) sc.recs[m++] = ft->records[s];
+        }
+        if (res == TMF_OK && m > 0) res = scan_window(ft, &sc, m, fn, ctx);
+    }
+    scan_free(&sc);
+    return res == SCAN_STOP ? TMF_OK : res;
+}
+
+// 1 if r still describes the live record of its key, 0 if it is stale,
+// -1 on a read error of the paged format
+static int is_live(FTable *ft, const FItem *r) {
+    if (ft->paged) {
+        PRec p;
+        int found = bt_find(&ft->keys, bt_key(r->key, 0), &p);
+        if (found < 0) return -1;
+        return found == 1 && p.offset == r->offset && p.length == r->length;
     }
+    int s = hi_find(&ft->idx, r->key);
+    return s >= 0 && ft->records[s].offset == r->offset && ft->records[s].length == r->length;
+}
+
+// reads n bytes of the info at off; the block cache of a compressed heap is
+// shared by readers like the info cache
+static int read_info(FTable *ft, long off, char *buf, int n) {
+    if (!ft->zip) return file_read(ft, off, buf, n);
+    if (ft->concurrent) pthread_mutex_lock(&ft->cache_lock);
+    int res = zh_read(&ft->zh, off, buf, n) == 0 ? TMF_OK : TMF_ERR_READ;
+    if (ft->concurrent) pthread_mutex_unlock(&ft->cache_lock);
+    return res;
+}
 
-    // ensure parent node exists
-    if (par != 0) {
-        int found = 0;
-        for (int i = 0; i < ft->size; i++) {
-            if (ft->records[i].busy && ft->records[i].key == par) { found = 1; break; }
+int tf_read_info(FTable *ft, const FItem *r, char *buf, int size) {
+    if (size <= 0) return TMF_ERR_INVALID;
+    int n = r->length < size - 1 ? r->length : size - 1;
+    int res = TMF_OK;
+    rd_lock(ft);
+    // r may be a stale copy (tf_search) whose bytes now belong to another record
+    int live = is_live(ft, r);
+    if (live <= 0) {
+        unlock(ft);
+        buf[0] = '\0';
+        return live < 0 ? TMF_ERR_READ : TMF_ERR_NOT_FOUND;
+    }
+    // readers share the cache, so its lookups and updates are serialized
+    if (ft->concurrent) pthread_mutex_lock(&ft->cache_lock);
+    const char *hit = ic_get(&ft->cache, r->key);
+    if (hit) memcpy(buf, hit, n);
+    if (ft->concurrent) pthread_mutex_unlock(&ft->cache_lock);
+    if (!hit) {
+        res = read_info(ft, r->offset, buf, n);
+        if (res == TMF_OK && n == r->length) {
+            if (ft->concurrent) pthread_mutex_lock(&ft->cache_lock);
+            ic_put(&ft->cache, r->key, buf, n);
+            if (ft->concurrent) pthread_mutex_unlock(&ft->cache_lock);
         }
-        if (!found) return TMF_ERR_INVALID;
     }
+    unlock(ft);
+    buf[n] = '\0';
+    return res == TMF_OK ? TMF_OK : TMF_ERR_READ;
+}
 
-    if (free_idx < 0) return TMF_ERR_WRITE; // table capacity reached
+void tf_cache_stats(const FTable *ft, long *hits, long *misses, size_t *bytes) {
+    if (hits) *hits = ft->cache.hits;
+    if (misses) *misses = ft->cache.misses;
+    if (bytes) *bytes = ft->cache.bytes;
+}
 
-    int len = (int)strlen(info) + 1;
-    long off = -1;
+void tf_cursor_open(TfCursor *c, FTable *ft, int par) {
+    int total = child_count(ft, par);
+    c->ft    = ft;
+    c->par   = par;
+    c->total = total > 0 ? total : 0;
+    c->err   = total < 0 ? TMF_ERR_READ : TMF_OK;
+    c->nwin  = 0;
+    c->iwin  = 0;
+    br_init(&c->br);
+    if (ft->paged) {
+        c->slot = total > 0 ? 0 : -1;
+        if (c->slot == 0 && bt_seek(&c->it, &ft->pars, bt_key(par, 0)) != 0) c->err = TMF_ERR_READ;
+    } else {
+        const Link *head = children_of(ft, par);
+        c->slot = head ? head->child : -1;
+    }
+}
 
-    // check for available space from deleted records (fragmentation reuse)
-    for (int i = 0; i < ft->size; i++) {
-        if (!ft->records[i].busy && ft->records[i].offset > 0 && (ft->records[i].length + 1) >= len) {
-            off = ft->records[i].offset;
+// collects the next window of the child list
+static void fill_window(TfCursor *c) {
+    FTable *ft = c->ft;
+    if (!ft->paged) {
+        for (; c->slot >= 0 && c->nwin < TF_CURSOR_WINDOW; c->slot = ft->links[c->slot].next)
+            c->win[c->nwin++] = ft->records[c->slot];
+        STAT(ft, slots, c->nwin);
+        return;
+    }
+    while (c->slot >= 0 && c->nwin < TF_CURSOR_WINDOW) {
+        BtKey k;
+        PRec r;
+        int got = bt_next(&c->it, &k, &r);
+        if (got < 0) c->err = TMF_ERR_READ;
+        if (got != 1 || k.a != c->par) {
+            c->slot = -1;
             break;
         }
+        c->win[c->nwin++] = paged_item(k.b, &r);
     }
+    STAT(ft, slots, c->nwin);
+}
 
-    if (off == -1) {
-        fseek(ft->f, 0, SEEK_END); // append to file if no reusable space found
-        off = ftell(ft->f);
-    } else {
-        fseek(ft->f, off, SEEK_SET); // reuse existing space in file
+int tf_cursor_next(TfCursor *c, TfRow *row) {
+    if (c->err != TMF_OK) return 0;
+    if (c->iwin == c->nwin) {
+        // next window of the child list: all its infos in one bulk read
+        c->nwin = 0;
+        c->iwin = 0;
+        fill_window(c);
+        if (c->err != TMF_OK || c->nwin == 0) return 0;
+        // concurrent cursors would unpin each other's cache entries, so they read the file
+        InfoCache *cache = c->ft->concurrent ? NULL : &c->ft->cache;
+        c->err = bulk_fetch(c->ft, cache, &c->br, c->win, c->nwin, c->info);
+        if (c->err != TMF_OK) return 0;
     }
+    int i = c->iwin++;
+    row->key    = c->win[i].key;
+    row->par    = c->win[i].par;
+    row->info   = c->info[i];
+    row->length = c->win[i].length;
+    return 1;
+}
 
-    if (fwrite(info, 1, len, ft->f) != (size_t)len) return TMF_ERR_WRITE;
-    fflush(ft->f);
+void tf_cursor_close(TfCursor *c) {
+    br_free(&c->br);
+}
 
-    // update index entry
-    ft->records[free_idx].busy = 1;
-    ft->records[free_idx].key = key;
-    ft->records[free_idx].par = par;
-    ft->records[free_idx].offset = off;
-    ft->records[free_idx].length = len - 1;
-    ft->count++;
-    return TMF_OK;
+int tf_search_each(FTable *ft, int par, TfRowFn fn, void *ctx) {
+    TfCursor c;
+    TfRow row;
+    int n = 0;
+    ST_BEGIN(t0);
+    rd_lock(ft);
+    tf_cursor_open(&c, ft, par);
+    while (tf_cursor_next(&c, &row)) {
+        n++;
+        if (fn(&row, ctx)) break;
+    }
+    tf_cursor_close(&c);
+    unlock(ft);
+    ST_END(&ft->stats, ST_SEARCH, t0);
+    return n;
 }
 
-FItem *tf_search(FTable *ft, int par, int *out_count) {
-    int cnt = 0;
-    // count children to allocate result array
-    for (int i = 0; i < ft->size; i++) {
-        if (ft->records[i].busy && ft->records[i].par == par) cnt++;
+static int search_fill(FTable *ft, int par, FItem *out, int cap) {
+    if (ft->paged) {
+        int total = child_count(ft, par);
+        int j = 0;
+        BtIter it;
+        BtKey k;
+        PRec r;
+        if (total <= 0 || cap <= 0) return total > 0 ? total : 0;
+        if (bt_seek(&it, &ft->pars, bt_key(par, 0)) == 0) {
+            while (j < cap && bt_next(&it, &k, &r) == 1 && k.a == par) out[j++] = paged_item(k.b, &r);
+        }
+        STAT(ft, slots, j);
+        return j < cap && j < total ? j : total; // fewer rows only after a read error
     }
-    if (cnt == 0) { *out_count = 0; return NULL; }
+    const Link *head = children_of(ft, par);
+    if (!head) return 0;
+    // metadata only, so no file access is needed here
+    int j = 0;
+    for (int i = head->child; i >= 0 && j < cap; i = ft->links[i].next) out[j++] = ft->records[i];
+    STAT(ft, slots, j);
+    return head->count;
+}
+
+int tf_search_fill(FTable *ft, int par, FItem *out, int cap) {
+    ST_BEGIN(t0);
+    rd_lock(ft);
+    int n = search_fill(ft, par, out, cap);
+    unlock(ft);
+    ST_END(&ft->stats, ST_SEARCH, t0);
+    return n;
+}
 
-    FItem *res = malloc(cnt * sizeof(FItem));
-    if (!res) return NULL;
+FItem *tf_search(FTable *ft, int par, int *out_count) {
+    ST_BEGIN(t0);
+    rd_lock(ft); // the count and the rows come from the same state
+    int cnt = search_fill(ft, par, NULL, 0);
+    FItem *res = cnt > 0 ? malloc(cnt * sizeof(FItem)) : NULL;
+    if (res) STAT(ft, allocs, 1);
     // populate result array with found items
-    for (int i = 0, j = 0; i < ft->size; i++) {
-        if (ft->records[i].busy && ft->records[i].par == par) res[j++] = ft->records[i];
-    }
-    *out_count = cnt;
+    *out_count = res ? search_fill(ft, par, res, cnt) : 0;
+    unlock(ft);
+    ST_END(&ft->stats, ST_SEARCH, t0);
     return res;
 }
 
+static int print_row(const FTable *ft, const FItem *r, const char *info, void *ctx) {
+    (void)ft;
+    (void)ctx;
+    printf("key=%d par=%d info=%s\n", r->key, r->par, info);
+    return 0;
+}
+
 void tf_print(FTable *ft) {
-    for (int i = 0; i < ft->size; i++) {
-        FItem *r = &ft->records[i];
-        if (!r->busy) continue;
-        char *buf = malloc(r->length + 1);
-        if (!buf) continue;
-        fseek(ft->f, r->offset, SEEK_SET); // jump to data location in file
-        if (fread(buf, 1, r->length, ft->f) == (size_t)r->length) {
-            buf[r->length] = '\0';
-            printf("key=%d par=%d info=%s\n", r->key, r->par, buf);
-        }
-        free(buf);
+    ST_BEGIN(t0);
+    rd_lock(ft);
+    each_record(ft, print_row, NULL);
+    unlock(ft);
+    ST_END(&ft->stats, ST_PRINT, t0);
+}
+
+void tf_print_sorted(FTable *ft) {
+    ST_BEGIN(t0);
+    rd_lock(ft);
+    each_in_range(ft, INT_MIN, INT_MAX, print_row, NULL);
+    unlock(ft);
+    ST_END(&ft->stats, ST_PRINT, t0);
+}
+
+// makes a rename durable: fsync the directory that holds path
+static void sync_dir(const char *path) {
+    const char *slash = strrchr(path, '/');
+    char *dir = slash ? strndup(path, slash - path + 1) : strdup(".");
+    if (!dir) return;
+    FILE *d = fopen(dir, "r");
+    if (d) {
+        fsync(fileno(d));
+        fclose(d);
+    }
+    free(dir);
+}
+
+static int write_info(const FTable *ft, const FItem *r, const char *info, void *ctx) {
+    (void)ft;
+    size_t len = (size_t)r->length + 1;
+    return fwrite(info, 1, len, (FILE *)ctx) != len;
+}
+
+// tf_compact of a compressed heap: the infos are packed into fresh blocks
+// that are appended to the new file one after another
+typedef struct {
+    FILE  *out;
+    long   end;  // end of the new file
+    ZHeap  zh;   // only appended to: read and release are never called
+    FItem *recs; // new FItem block, its offsets are set here
+    int    err;  // an append failed
+} ZipCopy;
+
+static long copy_alloc(void *ctx, size_t n) {
+    ZipCopy *c = ctx;
+    long off = c->end;
+    c->end += (long)n;
+    return off;
+}
+
+static int copy_write(void *ctx, long off, void *p, size_t n) {
+    ZipCopy *c = ctx;
+    return fseek(c->out, off, SEEK_SET) == 0 && fwrite(p, 1, n, c->out) == n ? 0 : -1;
+}
+
+static int copy_info(const FTable *ft, const FItem *r, const char *info, void *ctx) {
+    ZipCopy *c = ctx;
+    long off = zh_append(&c->zh, info, r->length + 1);
+    if (off < 0) {
+        c->err = 1;
+        return 1;
     }
+    c->recs[hi_find(&ft->idx, r->key)].offset = off;
+    return 0;
+}
+
+// writes the infos of slots ord[0..cnt) as blocks from *heap on, then the
+// directory; *heap becomes the end of the new file
+static int copy_zip(const FTable *ft, FILE *out, const int *ord, int cnt, FItem *recs,
+                    long *heap, long *zdir_off) {
+    ZipCopy c;
+    memset(&c, 0, sizeof(c));
+    c.out = out;
+    c.end = *heap;
+    c.recs = recs;
+    zh_init(&c.zh, copy_alloc, NULL, NULL, copy_write, &c);
+    int res = each_info(ft, ord, cnt, copy_info, &c);
+    if (res == TMF_OK && (c.err || zh_flush(&c.zh) != 0)) res = TMF_ERR_WRITE;
+    ZDir d = { c.zh.n, c.zh.n };
+    long off = (c.end + 7) / 8 * 8;
+    if (res == TMF_OK &&
+        (fseek(out, off, SEEK_SET) != 0 || fwrite(&d, sizeof(d), 1, out) != 1 ||
+         (d.n > 0 && fwrite(c.zh.dir, sizeof(ZBlock), d.n, out) != (size_t)d.n))) {
+        res = TMF_ERR_WRITE;
+    }
+    *zdir_off = off;
+    *heap = off + (long)sizeof(d) + (long)d.n * (long)sizeof(ZBlock);
+    zh_free(&c.zh);
+    return res;
+}
+
+int tf_compact(FTable *ft, int order, long *reclaimed) {
+    if (order < TF_COMPACT_SLOT || order > TF_COMPACT_DFS || ft->paged) return TMF_ERR_INVALID;
+    // everything logged so far must be durable: the old file stays valid until the rename;
+    // the flusher finds nothing pending afterwards and stays idle until free_state stops it
+    wr_lock(ft);
+    int flushed = wal_flush(ft);
+    wr_unlock(ft);
+    if (flushed != TMF_OK) return TMF_ERR_WRITE;
+
+    int *ord = malloc((size_t)(ft->count + 1) * sizeof(int));
+    FItem *recs = calloc((size_t)ft->size, sizeof(FItem));
+    size_t n = strlen(ft->fname);
+    char *tmp = malloc(n + 5);
+    if (!ord || !recs || !tmp) {
+        free(ord);
+        free(recs);
+        free(tmp);
+        return TMF_ERR_WRITE;
+    }
+    memcpy(tmp, ft->fname, n);
+    memcpy(tmp + n, ".tmp", 5);
+
+    // new layout: header | FItem block | Link block | hash index | infos back to back
+    long meta_off = sizeof(FHeader);
+    long links_off = meta_off + (long)ft->size * (long)sizeof(FItem);
+    long idx_off = links_off + (long)ft->size * (long)sizeof(Link);
+    long heap = idx_off + (long)ft->idx.cap * (long)sizeof(HashEntry);
+    int cnt = slot_order(ft, order, ord);
+    for (int q = 0; q < cnt; q++) {
+        recs[ord[q]] = ft->records[ord[q]];
+        if (ft->zip) continue; // copy_zip sets the offsets
+        recs[ord[q]].offset = heap;
+        heap += ft->records[ord[q]].length + 1;
+    }
+
+    int res = TMF_OK;
+    long zdir_off = 0;
+    FILE *out = fopen(tmp, "wb");
+    if (!out) res = TMF_ERR_OPEN;
+    // compressed blocks go first: the FItem block needs their offsets
+    if (res == TMF_OK && ft->zip) res = copy_zip(ft, out, ord, cnt, recs, &heap, &zdir_off);
+
+    FHeader h;
+    fill_header(ft, &h);
+    h.meta_off   = meta_off;
+    h.links_off  = links_off;
+    h.idx_off    = idx_off;
+    h.heap_end   = heap;
+    h.free_off   = heap; // an empty saved map: there are no gaps
+    h.free_count = 0;
+    h.free_cap   = 0;
+    h.wal_gen    = ft->wal_gen + 1; // the current log describes the old file only
+    h.zdir_off   = zdir_off;
+
+    if (res == TMF_OK &&
+        (fseek(out, 0, SEEK_SET) != 0 || fwrite(&h, sizeof(h), 1, out) != 1 ||
+         fwrite(recs, sizeof(FItem), ft->size, out) != (size_t)ft->size ||
+         fwrite(ft->links, sizeof(Link), ft->size, out) != (size_t)ft->size ||
+         fwrite(ft->idx.entries, sizeof(HashEntry), ft->idx.cap, out) != (size_t)ft->idx.cap)) {
+        res = TMF_ERR_WRITE;
+    }
+    if (res == TMF_OK && !ft->zip) res = each_info(ft, ord, cnt, write_info, out);
+    if (res == TMF_OK && ferror(out)) res = TMF_ERR_WRITE;
+    if (out && (fflush(out) != 0 || fsync(fileno(out)) != 0) && res == TMF_OK) res = TMF_ERR_WRITE;
+    if (out) fclose(out);
+    free(ord);
+    free(recs);
+
+    // the rename is the commit point: before it the old file is intact
+    if (res == TMF_OK && rename(tmp, ft->fname) != 0) res = TMF_ERR_WRITE;
+    if (res != TMF_OK) {
+        remove(tmp);
+        free(tmp);
+        return res;
+    }
+    free(tmp);
+    sync_dir(ft->fname);
+    // every free extent is gone from the new file; a compressed heap also
+    // drops the dead infos inside its blocks
+    if (reclaimed) *reclaimed = ft->zip ? ft->heap_end - heap : ft->fm.total;
+
+    // reopen the compacted file with the same options; keys and infos
+    // are unchanged, so the info index carries over
+    TfOptions opt = ft->opt;
+    char *fname = strdup(ft->fname);
+    if (!fname) return TMF_ERR_OPEN;
+    InfoIndex *ix = ft->info_idx;
+    ft->info_idx = NULL;
+    free_state(ft);
+    res = tf_open_ex(ft, fname, &opt);
+    free(fname);
+    if (res == TMF_OK) {
+        ft->info_idx = ix;
+    } else if (ix) {
+        ii_free(ix);
+        free(ix);
+    }
+    return res;
 }
 
 const char* tf_errstr(int code) {
@@ -190,23 +2017,478 @@ const char* tf_errstr(int code) {
     }
 }
 
+static void dot_node(OutBuf *o, const FItem *r, const char *info) {
+    ob_cstr(o, "  \"");
+    ob_int(o, r->key);
+    ob_cstr(o, "\" [label=\"");
+    ob_int(o, r->key);
+    ob_cstr(o, ": ");
+    ob_quoted(o, info);
+    ob_cstr(o, "\"];\n");
+}
+
+static void dot_edge(OutBuf *o, int par, int key) {
+    ob_cstr(o, "  \"");
+    ob_int(o, par);
+    ob_cstr(o, "\" -> \"");
+    ob_int(o, key);
+    ob_cstr(o, "\";\n");
+}
+
+static int dot_row(const FTable *ft, const FItem *r, const char *info, void *ctx) {
+    (void)ft;
+    dot_node(ctx, r, info);
+    if (r->par != 0) dot_edge(ctx, r->par, r->key); // draw hierarchy edge
+    return 0;
+}
+
+// breadth-first export queue: records with their depth below the export root
+typedef struct {
+    FItem *recs;
+    int   *depth;
+    int    n;
+    int    cap;
+    long   limit; // the queue never holds more records than this
+} DotQueue;
+
+static int dot_push(DotQueue *dq, const FItem *r, int depth) {
+    if (dq->n == dq->cap) {
+        int cap = dq->cap ? dq->cap * 2 : 1024;
+        FItem *recs = realloc(dq->recs, (size_t)cap * sizeof(FItem));
+        if (recs) dq->recs = recs;
+        int *d = recs ? realloc(dq->depth, (size_t)cap * sizeof(int)) : NULL;
+        if (!d) return TMF_ERR_READ;
+        dq->depth = d;
+        dq->cap = cap;
+    }
+    dq->recs[dq->n] = *r;
+    dq->depth[dq->n++] = depth;
+    return TMF_OK;
+}
+
+// queues the children of key (0 — the roots) at the given depth
+static int dot_children(const FTable *ft, DotQueue *dq, int key, int depth) {
+    int res = TMF_OK;
+    if (!ft->paged) {
+        const Link *head = children_of(ft, key);
+        for (int i = head ? head->child : -1; i >= 0 && dq->n < dq->limit && res == TMF_OK; i = ft->links[i].next)
+            res = dot_push(dq, &ft->records[i], depth);
+        return res;
+    }
+    BtIter it;
+    BtKey k;
+    PRec r;
+    int got = 1;
+    if (bt_seek(&it, (BTree *)&ft->pars, bt_key(key, 0)) != 0) return TMF_ERR_READ;
+    while (dq->n < dq->limit && res == TMF_OK && (got = bt_next(&it, &k, &r)) == 1 && k.a == key) {
+        FItem item = paged_item(k.b, &r);
+        res = dot_push(dq, &item, depth);
+    }
+    return got < 0 ? TMF_ERR_READ : res;
+}
+
+// filtered export: breadth-first from the subtree root (or the table roots)
+// within the depth and node limits; infos are fetched a window at a time
+static int dot_filtered_rows(const FTable *ft, OutBuf *o, const DotFilter *flt) {
+    DotQueue dq = { NULL, NULL, 0, 0, flt->max_nodes > 0 ? flt->max_nodes : (long)ft->count };
+    Scan sc;
+    int res = scan_init(&sc);
+    STAT(ft, allocs, 2);
+    if (res == TMF_OK && flt->root != 0) {
+        FItem root = { 0, 0, 0, 0, 0 };
+        if (ft->paged) {
+            PRec r;
+            int found = bt_find((BTree *)&ft->keys, bt_key(flt->root, 0), &r);
+            if (found < 0) res = TMF_ERR_READ;
+            else if (!found) res = TMF_ERR_NOT_FOUND;
+            else root = paged_item(flt->root, &r);
+        } else {
+            int i = hi_find(&ft->idx, flt->root);
+            if (i < 0) res = TMF_ERR_NOT_FOUND;
+            else root = ft->records[i];
+        }
+        if (res == TMF_OK) res = dot_push(&dq, &root, 1);
+    } else if (res == TMF_OK) {
+        res = dot_children(ft, &dq, 0, 1);
+    }
+    // children are appended while the window is written, so the
+    // next window starts right after this one, not TF_BULK_WINDOW later
+    for (int w = 0, m = 0; w < dq.n && res == TMF_OK; w += m) {
+        m = dq.n - w < TF_BULK_WINDOW ? dq.n - w : TF_BULK_WINDOW;
+        memcpy(sc.recs, dq.recs + w, (size_t)m * sizeof(FItem));
+        res = bulk_fetch(ft, NULL, &sc.b, sc.recs, m, sc.info);
+        STAT(ft, slots, m);
+        for (int i = 0; i < m && res == TMF_OK; i++) {
+            const FItem *r = &sc.recs[i];
+            dot_node(o, r, sc.info[i]);
+            // the root of the exported subtree has no parent in the output
+            if (r->par != 0 && r->key != flt->root) dot_edge(o, r->par, r->key);
+            int depth = dq.depth[w + i];
+            if (flt->max_depth <= 0 || depth < flt->max_depth) res = dot_children(ft, &dq, r->key, depth + 1);
+        }
+    }
+    scan_free(&sc);
+    free(dq.recs);
+    free(dq.depth);
+    return res;
+}
+
+int tf_export_dot_ex(const FTable *ft, FILE *f, const DotFilter *flt) {
+    OutBuf o;
+    ST_BEGIN(t0);
+    ob_init(&o, f, OB_CAP);
+    ob_cstr(&o, "digraph G {\n");
+    rd_lock(ft);
+    int res;
+    if (dot_filtered(flt)) res = dot_filtered_rows(ft, &o, flt);
+    else if (flt && flt->sorted) res = each_in_range((FTable *)ft, INT_MIN, INT_MAX, dot_row, &o);
+    else res = each_record(ft, dot_row, &o);
+    unlock(ft);
+    ob_cstr(&o, "}\n");
+    if (ob_flush(&o) != 0 && res == TMF_OK) res = TMF_ERR_WRITE;
+    ob_free(&o);
+    ST_END(&ft->stats, ST_EXPORT, t0);
+    return res;
+}
+
 void tf_export_dot(const FTable *ft, const char *filename) {
     FILE *f = fopen(filename, "w");
     if (!f) return;
-    fprintf(f, "digraph G {\n");
-    for (int i = 0; i < ft->size; i++) {
-        const FItem *r = &ft->records[i];
-        if (!r->busy) continue;
-        char *buf = malloc(r->length + 1);
-        if (buf) {
-            fseek(ft->f, r->offset, SEEK_SET);
-            fread(buf, 1, r->length, ft->f);
-            buf[r->length] = '\0';
-            fprintf(f, "  \"%d\" [label=\"%d: %s\"];\n", r->key, r->key, buf);
-            free(buf);
-        }
-        if (r->par != 0) fprintf(f, "  \"%d\" -> \"%d\";\n", r->par, r->key); // draw hierarchy edge
-    }
-    fprintf(f, "}\n");
+    tf_export_dot_ex(ft, f, NULL);
     fclose(f);
+}
+
+// --- hierarchy queries ---
+
+// slot formats: the jump labels are built by the first hierarchy query and
+// then kept up to date by fill_slot; readers may get here together, so the
+// build is serialized (writers hold the exclusive lock and never race it)
+static int need_jumps(FTable *ft) {
+    if (__atomic_load_n(&ft->jumps_ok, __ATOMIC_ACQUIRE)) return TMF_OK;
+    int res = TMF_OK;
+    if (ft->concurrent) pthread_mutex_lock(&ft->cache_lock);
+    if (!ft->jumps_ok) {
+        STAT(ft, allocs, 3);
+        if (jump_resize(&ft->jumps, ft->size) != 0) {
+            res = TMF_ERR_READ;
+        } else {
+            jump_build(&ft->jumps, ft->links, &ft->roots);
+            STAT(ft, slots, ft->count); // the build visits every record once
+            __atomic_store_n(&ft->jumps_ok, 1, __ATOMIC_RELEASE);
+        }
+    }
+    if (ft->concurrent) pthread_mutex_unlock(&ft->cache_lock);
+    return res;
+}
+
+// the record of key in either format: 1 if found, 0 if not, -1 on a read error
+static int find_item(FTable *ft, int key, FItem *out) {
+    if (!ft->paged) {
+        int i = hi_find(&ft->idx, key);
+        if (i >= 0) *out = ft->records[i];
+        return i >= 0;
+    }
+    PRec r;
+    int found = bt_find(&ft->keys, bt_key(key, 0), &r);
+    if (found == 1) *out = paged_item(key, &r);
+    return found;
+}
+
+// hands the rows of a window on to the caller's TfRowFn
+typedef struct {
+    TfRowFn fn;
+    void   *ctx;
+} RowCall;
+
+static int call_row(const FTable *ft, const FItem *r, const char *info, void *ctx) {
+    (void)ft;
+    RowCall *rc = ctx;
+    TfRow row = { r->key, r->par, info, r->length };
+    return rc->fn(&row, rc->ctx);
+}
+
+// paged preorder: the export queue serves as the stack; the children of key
+// go on top in reverse key order, so they come off it in key order
+static int push_children(FTable *ft, DotQueue *st, int key) {
+    int from = st->n;
+    int res = dot_children(ft, st, key, 0);
+    for (int a = from, b = st->n - 1; a < b; a++, b--) {
+        FItem r = st->recs[a];
+        st->recs[a] = st->recs[b];
+        st->recs[b] = r;
+    }
+    return res;
+}
+
+// preorder over the subtree of key, a window of infos at a time
+static int descendants(FTable *ft, int key, TfRowFn fn, void *ctx) {
+    RowCall rc = { fn, ctx };
+    DotQueue st = { NULL, NULL, 0, 0, LONG_MAX };
+    FItem root;
+    Scan sc;
+    // key 0 walks the whole forest: the roots are the children of 0
+    int found = key != 0 ? find_item(ft, key, &root) : 1;
+    if (found != 1) return found < 0 ? TMF_ERR_READ : TMF_ERR_NOT_FOUND;
+    int res = scan_init(&sc);
+    STAT(ft, allocs, 2);
+    int top = ft->paged || key == 0 ? -1 : hi_find(&ft->idx, key);
+    int s = -1; // next slot of the walk
+    if (res == TMF_OK) res = ft->paged ? push_children(ft, &st, key) : need_jumps(ft);
+    if (res == TMF_OK && !ft->paged) s = top >= 0 ? jump_next(&ft->jumps, ft->links, top, top) : ft->roots.child;
+    while (res == TMF_OK) {
+        int m = 0;
+        if (ft->paged) {
+            while (m < TF_BULK_WINDOW && st.n > 0 && res == TMF_OK) {
+                sc.recs[m] = st.recs[--st.n];
+                res = push_children(ft, &st, sc.recs[m++].key);
+            }
+        } else {
+            for (; m < TF_BULK_WINDOW && s >= 0; s = jump_next(&ft->jumps, ft->links, top, s))
+                sc.recs[m++] = ft->records[s];
+        }
+        if (res != TMF_OK || m == 0) break;
+        res = scan_window(ft, &sc, m, call_row, &rc);
+    }
+    scan_free(&sc);
+    free(st.recs);
+    free(st.depth);
+    return res == SCAN_STOP ? TMF_OK : res;
+}
+
+int tf_descendants(FTable *ft, int key, TfRowFn fn, void *ctx) {
+    rd_lock(ft);
+    int res = descendants(ft, key, fn, ctx);
+    unlock(ft);
+    return res;
+}
+
+// the path is written out only up to cap keys; the paged format still
+// climbs to the root to count the rest
+static int ancestors(FTable *ft, int key, int *keys, int cap) {
+    FItem r;
+    if (find_item(ft, key, &r) != 1) return -1;
+    if (!ft->paged) {
+        if (need_jumps(ft) != TMF_OK) return -1;
+        int s = hi_find(&ft->idx, key);
+        int n = ft->jumps.depth[s];
+        for (int q = 0; q < n && q < cap; q++) {
+            s = ft->jumps.up[s];
+            keys[q] = ft->records[s].key;
+        }
+        return n;
+    }
+    int n = 0;
+    for (; r.par != 0; n++) {
+        if (n < cap) keys[n] = r.par;
+        if (find_item(ft, r.par, &r) != 1) return -1; // a missing parent is a broken tree
+    }
+    return n;
+}
+
+int tf_ancestors(FTable *ft, int key, int *keys, int cap) {
+    rd_lock(ft);
+    int n = ancestors(ft, key, keys, cap);
+    unlock(ft);
+    return n;
+}
+
+static int is_ancestor(FTable *ft, int anc, int key) {
+    FItem a, r;
+    if (find_item(ft, anc, &a) != 1 || find_item(ft, key, &r) != 1) return -1;
+    if (!ft->paged) {
+        if (need_jumps(ft) != TMF_OK) return -1;
+        return jump_is_ancestor(&ft->jumps, hi_find(&ft->idx, anc), hi_find(&ft->idx, key));
+    }
+    while (r.par != 0) {
+        if (r.par == anc) return 1;
+        if (find_item(ft, r.par, &r) != 1) return -1;
+    }
+    return 0;
+}
+
+int tf_is_ancestor(FTable *ft, int anc, int key) {
+    rd_lock(ft);
+    int res = is_ancestor(ft, anc, key);
+    unlock(ft);
+    return res;
+}
+
+// --- key order ---
+
+int tf_range(FTable *ft, int lo, int hi, TfRowFn fn, void *ctx) {
+    RowCall rc = { fn, ctx };
+    ST_BEGIN(t0);
+    rd_lock(ft);
+    int res = each_in_range(ft, lo, hi, call_row, &rc);
+    unlock(ft);
+    ST_END(&ft->stats, ST_SEARCH, t0);
+    return res;
+}
+
+// the record with the smallest (last = 0) or the largest key
+static int edge_item(FTable *ft, int last, FItem *out) {
+    int found;
+    if (ft->paged) {
+        BtIter it;
+        BtKey k;
+        PRec r;
+        if (last) found = bt_last(&ft->keys, &k, &r);
+        else found = bt_seek(&it, &ft->keys, bt_key(0, 0)) != 0 ? -1 : bt_next(&it, &k, &r);
+        if (found == 1) *out = paged_item(k.a, &r);
+    } else {
+        int s;
+        if (need_order(ft) != TMF_OK) return TMF_ERR_READ;
+        found = last ? oi_max(&ft->order, NULL, &s) : oi_min(&ft->order, NULL, &s);
+        if (found) *out = ft->records[s];
+    }
+    if (found < 0) return TMF_ERR_READ;
+    return found ? TMF_OK : TMF_ERR_NOT_FOUND;
+}
+
+int tf_min(FTable *ft, FItem *out) {
+    rd_lock(ft);
+    int res = edge_item(ft, 0, out);
+    unlock(ft);
+    return res;
+}
+
+int tf_max(FTable *ft, FItem *out) {
+    rd_lock(ft);
+    int res = edge_item(ft, 1, out);
+    unlock(ft);
+    return res;
+}
+
+// --- info index ---
+
+typedef struct {
+    InfoIndex *ix;
+    int        err;
+} IndexBuild;
+
+static int index_row(const FTable *ft, const FItem *r, const char *info, void *ctx) {
+    (void)ft;
+    IndexBuild *b = ctx;
+    if (ii_append(b->ix, r->key, info) != 0) b->err = 1;
+    return b->err;
+}
+
+int tf_set_info_index(FTable *ft, int on) {
+    int res = TMF_OK;
+    wr_lock(ft);
+    if (!on && ft->info_idx) {
+        ii_free(ft->info_idx);
+        free(ft->info_idx);
+        ft->info_idx = NULL;
+    } else if (on && !ft->info_idx) {
+        IndexBuild b = { malloc(sizeof(InfoIndex)), 0 };
+        STAT(ft, allocs, 1);
+        if (!b.ix || ii_init(b.ix, ft->count) != 0) res = TMF_ERR_READ;
+        // one bulk scan of every info, past the cache
+        if (res == TMF_OK) res = each_record(ft, index_row, &b);
+        if (res == TMF_OK && (b.err || ii_build(b.ix) != 0)) res = TMF_ERR_READ;
+        if (res == TMF_OK) {
+            ft->info_idx = b.ix;
+        } else if (b.ix) {
+            ii_free(b.ix);
+            free(b.ix);
+        }
+    }
+    wr_unlock(ft);
+    return res;
+}
+
+// hands an indexed key on to the caller's TfRowFn: the record comes from
+// memory (or the key tree), the info from the index itself
+typedef struct {
+    FTable *ft;
+    TfRowFn fn;
+    void   *ctx;
+    int     err;
+} FindCall;
+
+static int found_row(int key, const char *info, void *ctx) {
+    FindCall *fc = ctx;
+    FItem r;
+    if (find_item(fc->ft, key, &r) != 1) {
+        fc->err = TMF_ERR_READ;
+        return 1;
+    }
+    TfRow row = { key, r.par, info, r.length };
+    return fc->fn(&row, fc->ctx);
+}
+
+// full scan fallback: rows whose info matches go on to the caller
+typedef struct {
+    const char *s;
+    size_t      n;
+    int         prefix;
+    RowCall     rc;
+} InfoMatch;
+
+static int match_row(const FTable *ft, const FItem *r, const char *info, void *ctx) {
+    InfoMatch *m = ctx;
+    if (m->prefix ? strncmp(info, m->s, m->n) != 0 : !strstr(info, m->s)) return 0;
+    return call_row(ft, r, info, &m->rc);
+}
+
+static int find_info(FTable *ft, const char *s, int prefix, TfRowFn fn, void *ctx) {
+    if (!s) return TMF_ERR_INVALID;
+    int res;
+    ST_BEGIN(t0);
+    rd_lock(ft);
+    if (ft->info_idx) {
+        FindCall fc = { ft, fn, ctx, TMF_OK };
+        long seen = prefix ? ii_prefix(ft->info_idx, s, found_row, &fc)
+                           : ii_substr(ft->info_idx, s, found_row, &fc);
+        STAT(ft, slots, seen);
+        (void)seen;
+        res = fc.err;
+    } else {
+        InfoMatch m = { s, strlen(s), prefix, { fn, ctx } };
+        res = each_record(ft, match_row, &m);
+    }
+    unlock(ft);
+    ST_END(&ft->stats, ST_SEARCH, t0);
+    return res;
+}
+
+int tf_find_prefix(FTable *ft, const char *prefix, TfRowFn fn, void *ctx) {
+    return find_info(ft, prefix, 1, fn, ctx);
+}
+
+int tf_find_substr(FTable *ft, const char *s, TfRowFn fn, void *ctx) {
+    return find_info(ft, s, 0, fn, ctx);
+}
+
+int tf_stats(FTable *ft, TableStats *out) {
+    memset(out, 0, sizeof(*out));
+#ifdef TABLE_STATS
+    rd_lock(ft);
+    st_copy(out, &ft->stats);
+    if (ft->paged) {
+        // page I/O is counted by the pager itself
+        if (ft->concurrent) pthread_mutex_lock(&ft->pager.lock);
+        out->reads += ft->pager.reads;
+        out->writes += ft->pager.writes;
+        out->bytes_read += ft->pager.reads * BT_PAGE;
+        out->bytes_written += ft->pager.writes * BT_PAGE;
+        if (ft->concurrent) pthread_mutex_unlock(&ft->pager.lock);
+    }
+    unlock(ft);
+    return TMF_OK;
+#else
+    (void)ft;
+    return TMF_ERR_INVALID;
+#endif
+}
+
+void tf_stats_reset(FTable *ft) {
+    wr_lock(ft);
+#ifdef TABLE_STATS
+    memset(&ft->stats, 0, sizeof(ft->stats));
+#endif
+    ft->pager.reads = 0;
+    ft->pager.writes = 0;
+    wr_unlock(ft);
 }
\ No newline at end of file
@@ -2,6 +2,22 @@
 #define TABLE_FILE_H
 
 #include <stdio.h>
+#include <stddef.h>
+#include <pthread.h>
+#include "hash_index.h"
+#include "tree_links.h"
+#include "tree_jump.h"
+#include "info_index.h"
+#include "ord_index.h"
+#include "batch.h"
+#include "wal.h"
+#include "freemap.h"
+#include "bulkread.h"
+#include "infocache.h"
+#include "btree.h"
+#include "zheap.h"
+#include "stats.h"
+#include "outbuf.h"
 
 #define TMF_OK            0 // успешно
 #define TMF_ERR_OPEN      1 // ошибка открытия/создания файла
@@ -14,56 +30,398 @@ typedef struct {
     int   busy;     // 0 – свободно, 1 – запись существует
     int   key;      // ключ элемента, != 0
     int   par;      // ключ родителя: 0 или существующий ключ
-    long  offset;   // смещение данных info в файле
+    long  offset;   // смещение данных info в файле (при сжатии — в блоках, см. zheap.h)
     int   length;   // длина данных info в байтах (без '\0')
 } FItem;
 
+// Политика сброса отображённого файла на диск (режим mmap)
+#define TF_MSYNC_CLOSE 0 // msync только при закрытии (по умолчанию)
+#define TF_MSYNC_NONE  1 // не вызывать msync, запись оставляется ядру
+#define TF_MSYNC_ASYNC 2 // msync(MS_ASYNC) после каждой операции
+#define TF_MSYNC_SYNC  3 // msync(MS_SYNC) после каждой операции
+
+// Параметры открытия; нулевые поля означают значения по умолчанию
+typedef struct {
+    int capacity;     // начальная ёмкость новой таблицы (см. tf_open)
+    int use_mmap;     // 1 — работать через mmap вместо fseek/fread/fwrite
+    int msync_policy; // TF_MSYNC_* (только для use_mmap)
+    int use_wal;      // 1 — вести журнал <filename>.wal (только без use_mmap)
+    int wal_group_ops;  // сбрасывать журнал после стольких операций (64)
+    int wal_group_ms;   // ... или через столько миллисекунд (10), в том числе без новых операций
+    int wal_checkpoint; // контрольная точка после стольких операций (4096)
+    long cache_bytes;   // бюджет кэша info в байтах (1 МиБ), < 0 — без кэша
+    int use_btree;      // 1 — новый файл создаётся в страничном формате (B+деревья)
+    int page_cache;     // страниц в кэше B+деревьев (256, т.е. 1 МиБ)
+    int concurrent;     // 1 — таблицу используют несколько потоков (см. tf_open_ex)
+    int compress;       // 1 — info в сжатых блоках (zheap.h): файл меньше, чтение медленнее
+} TfOptions;
+
 typedef struct {
-    FItem *records; // массив метаданных длины size
-    int    size;    // максимальный размер таблицы
+    FItem *records; // массив метаданных длины size (в режиме mmap — внутри отображения)
+    int    size;    // текущая ёмкость таблицы (растёт автоматически)
     int    count;   // текущее число занятых записей
     FILE  *f;       // файловый дескриптор
     char   *fname;  // имя файла (для записи при закрытии)
+    HashIndex idx;  // индекс "ключ -> слот", хранится в файле
+    Link   *links;  // связи потомков по слотам, хранятся в файле
+    Link    roots;  // список корней (par == 0): общий невидимый родитель
+    int     free_head; // первый свободный слот (цепочка через links[].next)
+    Jumps   jumps;     // родители, глубины и прыжки к предкам по слотам (в памяти)
+    int     jumps_ok;  // 1 — jumps построены (первым запросом об иерархии)
+    OrdIndex order;    // ключ -> слот по возрастанию ключей (в памяти)
+    int     order_ok;  // 1 — order построен (первым запросом по порядку ключей)
+    InfoIndex *info_idx; // индекс по info в памяти или NULL (см. tf_set_info_index)
+    long    meta_off;  // смещение блока FItem в файле
+    long    links_off; // смещение блока Link в файле
+    int     meta_block; // число слотов, под которое выделены блоки FItem и Link
+    long    idx_off;   // смещение блока хеш-индекса в файле
+    int     idx_block; // число ячеек, под которое выделен блок индекса
+    long    heap_end;  // конец занятой части файла (сюда дописываются данные)
+    char   *map;       // отображение файла или NULL (обычный режим)
+    size_t  map_len;   // длина отображения
+    int     msync_policy; // TF_MSYNC_*
+    Wal     wal;          // журнал операций (wal.f == NULL — выключен)
+    long    wal_gen;      // поколение журнала, учтённое в metadata
+    int     wal_checkpoint; // операций журнала до контрольной точки
+    FreeMap fm;           // свободные участки файла
+    long    free_off;     // смещение сохранённой карты свободных участков
+    int     free_count;   // участков в сохранённой карте
+    int     free_cap;     // ёмкость блока карты
+    FmExtent *limbo;      // участки удалённых info, ждущие сброса журнала
+    int     limbo_n;
+    int     limbo_cap;
+    TfOptions opt;        // параметры открытия (для повторного открытия)
+    InfoCache cache;      // кэш info по ключам (в режиме mmap выключен)
+    int     paged;        // 1 — страничный формат: records, links и idx не используются
+    BtPager pager;        // кэш страниц B+деревьев
+    BTree   keys;         // (key, 0) -> запись
+    BTree   pars;         // (par, key) -> запись, для поиска по родителю
+    int     zip;          // 1 — info хранятся сжатыми блоками, offset — виртуальный
+    ZHeap   zh;           // блоки сжатой кучи info
+    long    zdir_off;     // смещение сохранённого каталога блоков
+    int     zdir_cap;     // ёмкость блока каталога (в блоках)
+    int     concurrent;   // 1 — функции таблицы берут lock
+    int     locked;       // 1 — lock создан: изменения берут его (concurrent или журнал)
+    pthread_rwlock_t lock;        // читатели/писатель в параллельном режиме
+    pthread_t flusher;    // поток, сбрасывающий группу журнала по сроку
+    int     flusher_on;   // 1 — поток запущен
+    int     flush_stop;   // 1 — потоку пора завершиться
+    int     flush_kick;   // 1 — начата новая группа журнала (новый срок сброса)
+    pthread_mutex_t  flush_lock;  // flush_stop и flush_kick
+    pthread_cond_t   flush_cv;
+    pthread_mutex_t  cache_lock;  // кэш info, общий для читателей
+#ifdef TABLE_STATS
+    TableStats stats;     // счётчики операций (см. stats.h)
+#endif
 } FTable;           // ft - имя переменной, указывающей на структуру FTable
 
 /*
- * Открыть (или создать) файл и считать metadata.
- * size — максимальное число записей.
+ * Открыть (или создать) файл и считать metadata (блоки FItem, связей
+ * и хеш-индекса хранятся в файле, поэтому ничего не перестраивается).
+ * size — начальная ёмкость новой таблицы; ёмкость хранится в заголовке
+ * файла и удваивается при заполнении. Для файлов старого формата
+ * (без заголовка) size — число записей, с которым файл был создан;
+ * такой файл преобразуется в новый формат при открытии.
  * Возвращает TMF_OK или код ошибки.
  */
 int tf_open(FTable *ft, const char *filename, int size);
 
 /*
- * Закрыть файл: записать count и metadata, освободить память.
+ * То же, что tf_open, с параметрами opt (opt->capacity — аналог size).
+ * С use_btree новый файл создаётся в страничном формате: вместо массива
+ * FItem в памяти записи лежат в двух B+деревьях в том же файле — по key
+ * и по (par, key). Страницы читаются через кэш из page_cache страниц,
+ * поэтому открытие не читает записи, память ограничена кэшами, а поиск
+ * по ключу, по родителю и вставка читают O(log n) страниц.
+ * Формат существующего файла определяется его заголовком (use_btree
+ * на него не влияет). Страничный формат не поддерживает use_mmap,
+ * use_wal и tf_compact (TMF_ERR_INVALID); как и обычный режим без
+ * журнала, он сохраняет состояние только в tf_sync и tf_close.
+ * С concurrent поиск, tf_read_info, вывод и экспорт берут блокировку
+ * на чтение и идут из многих потоков одновременно (info читаются через
+ * pread, без общей позиции файла), изменения и tf_sync — монопольную.
+ * Курсоры блокировку не берут (см. tf_read_lock) и в этом режиме читают
+ * info из файла, минуя кэш. tf_compact и tf_close вызываются, когда
+ * других потоков, работающих с таблицей, уже нет.
+ * В режиме use_mmap файл отображается в память целиком: открытие не
+ * читает metadata, а поиск, tf_print и курсоры читают info без копирования
+ * (строки в курсоре указывают прямо в отображение).
+ * С use_wal изменения индекса (вставки и удаления) пишутся в журнал
+ * <filename>.wal и сбрасываются группами с fsync; при открытии журнал
+ * воспроизводится, так что после сбоя теряется не больше одной
+ * несброшенной группы. Группу, которую не сбросила следующая операция,
+ * через wal_group_ms сбрасывает фоновый поток таблицы, поэтому теряются
+ * лишь изменения последних wal_group_ms, даже если таблица простаивает.
+ * Поток берёт ту же блокировку, что и изменения (без concurrent её
+ * берут только изменения, поиск по-прежнему идёт без блокировки).
+ * Каждые wal_checkpoint операций журнал сворачивается
+ * в metadata файла (контрольная точка) и очищается.
+ * use_wal вместе с use_mmap не поддерживается (TMF_ERR_INVALID).
+ * С compress новый файл (любого из двух форматов) хранит info не по
+ * отдельности, а упакованными в блоки по ZH_BLOCK байт, сжатыми lz.h;
+ * чтение распаковывает блок в небольшой кэш, поэтому сканы и соседние
+ * строки распаковываются один раз на блок. Сжатие существующего файла
+ * определяется его заголовком; с use_mmap и use_wal оно не
+ * поддерживается (TMF_ERR_INVALID). Место удалённых info в частично
+ * живых блоках возвращает tf_compact (он переупаковывает блоки).
+ * Возвращает TMF_OK или код ошибки.
+ */
+int tf_open_ex(FTable *ft, const char *filename, const TfOptions *opt);
+
+/*
+ * Сбросить изменения на диск: несброшенную группу журнала,
+ * отображение (msync) или metadata в обычном режиме.
+ * Возвращает TMF_OK или TMF_ERR_WRITE.
+ */
+int tf_sync(FTable *ft);
+
+/*
+ * Закрыть файл: записать заголовок и metadata, освободить память.
  */
 void tf_close(FTable *ft);
 
 /*
- * Вставить новый элемент: дописать info в конец файла,
- * добавить/обновить FItem в памяти.
+ * Вставить новый элемент: записать info в наименьший подходящий
+ * свободный участок файла (или в конец файла), добавить FItem.
  * Возвращает TMF_OK или код ошибки.
  */
 int tf_insert(FTable *ft, int key, int par, const char *info);
 
 /*
- * Пометить busy=0 для записи с данным key и всех её потомков.
+ * Пометить busy=0 для записи с данным key и всех её потомков;
+ * место их info становится свободным.
  * Возвращает TMF_OK или код ошибки.
  */
 int tf_remove(FTable *ft, int key);
 
+/*
+ * Пакетная вставка n элементов rows. Пакет проверяется целиком
+ * (родитель может быть ниже в том же пакете, см. batch.h),
+ * все info дописываются в файл одной записью с одним fflush.
+ * errs (может быть NULL) — код TMF_* для каждого элемента.
+ * Возвращает число вставленных элементов.
+ */
+int tf_insert_batch(FTable *ft, const BatchRow *rows, int n, int *errs);
+
+/*
+ * Пакетное удаление n ключей keys вместе с потомками.
+ * errs (может быть NULL) — TMF_OK или TMF_ERR_NOT_FOUND для каждого ключа;
+ * ключ, удалённый вместе с предком из того же пакета, считается найденным.
+ * Возвращает число найденных ключей.
+ */
+int tf_remove_batch(FTable *ft, const int *keys, int n, int *errs);
+
 /*
  * Найти все FItem с par == заданному.
  * out_count — по адресу вернуть число найденных записей.
  * Возвращает динамический массив FItem* или NULL, если ничего не найдено.
+ * Обёртка над tf_search_fill; для чтения вместе с info см. tf_cursor_open.
  */
 FItem *tf_search(FTable *ft, int par, int *out_count);
 
+/*
+ * Строка результата поиска. info указывает во внутренний буфер курсора
+ * (в режиме mmap — в отображение файла) и действительна до следующего
+ * вызова tf_cursor_next / tf_cursor_close.
+ */
+typedef struct {
+    int         key;    // ключ элемента
+    int         par;    // ключ родителя
+    const char *info;   // содержимое info ('\0' в конце)
+    int         length; // длина info в байтах
+} TfRow;
+
+#define TF_CURSOR_WINDOW 64 // строк курсора на одно пакетное чтение
+
+/*
+ * Курсор поиска по ключу родителя. Info читаются окнами по
+ * TF_CURSOR_WINDOW строк одним пакетным чтением (см. bulkread.h);
+ * буфер один на весь обход и только растёт.
+ */
+typedef struct {
+    FTable  *ft;
+    int      par;    // ключ родителя
+    int      total;  // общее число найденных записей
+    int      slot;   // первый слот списка потомков, ещё не попавший в окно
+                     // (в страничном формате 0), или -1 — строк больше нет
+    int      err;    // TMF_OK или код ошибки чтения, прервавшей обход
+    FItem    win[TF_CURSOR_WINDOW]; // записи текущего окна
+    const char *info[TF_CURSOR_WINDOW]; // info слотов окна (буфер, кэш или отображение)
+    int      nwin;   // число слотов в окне
+    int      iwin;   // следующая строка окна
+    BulkRead br;     // буфер info окна
+    BtIter   it;     // позиция в дереве (par, key) в страничном формате
+} TfCursor;
+
+/*
+ * Обработчик строки для tf_search_each; ненулевой результат прекращает обход.
+ * В параллельном режиме вызывается под блокировкой на чтение, поэтому
+ * изменять таблицу из обработчика нельзя.
+ */
+typedef int (*TfRowFn)(const TfRow *row, void *ctx);
+
+/*
+ * Блокировка на чтение в параллельном режиме: владелец курсора держит
+ * её от tf_cursor_open до tf_cursor_close (без concurrent — ничего не делают).
+ */
+void tf_read_lock(FTable *ft);
+void tf_read_unlock(FTable *ft);
+
+/*
+ * Начать обход записей с ключом родителя par.
+ * Таблицу нельзя изменять, пока курсор используется.
+ */
+void tf_cursor_open(TfCursor *c, FTable *ft, int par);
+
+/*
+ * Получить следующую строку (с прочитанным info).
+ * Возвращает 1 или 0, если строк больше нет или произошла ошибка (см. c->err).
+ */
+int tf_cursor_next(TfCursor *c, TfRow *row);
+
+/*
+ * Освободить буфер курсора.
+ */
+void tf_cursor_close(TfCursor *c);
+
+/*
+ * Вызвать fn для каждой записи с ключом родителя par.
+ * Возвращает число обработанных строк.
+ */
+int tf_search_each(FTable *ft, int par, TfRowFn fn, void *ctx);
+
+/*
+ * Записать в out metadata не более cap найденных записей.
+ * Возвращает общее число найденных записей (может быть > cap).
+ */
+int tf_search_fill(FTable *ft, int par, FItem *out, int cap);
+
+/*
+ * Прочитать info записи r в буфер buf размера size (с '\0' в конце;
+ * при нехватке места строка обрезается). r может быть копией из
+ * tf_search_fill: если запись с тех пор удалена или заменена, info
+ * не читается.
+ * Возвращает TMF_OK, TMF_ERR_NOT_FOUND (копия устарела) или TMF_ERR_READ.
+ */
+int tf_read_info(FTable *ft, const FItem *r, char *buf, int size);
+
+/*
+ * Вызвать fn для каждого потомка key (всех уровней, без самого key)
+ * в прямом порядке обхода: за записью идёт её поддерево. Info читаются
+ * пакетами по TF_BULK_WINDOW записей мимо кэша. В форматах со слотами
+ * поддерево обходится по спискам потомков (время пропорционально числу
+ * потомков), братья идут в порядке вставки; в страничном — потомки
+ * каждой записи берутся из дерева (par, key) по возрастанию ключей.
+ * key = 0 — все записи таблицы (каждый родитель раньше потомков).
+ * Ненулевой результат fn прекращает обход.
+ * Возвращает TMF_OK, TMF_ERR_NOT_FOUND или TMF_ERR_READ.
+ */
+int tf_descendants(FTable *ft, int key, TfRowFn fn, void *ctx);
+
+/*
+ * Записать в keys не более cap ключей предков key: родитель, его
+ * родитель и так далее до корня. Возвращает число предков (глубину key,
+ * может быть > cap) или -1, если ключа нет или произошла ошибка чтения.
+ */
+int tf_ancestors(FTable *ft, int key, int *keys, int cap);
+
+/*
+ * 1, если anc — предок key (родитель, его родитель, ...), 0 — нет,
+ * -1 — одного из ключей нет или ошибка чтения. В форматах со слотами
+ * проверка идёт по прыжкам к предкам (tree_jump.h) за O(log n); их
+ * разметка строится в памяти при первом запросе об иерархии (за O(n))
+ * и дальше поддерживается вставками. В страничном формате записи не
+ * держатся в памяти, и проверка поднимается от key по родителям:
+ * O(глубина) поисков в дереве ключей.
+ */
+int tf_is_ancestor(FTable *ft, int anc, int key);
+
+/*
+ * Вторичный индекс по info (on = 1 — построить, 0 — удалить), см.
+ * info_index.h. Индекс не хранится в файле: он строится в памяти одним
+ * пакетным чтением всех info (после каждого открытия заново) и дальше
+ * поддерживается вставками и удалениями. Если на него не хватает
+ * памяти, вставка не выполняется (TMF_ERR_WRITE).
+ * Возвращает TMF_OK или TMF_ERR_READ (ошибка чтения, нехватка памяти).
+ */
+int tf_set_info_index(FTable *ft, int on);
+
+/*
+ * Вызвать fn для каждой записи, info которой начинается с prefix.
+ * С индексом — по возрастанию info (равные — по ключу), и info файла
+ * не читаются; без индекса — полным сканированием (как tf_print).
+ * Ненулевой результат fn прекращает обход.
+ * Возвращает TMF_OK, TMF_ERR_INVALID (prefix == NULL) или TMF_ERR_READ.
+ */
+int tf_find_prefix(FTable *ft, const char *prefix, TfRowFn fn, void *ctx);
+
+/*
+ * Вызвать fn для каждой записи, info которой содержит s. С индексом
+ * проверяются только записи из самого короткого списка триграмм s
+ * (для s короче 3 байт — все записи индекса) в порядке их добавления
+ * в индекс; без индекса — полным сканированием.
+ * Возвращает TMF_OK, TMF_ERR_INVALID (s == NULL) или TMF_ERR_READ.
+ */
+int tf_find_substr(FTable *ft, const char *s, TfRowFn fn, void *ctx);
+
+/*
+ * Вызвать fn для каждой записи с ключом из [lo, hi] по возрастанию
+ * ключей; info читаются пакетами по TF_BULK_WINDOW записей мимо кэша.
+ * В форматах со слотами порядок даёт упорядоченный индекс в памяти
+ * (ord_index.h): он строится при первом таком запросе (за O(n log n))
+ * и дальше поддерживается вставками и удалениями. В страничном формате
+ * диапазон читается прямо из дерева ключей.
+ * Ненулевой результат fn прекращает обход.
+ * Возвращает TMF_OK или TMF_ERR_READ.
+ */
+int tf_range(FTable *ft, int lo, int hi, TfRowFn fn, void *ctx);
+
+/*
+ * Запись с наименьшим (tf_min) или наибольшим (tf_max) ключом в out.
+ * Возвращает TMF_OK, TMF_ERR_NOT_FOUND (таблица пуста) или TMF_ERR_READ.
+ */
+int tf_min(FTable *ft, FItem *out);
+int tf_max(FTable *ft, FItem *out);
+
+/*
+ * Статистика кэша info: попадания, промахи и занятые байты
+ * (любой указатель может быть NULL). Кэш используют курсоры
+ * (а значит, tf_search_each) и tf_read_info; полные обходы
+ * (tf_print, tf_export_dot, tf_compact) идут мимо кэша.
+ */
+void tf_cache_stats(const FTable *ft, long *hits, long *misses, size_t *bytes);
+
 /*
  * Вывести в stdout все busy=1 записи:
  * для каждой — metadata и содержимое info.
+ * Info читаются пакетами (отсортированы по смещению и объединены).
  */
 void tf_print(FTable *ft);
 
+/*
+ * То же, что tf_print, по возрастанию ключей (см. tf_range).
+ */
+void tf_print_sorted(FTable *ft);
+
+// Порядок info после уплотнения (tf_compact)
+#define TF_COMPACT_SLOT   0 // по номерам слотов
+#define TF_COMPACT_PARENT 1 // по родителям: потомки каждого узла подряд
+#define TF_COMPACT_DFS    2 // обход в глубину: каждое поддерево подряд
+
+/*
+ * Уплотнить файл: переписать живые info подряд (без удалённых данных
+ * и свободных участков) в порядке order (TF_COMPACT_*), чтобы результат
+ * tf_search или поддерево читались одним последовательным чтением.
+ * Новый файл пишется рядом (<filename>.tmp) и атомарно заменяет старый
+ * через rename, поэтому сбой во время уплотнения старый файл не портит.
+ * Таблица переоткрывается с теми же параметрами.
+ * Для страничного формата не поддерживается (TMF_ERR_INVALID).
+ * reclaimed (может быть NULL) — сколько байт свободного места
+ * (удалённые info, старые блоки metadata) не попало в новый файл.
+ * Возвращает TMF_OK или код ошибки.
+ */
+int tf_compact(FTable *ft, int order, long *reclaimed);
+
 /*
  * Преобразует код ошибки файловой таблицы в человекочитаемую строку.
  */
@@ -71,4 +429,30 @@ const char *tf_errstr(int code);
 
 void tf_export_dot(const FTable *ft, const char *filename);
 
+/*
+ * Экспорт в Graphviz DOT в открытый файл f (в том числе в канал popen:
+ * вывод идёт через буфер OB_CAP байт и сбрасывается по мере заполнения).
+ * flt (может быть NULL) ограничивает вывод поддеревом flt->root, глубиной
+ * и числом узлов; с ограничениями записи выводятся по уровням от корня,
+ * а их info читаются пакетами по мере обхода, без них — по возрастанию
+ * ключей (flt->sorted, см. tf_range) или как tf_export_dot.
+ * Возвращает TMF_OK, TMF_ERR_NOT_FOUND (нет ключа flt->root),
+ * TMF_ERR_READ или TMF_ERR_WRITE.
+ */
+int tf_export_dot_ex(const FTable *ft, FILE *f, const DotFilter *flt);
+
+/*
+ * Статистика таблицы с момента открытия или tf_stats_reset: просмотренные
+ * записи, вызовы fseek и чтения/записи (вместе со страницами B+деревьев
+ * и группами журнала), прочитанные и записанные байты, выделения памяти
+ * и задержки операций. Возвращает TMF_OK или TMF_ERR_INVALID (сборка
+ * без TABLE_STATS, out обнулён).
+ */
+int tf_stats(FTable *ft, TableStats *out);
+
+/*
+ * Обнуление статистики.
+ */
+void tf_stats_reset(FTable *ft);
+
 #endif // TABLE_FILE_H
@@ -1,115 +1,1084 @@
+#define _GNU_SOURCE // pthread_rwlockattr_setkind_np
 #include "table_mem.h"
+#include "scan.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
-#include <stdio.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+
+#define TM_MIN_CAPACITY SCAN_BLOCK
+// Если у родителя больше capacity / TM_SCAN_RATIO потомков, сплошное
+// сканирование столбца pars дешевле обхода списка по случайным адресам
+#define TM_SCAN_RATIO   16
+
+#define WORDS(t) ((t)->capacity / SCAN_BLOCK)
+
+// Параллельные обходы включаются только в таблицах от TM_PAR_MIN слотов;
+// вывод идёт раундами: каждый поток форматирует часть из TM_PAR_CHUNK слотов
+#define TM_PAR_MIN   (1 << 16)
+#define TM_PAR_CHUNK (1 << 16)
+
+// Счётчик статистики таблицы t (см. stats.h)
+#define STAT(t, field, n) ST_ADD(&(t)->stats, field, n)
+
+
+static void set_busy(Table *t, int i, int on) {
+    uint64_t bit = (uint64_t)1 << (i % SCAN_BLOCK);
+    if (on) t->busy[i / SCAN_BLOCK] |= bit;
+    else    t->busy[i / SCAN_BLOCK] &= ~bit;
+}
+
+
+// Следующий занятый слот начиная с from (или -1)
+static int next_busy(const Table *t, int from) {
+    return scan_next_busy(t->busy, WORDS(t), from);
+}
+
+
+// Строка info элемента: из самого Item или из арены
+static const char *item_info(const Item *it) {
+    return it->len < TM_SSO_LEN ? it->info.buf : it->info.ptr;
+}
+
+
+// Копирует строку в элемент; длинные строки размещаются в арене
+static int set_info(Table *t, Item *it, const char *info) {
+    size_t len = strlen(info);
+    char *dst = it->info.buf;
+    if (len >= TM_SSO_LEN) {
+        dst = arena_alloc(&t->arena, len + 1);
+        if (!dst) return TM_ERR_FULL;
+        it->info.ptr = dst;
+    }
+    memcpy(dst, info, len + 1);
+    it->len = (int)len;
+    return TM_OK;
+}
+
+
+static void release_info(Table *t, Item *it) {
+    if (it->len >= TM_SSO_LEN)
+        arena_release(&t->arena, it->info.ptr, (size_t)it->len + 1);
+    it->len = 0;
+}
+
+
+// Добавляет слоты [from, to) в список свободных так,
+// чтобы первыми выдавались слоты с меньшими номерами
+static void push_free_range(Table *t, int from, int to) {
+    for (int i = to - 1; i >= from; i--)
+        link_push_free(t->links, &t->free_head, i);
+}
 
 
+// Перевыделение всех столбцов под cap слотов (cap кратно 64)
+static int resize(Table *t, int cap) {
+    int *keys = realloc(t->keys, cap * sizeof(int));
+    if (!keys) return TM_ERR_FULL;
+    t->keys = keys;
+    int *pars = realloc(t->pars, cap * sizeof(int));
+    if (!pars) return TM_ERR_FULL;
+    t->pars = pars;
+    uint64_t *busy = realloc(t->busy, cap / SCAN_BLOCK * sizeof(uint64_t));
+    if (!busy) return TM_ERR_FULL;
+    t->busy = busy;
+    Item *items = realloc(t->items, cap * sizeof(Item));
+    if (!items) return TM_ERR_FULL;
+    t->items = items;
+    Link *links = realloc(t->links, cap * sizeof(Link));
+    if (!links) return TM_ERR_FULL;
+    t->links = links;
+    if (jump_resize(&t->jumps, cap) != 0) return TM_ERR_FULL;
+    int old = t->capacity;
+    memset(t->keys + old, 0, (cap - old) * sizeof(int));
+    memset(t->pars + old, 0, (cap - old) * sizeof(int));
+    memset(t->busy + old / SCAN_BLOCK, 0, (cap - old) / SCAN_BLOCK * sizeof(uint64_t));
+    memset(t->items + old, 0, (cap - old) * sizeof(Item));
+    push_free_range(t, old, cap);
+    t->capacity = cap;
+    STAT(t, allocs, 8); // по одному realloc на столбец
+    return TM_OK;
+}
+
+
+// Писатель не должен ждать, пока читатели не кончатся: в glibc ожидающий
+// писатель пропускается вперёд новых читателей
+static void init_lock(pthread_rwlock_t *lock) {
+    pthread_rwlockattr_t attr;
+    pthread_rwlockattr_init(&attr);
+#ifdef __GLIBC__
+    pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+    pthread_rwlock_init(lock, &attr);
+    pthread_rwlockattr_destroy(&attr);
+}
+
 
 void tm_init(Table *t, int SIZE) {
-    t->items    = calloc(SIZE, sizeof(Item));
-    t->capacity = SIZE;
-    t->count    = 0;
+    if (SIZE < TM_MIN_CAPACITY) SIZE = TM_MIN_CAPACITY;
+    SIZE = (SIZE + SCAN_BLOCK - 1) / SCAN_BLOCK * SCAN_BLOCK;
+    t->keys      = NULL;
+    t->pars      = NULL;
+    t->busy      = NULL;
+    t->items     = NULL;
+    t->links     = NULL;
+    t->capacity  = 0;
+    t->count     = 0;
+    t->free_head = -1;
+    link_reset(&t->roots, 0);
+    jump_init(&t->jumps);
+    t->info_idx  = NULL;
+    arena_init(&t->arena);
+    init_lock(&t->lock);
+    t->concurrent = 0;
+    t->pool      = NULL;
+#ifdef TABLE_STATS
+    memset(&t->stats, 0, sizeof(t->stats));
+#endif
+    resize(t, SIZE);
+    hi_init(&t->idx, SIZE);
+    oi_init(&t->order);
+    t->order_ok  = 0;
+    pthread_mutex_init(&t->order_lock, NULL);
+}
+
+
+void tm_set_concurrent(Table *t, int on) {
+    t->concurrent = on;
+}
+
+
+int tm_set_threads(Table *t, int n) {
+    pool_free(t->pool);
+    t->pool = NULL;
+    if (n == 1) return TM_OK;
+    t->pool = pool_create(n);
+    if (!t->pool) return TM_ERR_FULL;
+    if (pool_size(t->pool) == 1) {
+        // одного потока достаточно и без пула
+        pool_free(t->pool);
+        t->pool = NULL;
+    }
+    return TM_OK;
+}
+
+
+static int parallel(const Table *t) {
+    return t->pool && t->capacity >= TM_PAR_MIN;
+}
+
+
+// Первое слово битовой карты части part из parts
+static int part_word(const Table *t, int part, int parts) {
+    return (int)((long)WORDS(t) * part / parts);
+}
+
+
+// Блокировки параллельного режима; lock меняется и у константной таблицы
+static void rd_lock(const Table *t) {
+    if (t->concurrent) pthread_rwlock_rdlock((pthread_rwlock_t *)&t->lock);
+}
+
+
+static void wr_lock(Table *t) {
+    if (t->concurrent) pthread_rwlock_wrlock(&t->lock);
+}
+
+
+static void unlock(const Table *t) {
+    if (t->concurrent) pthread_rwlock_unlock((pthread_rwlock_t *)&t->lock);
+}
+
+
+void tm_read_lock(const Table *t) {
+    rd_lock(t);
+}
+
+
+void tm_read_unlock(const Table *t) {
+    unlock(t);
+}
+
+
+// Геометрическое расширение: удвоение числа слотов
+static int grow(Table *t) {
+    int cap = t->capacity > 0 ? t->capacity * 2 : TM_MIN_CAPACITY;
+    return resize(t, cap);
+}
+
+
+// Link родителя par (голова списка его потомков) или NULL, если par нет
+static Link *children_head(Table *t, int par) {
+    if (par == 0) return &t->roots;
+    int p = hi_find(&t->idx, par);
+    return p >= 0 ? &t->links[p] : NULL;
+}
+
+
+static const Link *children_of(const Table *t, int par) {
+    if (par == 0) return &t->roots;
+    int p = hi_find(&t->idx, par);
+    return p >= 0 ? &t->links[p] : NULL;
+}
+
+
+// Размещение проверенного элемента в первом свободном слоте.
+// Родитель par должен существовать, свободный слот — быть в списке
+static int place(Table *t, int key, int par, const char *info) {
+    Link *head = children_head(t, par);
+    int i = t->free_head;
+    if (t->info_idx && ii_add(t->info_idx, key, info) != 0) return TM_ERR_FULL;
+    if (set_info(t, &t->items[i], info) != TM_OK) {
+        if (t->info_idx) ii_del(t->info_idx, key);
+        return TM_ERR_FULL;
+    }
+    if (hi_put(&t->idx, key, i) != 0) {
+        if (t->info_idx) ii_del(t->info_idx, key);
+        release_info(t, &t->items[i]);
+        return TM_ERR_FULL;
+    }
+    // вставка в первую свободную ячейку из списка
+    link_pop_free(t->links, &t->free_head);
+    set_busy(t, i, 1);
+    t->keys[i] = key;
+    t->pars[i] = par;
+    link_reset(t->links, i);
+    link_attach(t->links, head, i);
+    jump_attach(&t->jumps, i, head == &t->roots ? -1 : (int)(head - t->links));
+    if (t->order_ok && oi_put(&t->order, key, i) != 0) {
+        // без памяти упорядоченный индекс строится заново следующим запросом
+        oi_free(&t->order);
+        t->order_ok = 0;
+    }
+    t->count++;
+    return TM_OK;
+}
+
+
+static int insert(Table *t, int key, int par, const char *info) {
+    // проверка уникальности ключа
+    if (hi_find(&t->idx, key) >= 0) return TM_ERR_EXISTS;
+    // проверка валидности родителя
+    if (!children_head(t, par)) return TM_ERR_INVALID;
+    if (t->free_head < 0 && grow(t) != TM_OK) return TM_ERR_FULL;
+    return place(t, key, par, info);
 }
 
 
 int tm_insert(Table *t, int key, int par, const char *info) {
     if (key <= 0 || info == NULL) return TM_ERR_INVALID;
-    if (t->count >= t->capacity) return TM_ERR_FULL;
-    // проверка уникальности ключа
-    for (int i = 0; i < t->capacity; i++) {
-        if (t->items[i].busy && t->items[i].key == key)
-            return TM_ERR_EXISTS;
+    ST_BEGIN(t0);
+    wr_lock(t);
+    int res = insert(t, key, par, info);
+    unlock(t);
+    ST_END(&t->stats, ST_INSERT, t0);
+    return res;
+}
+
+
+static int key_exists(void *ctx, int key) {
+    return hi_find(&((Table *)ctx)->idx, key) >= 0;
+}
+
+
+static int batch_err(int code) {
+    switch (code) {
+        case BATCH_OK:     return TM_OK;
+        case BATCH_EXISTS: return TM_ERR_EXISTS;
+        default:           return TM_ERR_INVALID;
     }
-    // проверка валидности родителя
-    if (par != 0) {
-        int found = 0;
-        for (int i = 0; i < t->capacity; i++) {
-            if (t->items[i].busy && t->items[i].key == par) {
-                found = 1;
-                break;
-            }
-        }
-        if (!found) return TM_ERR_INVALID;
+}
+
+
+int tm_insert_batch(Table *t, const BatchRow *rows, int n, int *errs) {
+    if (n <= 0) return 0;
+    int *order = malloc(n * sizeof(int));
+    int *codes = errs ? errs : malloc(n * sizeof(int));
+    if (!order || !codes) {
+        free(order);
+        if (codes != errs) free(codes);
+        return 0;
+    }
+    wr_lock(t);
+    STAT(t, allocs, errs ? 1 : 2);
+    int m = batch_order(rows, n, key_exists, t, order, codes);
+    for (int i = 0; i < n; i++) codes[i] = m < 0 ? TM_ERR_FULL : batch_err(codes[i]);
+    // место под весь пакет выделяется заранее, а не по одному слоту
+    while (m > 0 && t->capacity - t->count < m) {
+        if (grow(t) != TM_OK) break;
     }
-    // вставка в первую свободную ячейку
-    for (int i = 0; i < t->capacity; i++) {
-        if (!t->items[i].busy) {
-            t->items[i].busy = 1;
-            t->items[i].key  = key;
-            t->items[i].par  = par;
-            t->items[i].info = strdup(info);
-            t->count++;
-            return TM_OK;
+    int done = 0;
+    for (int q = 0; q < m; q++) {
+        const BatchRow *r = &rows[order[q]];
+        int res = TM_ERR_FULL;
+        // родитель мог не вставиться из-за нехватки памяти
+        if (!children_head(t, r->par)) res = TM_ERR_INVALID;
+        else if (t->free_head >= 0 || grow(t) == TM_OK) res = place(t, r->key, r->par, r->info);
+        codes[order[q]] = res;
+        if (res == TM_OK) done++;
+    }
+    unlock(t);
+    free(order);
+    if (codes != errs) free(codes);
+    return done;
+}
+
+
+// Освобождение слота удаляемого поддерева
+static void drop_slot(Table *t, int s) {
+    STAT(t, slots, 1);
+    hi_del(&t->idx, t->keys[s]);
+    if (t->order_ok) oi_del(&t->order, t->keys[s]);
+    if (t->info_idx) ii_del(t->info_idx, t->keys[s]);
+    release_info(t, &t->items[s]);
+    set_busy(t, s, 0);
+    t->count--;
+    link_push_free(t->links, &t->free_head, s);
+}
+
+
+// Поиск потомков фронта сканированием части столбца родителей:
+// слот попадает в следующий фронт, если ключ его родителя есть во фронте
+typedef struct {
+    const Table     *t;
+    const HashIndex *front; // ключи слотов фронта
+    uint64_t        *next;  // битовая карта следующего фронта
+    int              parts;
+} LevelJob;
+
+
+static void level_part(void *ctx, int part) {
+    LevelJob *j = ctx;
+    const Table *t = j->t;
+    int end = part_word(t, part + 1, j->parts);
+    STAT(t, slots, (long)(end - part_word(t, part, j->parts)) * SCAN_BLOCK);
+    for (int w = part_word(t, part, j->parts); w < end; w++) {
+        uint64_t m = t->busy[w], hit = 0;
+        while (m) {
+            int i = w * SCAN_BLOCK + scan_ctz(m);
+            if (t->pars[i] != 0 && hi_find(j->front, t->pars[i]) >= 0)
+                hit |= (uint64_t)1 << (i % SCAN_BLOCK);
+            m &= m - 1;
         }
+        j->next[w] = hit; // каждая часть пишет только свои слова
+    }
+}
+
+
+// Список слотов удаляемого поддерева
+typedef struct {
+    int *slot;
+    int  len;
+    int  cap;
+} SlotList;
+
+
+static int push_slot(SlotList *l, int s) {
+    if (l->len == l->cap) {
+        int *p = realloc(l->slot, (size_t)l->cap * 2 * sizeof(int));
+        if (!p) return -1;
+        l->slot = p;
+        l->cap *= 2;
     }
-    return TM_ERR_FULL;
+    l->slot[l->len++] = s;
+    return 0;
 }
 
 
-static void remove_rec(Table *t, int key) {
-    for (int i = 0; i < t->capacity; i++) {
-        if (t->items[i].busy && t->items[i].par == key) {
-            int child = t->items[i].key;
-            remove_rec(t, child);
-            free(t->items[i].info);
-            t->items[i].busy = 0;
-            t->count--;
+// Добавляет в список потомков фронта l->slot[from..end).
+// Широкий фронт ищется параллельно, узкий — по спискам потомков.
+// Возвращает 0 или -1 при нехватке памяти
+static int next_level(Table *t, SlotList *l, int from, int end, uint64_t *bits) {
+    if ((long)(end - from) * TM_SCAN_RATIO < t->capacity) {
+        for (int q = from; q < end; q++) {
+            for (int c = t->links[l->slot[q]].child; c >= 0; c = t->links[c].next)
+                if (push_slot(l, c) != 0) return -1;
+        }
+        return 0;
+    }
+    HashIndex front;
+    if (hi_init(&front, end - from) != 0) return -1;
+    for (int q = from; q < end; q++) {
+        if (hi_put(&front, t->keys[l->slot[q]], l->slot[q]) != 0) {
+            hi_free(&front);
+            return -1;
         }
     }
+    LevelJob j = { t, &front, bits, pool_size(t->pool) * 4 };
+    pool_run(t->pool, level_part, &j, j.parts);
+    hi_free(&front);
+    // слоты следующего фронта — по возрастанию номеров
+    for (int w = 0; w < WORDS(t); w++) {
+        for (uint64_t m = bits[w]; m; m &= m - 1)
+            if (push_slot(l, w * SCAN_BLOCK + scan_ctz(m)) != 0) return -1;
+    }
+    return 0;
+}
+
+
+// Удаление поддерева слота root по уровням: сначала собираются все слоты
+// поддерева (каждый уровень — потомки предыдущего), затем они освобождаются.
+// Возвращает 0 или -1 при нехватке памяти (таблица не изменена)
+static int remove_levels(Table *t, int root) {
+    SlotList l = { malloc(1024 * sizeof(int)), 1, 1024 };
+    uint64_t *bits = malloc(WORDS(t) * sizeof(uint64_t));
+    int res = l.slot && bits ? 0 : -1;
+    STAT(t, allocs, 2);
+    if (res == 0) l.slot[0] = root;
+    // l.slot[from..end) — текущий фронт, за ним дописывается следующий
+    for (int from = 0; res == 0 && from < l.len; ) {
+        int end = l.len;
+        res = next_level(t, &l, from, end, bits);
+        from = end;
+    }
+    if (res == 0) {
+        link_detach(t->links, children_head(t, t->pars[root]), root);
+        for (int q = 0; q < l.len; q++) drop_slot(t, l.slot[q]);
+    }
+    free(l.slot);
+    free(bits);
+    return res;
+}
+
+
+static int remove_key(Table *t, int key) {
+    int i = hi_find(&t->idx, key);
+    if (i < 0) return TM_ERR_NOT_FOUND;
+    if (parallel(t) && remove_levels(t, i) == 0) return TM_OK;
+    // отцепляем поддерево от родителя и удаляем его обходом без рекурсии
+    link_detach(t->links, children_head(t, t->pars[i]), i);
+    int work = i;
+    int s;
+    while ((s = link_pop_subtree(t->links, &work)) >= 0) drop_slot(t, s);
+    return TM_OK;
 }
 
 
 int tm_remove(Table *t, int key) {
-    for (int i = 0; i < t->capacity; i++) {
-        if (t->items[i].busy && t->items[i].key == key) {
-            remove_rec(t, key);
-            free(t->items[i].info);
-            t->items[i].busy = 0;
-            t->count--;
-            return TM_OK;
+    ST_BEGIN(t0);
+    wr_lock(t);
+    int res = remove_key(t, key);
+    unlock(t);
+    ST_END(&t->stats, ST_REMOVE, t0);
+    return res;
+}
+
+
+int tm_remove_batch(Table *t, const int *keys, int n, int *errs) {
+    int done = 0;
+    wr_lock(t);
+    // сначала проверяем весь пакет, чтобы отличить отсутствующие ключи
+    // от удалённых вместе с предком из этого же пакета
+    for (int i = 0; i < n; i++) {
+        int res = hi_find(&t->idx, keys[i]) >= 0 ? TM_OK : TM_ERR_NOT_FOUND;
+        if (errs) errs[i] = res;
+        if (res == TM_OK) done++;
+    }
+    for (int i = 0; i < n; i++) {
+        if (hi_find(&t->idx, keys[i]) >= 0) remove_key(t, keys[i]);
+    }
+    unlock(t);
+    return done;
+}
+
+
+void tm_cursor_open(TmCursor *c, const Table *t, int par) {
+    const Link *head = children_of(t, par);
+    c->t     = t;
+    c->par   = par;
+    c->total = head ? head->count : 0;
+    c->slot  = head ? head->child : -1;
+    c->word  = -1;
+    c->mask  = 0;
+    // потомков много: выгоднее сканировать столбец родителей блоками по 64 слота
+    c->scan  = (long)c->total * TM_SCAN_RATIO >= t->capacity;
+}
+
+
+static void slot_row(const Table *t, int i, TmRow *row) {
+    row->key  = t->keys[i];
+    row->par  = t->pars[i];
+    row->info = item_info(&t->items[i]);
+}
+
+
+int tm_cursor_next(TmCursor *c, TmRow *row) {
+    const Table *t = c->t;
+    int i;
+    if (!c->scan) {
+        // потомков мало: обходим только их список
+        i = c->slot;
+        if (i < 0) return 0;
+        c->slot = t->links[i].next;
+        STAT(t, slots, 1);
+    } else {
+        while (!c->mask) {
+            if (++c->word >= WORDS(t)) return 0;
+            STAT(t, slots, SCAN_BLOCK);
+            if (t->busy[c->word])
+                c->mask = scan_eq64(t->pars, c->word * SCAN_BLOCK, c->par) & t->busy[c->word];
         }
+        i = c->word * SCAN_BLOCK + scan_ctz(c->mask);
+        c->mask &= c->mask - 1;
+    }
+    slot_row(t, i, row);
+    return 1;
+}
+
+
+// Параллельное сканирование столбца родителей: каждая часть собирает
+// совпадения своего диапазона слов в отдельный массив
+typedef struct {
+    const Table *t;
+    int   par;
+    int   parts;
+    int **slot;  // найденные слоты каждой части
+    int  *len;   // их число или -1 при нехватке памяти
+} MatchJob;
+
+
+static void match_part(void *ctx, int part) {
+    MatchJob *j = ctx;
+    const Table *t = j->t;
+    int end = part_word(t, part + 1, j->parts), n = 0, cap = 0;
+    int *out = NULL;
+    STAT(t, slots, (long)(end - part_word(t, part, j->parts)) * SCAN_BLOCK);
+    for (int w = part_word(t, part, j->parts); w < end; w++) {
+        if (!t->busy[w]) continue;
+        for (uint64_t m = scan_eq64(t->pars, w * SCAN_BLOCK, j->par) & t->busy[w];
+             m; m &= m - 1) {
+            if (n == cap) {
+                int *p = realloc(out, (size_t)(cap ? cap * 2 : 256) * sizeof(int));
+                if (!p) {
+                    free(out);
+                    j->slot[part] = NULL;
+                    j->len[part]  = -1;
+                    return;
+                }
+                out = p;
+                cap = cap ? cap * 2 : 256;
+                STAT(t, allocs, 1);
+            }
+            out[n++] = w * SCAN_BLOCK + scan_ctz(m);
+        }
+    }
+    j->slot[part] = out;
+    j->len[part]  = n;
+}
+
+
+// Слоты total элементов с родителем par по возрастанию номеров
+// или NULL при нехватке памяти
+static int *match_slots(const Table *t, int par, int total) {
+    int parts = pool_size(t->pool) * 4;
+    int *res = malloc((total > 0 ? total : 1) * sizeof(int));
+    int **slot = calloc(parts, sizeof(int *));
+    int *len = calloc(parts, sizeof(int));
+    int ok = res && slot && len;
+    STAT(t, allocs, 3);
+    if (ok) {
+        MatchJob j = { t, par, parts, slot, len };
+        pool_run(t->pool, match_part, &j, parts);
+        int n = 0;
+        for (int p = 0; p < parts; p++) {
+            if (len[p] < 0) ok = 0;
+            else if (ok) {
+                memcpy(res + n, slot[p], len[p] * sizeof(int));
+                n += len[p];
+            }
+            free(slot[p]);
+        }
+    }
+    free(slot);
+    free(len);
+    if (!ok) {
+        free(res);
+        return NULL;
+    }
+    return res;
+}
+
+
+// Слоты найденных элементов для курсора c, если поиск выгодно
+// распараллелить; иначе NULL, и строки читаются курсором
+static int *cursor_slots(const TmCursor *c) {
+    return c->scan && parallel(c->t) ? match_slots(c->t, c->par, c->total) : NULL;
+}
+
+
+int tm_search_each(const Table *t, int par, TmRowFn fn, void *ctx) {
+    TmCursor c;
+    TmRow row;
+    int n = 0;
+    ST_BEGIN(t0);
+    rd_lock(t);
+    tm_cursor_open(&c, t, par);
+    int *m = cursor_slots(&c);
+    if (m) {
+        while (n < c.total) {
+            slot_row(t, m[n++], &row);
+            if (fn(&row, ctx)) break;
+        }
+        free(m);
+    } else {
+        while (tm_cursor_next(&c, &row)) {
+            n++;
+            if (fn(&row, ctx)) break;
+        }
+    }
+    unlock(t);
+    ST_END(&t->stats, ST_SEARCH, t0);
+    return n;
+}
+
+
+int tm_search_fill(const Table *t, int par, TmRow *rows, int cap) {
+    TmCursor c;
+    ST_BEGIN(t0);
+    rd_lock(t);
+    tm_cursor_open(&c, t, par);
+    int n = 0;
+    int *m = cap < c.total ? NULL : cursor_slots(&c);
+    if (m) {
+        for (; n < c.total; n++) slot_row(t, m[n], &rows[n]);
+        free(m);
+    } else {
+        while (n < cap && tm_cursor_next(&c, &rows[n])) n++;
     }
-    return TM_ERR_NOT_FOUND;
+    unlock(t);
+    ST_END(&t->stats, ST_SEARCH, t0);
+    return c.total;
+}
+
+
+// Добавление найденной строки в результат tm_search
+static void add_found(Table *res, const TmRow *row) {
+    int j = link_pop_free(res->links, &res->free_head);
+    set_busy(res, j, 1);
+    res->keys[j] = row->key;
+    res->pars[j] = row->par;
+    set_info(res, &res->items[j], row->info);
+    hi_put(&res->idx, row->key, j);
+    // родителя в результате нет, поэтому найденные элементы — корни
+    link_reset(res->links, j);
+    link_attach(res->links, &res->roots, j);
+    jump_attach(&res->jumps, j, -1);
+    res->count++;
 }
 
 
 Table* tm_search(const Table *t, int par) {
+    TmCursor c;
+    TmRow row;
+    ST_BEGIN(t0);
+    rd_lock(t);
+    tm_cursor_open(&c, t, par);
     Table *res = malloc(sizeof(Table));
-    res->capacity = t->capacity;
-    res->count    = 0;
-    res->items    = calloc(res->capacity, sizeof(Item));
-    for (int i = 0; i < t->capacity; i++) {
-        if (t->items[i].busy && t->items[i].par == par) {
-            res->items[res->count].busy = 1;
-            res->items[res->count].key  = t->items[i].key;
-            res->items[res->count].par  = par;
-            res->items[res->count].info = strdup(t->items[i].info);
-            res->count++;
+    STAT(t, allocs, 1);
+    tm_init(res, c.total);
+    int *m = cursor_slots(&c);
+    if (m) {
+        for (int q = 0; q < c.total; q++) {
+            slot_row(t, m[q], &row);
+            add_found(res, &row);
         }
+        free(m);
+    } else {
+        while (tm_cursor_next(&c, &row)) add_found(res, &row);
     }
+    unlock(t);
+    ST_END(&t->stats, ST_SEARCH, t0);
     return res;
 }
 
 
-void tm_print(const Table *t) {
-    printf("Table (count=%d):\n", t->count);
-    for (int i = 0; i < t->capacity; i++) {
-        if (t->items[i].busy) {
-            printf(" key=%d par=%d info='%s'\n",
-                   t->items[i].key, t->items[i].par,
-                   t->items[i].info);
+// Поддерево обходится по спискам потомков, подъём к следующему брату —
+// по слотам родителей из разметки прыжков
+int tm_descendants(const Table *t, int key, TmRowFn fn, void *ctx) {
+    TmRow row;
+    rd_lock(t);
+    // i = -1 — обход всего леса от первого корня
+    int i = key != 0 ? hi_find(&t->idx, key) : -1;
+    if (i < 0 && key != 0) {
+        unlock(t);
+        return TM_ERR_NOT_FOUND;
+    }
+    int first = i >= 0 ? jump_next(&t->jumps, t->links, i, i) : t->roots.child;
+    for (int s = first; s >= 0; s = jump_next(&t->jumps, t->links, i, s)) {
+        STAT(t, slots, 1);
+        slot_row(t, s, &row);
+        if (fn(&row, ctx)) break;
+    }
+    unlock(t);
+    return TM_OK;
+}
+
+
+int tm_ancestors(const Table *t, int key, int *keys, int cap) {
+    rd_lock(t);
+    int i = hi_find(&t->idx, key);
+    int n = i >= 0 ? t->jumps.depth[i] : -1;
+    // путь выписывается только до cap ключей
+    for (int q = 0, s = i; q < n && q < cap; q++) {
+        s = t->jumps.up[s];
+        keys[q] = t->keys[s];
+    }
+    unlock(t);
+    return n;
+}
+
+
+int tm_is_ancestor(const Table *t, int anc, int key) {
+    rd_lock(t);
+    int a = hi_find(&t->idx, anc);
+    int i = hi_find(&t->idx, key);
+    int res = a >= 0 && i >= 0 ? jump_is_ancestor(&t->jumps, a, i) : -1;
+    unlock(t);
+    return res;
+}
+
+
+typedef struct {
+    int key;
+    int slot;
+} KeySlot;
+
+
+static int cmp_key_slot(const void *a, const void *b) {
+    int x = ((const KeySlot *)a)->key, y = ((const KeySlot *)b)->key;
+    return (x > y) - (x < y);
+}
+
+
+// Построение упорядоченного индекса по занятым слотам: сортировка пар
+// "ключ, слот" и сборка дерева снизу вверх
+static int build_order(Table *t) {
+    int n = 0;
+    KeySlot *ks = malloc((size_t)(t->count + 1) * sizeof(KeySlot));
+    int *keys = malloc((size_t)(t->count + 1) * sizeof(int));
+    int *slots = malloc((size_t)(t->count + 1) * sizeof(int));
+    STAT(t, allocs, 3);
+    int res = ks && keys && slots ? TM_OK : TM_ERR_FULL;
+    for (int i = res == TM_OK ? next_busy(t, 0) : -1; i >= 0; i = next_busy(t, i + 1)) {
+        ks[n].key = t->keys[i];
+        ks[n++].slot = i;
+    }
+    STAT(t, slots, n);
+    if (res == TM_OK) {
+        qsort(ks, (size_t)n, sizeof(KeySlot), cmp_key_slot);
+        for (int q = 0; q < n; q++) {
+            keys[q] = ks[q].key;
+            slots[q] = ks[q].slot;
         }
+        if (oi_build(&t->order, keys, slots, n) != 0) res = TM_ERR_FULL;
     }
+    free(ks);
+    free(keys);
+    free(slots);
+    return res;
 }
 
 
-void tm_free(Table *t) {
-    for (int i = 0; i < t->capacity; i++) {
-        if (t->items[i].busy) free(t->items[i].info);
+// Упорядоченный индекс строится первым запросом по порядку ключей и дальше
+// поддерживается вставками и удалениями, так что таблица, которую так не
+// спрашивают, за него не платит. Читатели могут прийти сюда одновременно
+// (под блокировкой на чтение), поэтому построение идёт под order_lock
+static int need_order(const Table *t) {
+    if (__atomic_load_n(&t->order_ok, __ATOMIC_ACQUIRE)) return TM_OK;
+    Table *w = (Table *)t;
+    int res = TM_OK;
+    pthread_mutex_lock(&w->order_lock);
+    if (!w->order_ok) {
+        res = build_order(w);
+        if (res == TM_OK) __atomic_store_n(&w->order_ok, 1, __ATOMIC_RELEASE);
     }
+    pthread_mutex_unlock(&w->order_lock);
+    return res;
+}
+
+
+int tm_range(const Table *t, int lo, int hi, TmRowFn fn, void *ctx) {
+    OiIter it;
+    TmRow row;
+    int s;
+    ST_BEGIN(t0);
+    rd_lock(t);
+    int res = need_order(t);
+    if (res == TM_OK) oi_seek(&it, &t->order, lo, hi);
+    while (res == TM_OK && oi_next(&it, NULL, &s)) {
+        STAT(t, slots, 1);
+        slot_row(t, s, &row);
+        if (fn(&row, ctx)) break;
+    }
+    unlock(t);
+    ST_END(&t->stats, ST_SEARCH, t0);
+    return res;
+}
+
+
+// Крайний элемент упорядоченного индекса: last = 0 — наименьший ключ
+static int edge_row(const Table *t, int last, TmRow *row) {
+    int s, found = 0;
+    rd_lock(t);
+    int res = need_order(t);
+    if (res == TM_OK) found = last ? oi_max(&t->order, NULL, &s) : oi_min(&t->order, NULL, &s);
+    if (found) slot_row(t, s, row);
+    unlock(t);
+    if (res != TM_OK) return res;
+    return found ? TM_OK : TM_ERR_NOT_FOUND;
+}
+
+
+int tm_min(const Table *t, TmRow *row) {
+    return edge_row(t, 0, row);
+}
+
+
+int tm_max(const Table *t, TmRow *row) {
+    return edge_row(t, 1, row);
+}
+
+
+static void free_info_index(Table *t) {
+    if (!t->info_idx) return;
+    ii_free(t->info_idx);
+    free(t->info_idx);
+    t->info_idx = NULL;
+}
+
+
+int tm_set_info_index(Table *t, int on) {
+    int res = TM_OK;
+    wr_lock(t);
+    if (!on) {
+        free_info_index(t);
+    } else if (!t->info_idx) {
+        InfoIndex *ix = malloc(sizeof(InfoIndex));
+        STAT(t, allocs, 1);
+        if (!ix || ii_init(ix, t->count) != 0) res = TM_ERR_FULL;
+        for (int i = next_busy(t, 0); res == TM_OK && i >= 0; i = next_busy(t, i + 1)) {
+            STAT(t, slots, 1);
+            if (ii_append(ix, t->keys[i], item_info(&t->items[i])) != 0) res = TM_ERR_FULL;
+        }
+        // дерево префиксов строится одной сортировкой, а не вставками
+        if (res == TM_OK && ii_build(ix) != 0) res = TM_ERR_FULL;
+        if (res == TM_OK) {
+            t->info_idx = ix;
+        } else if (ix) {
+            ii_free(ix);
+            free(ix);
+        }
+    }
+    unlock(t);
+    return res;
+}
+
+
+// Передача найденного индексом ключа обработчику строк
+typedef struct {
+    const Table *t;
+    TmRowFn      fn;
+    void        *ctx;
+} FindCall;
+
+
+static int found_row(int key, const char *info, void *ctx) {
+    FindCall *fc = ctx;
+    TmRow row;
+    (void)info;
+    slot_row(fc->t, hi_find(&fc->t->idx, key), &row);
+    return fc->fn(&row, fc->ctx);
+}
+
+
+// Поиск по info: через индекс или сканированием занятых слотов
+static int find_info(const Table *t, const char *s, int prefix, TmRowFn fn, void *ctx) {
+    if (!s) return TM_ERR_INVALID;
+    ST_BEGIN(t0);
+    rd_lock(t);
+    if (t->info_idx) {
+        FindCall fc = { t, fn, ctx };
+        long seen = prefix ? ii_prefix(t->info_idx, s, found_row, &fc)
+                           : ii_substr(t->info_idx, s, found_row, &fc);
+        STAT(t, slots, seen);
+        (void)seen;
+    } else {
+        size_t n = strlen(s);
+        TmRow row;
+        for (int i = next_busy(t, 0); i >= 0; i = next_busy(t, i + 1)) {
+            STAT(t, slots, 1);
+            const char *info = item_info(&t->items[i]);
+            if (prefix ? strncmp(info, s, n) != 0 : !strstr(info, s)) continue;
+            slot_row(t, i, &row);
+            if (fn(&row, ctx)) break;
+        }
+    }
+    unlock(t);
+    ST_END(&t->stats, ST_SEARCH, t0);
+    return TM_OK;
+}
+
+
+int tm_find_prefix(const Table *t, const char *prefix, TmRowFn fn, void *ctx) {
+    return find_info(t, prefix, 1, fn, ctx);
+}
+
+
+int tm_find_substr(const Table *t, const char *s, TmRowFn fn, void *ctx) {
+    return find_info(t, s, 0, fn, ctx);
+}
+
+
+// Форматирование строки слота slot
+typedef void (*RowFmt)(OutBuf *o, const Table *t, int slot);
+
+
+// Вывод строк всех элементов в o по возрастанию ключей.
+// Возвращает TM_OK или TM_ERR_FULL (нет памяти на индекс)
+static int emit_sorted(const Table *t, OutBuf *o, RowFmt fmt) {
+    OiIter it;
+    int s;
+    if (need_order(t) != TM_OK) return TM_ERR_FULL;
+    oi_seek(&it, &t->order, INT_MIN, INT_MAX);
+    while (oi_next(&it, NULL, &s)) {
+        STAT(t, slots, 1);
+        fmt(o, t, s);
+    }
+    return TM_OK;
+}
+
+
+// Форматирование слотов [from, to) в o
+static void emit_range(OutBuf *o, const Table *t, RowFmt fmt, int from, int to) {
+    for (int i = next_busy(t, from); i >= 0 && i < to; i = next_busy(t, i + 1)) {
+        STAT(t, slots, 1);
+        fmt(o, t, i);
+    }
+}
+
+
+// Параллельное форматирование: часть part раунда форматирует
+// участок base + part слотов по TM_PAR_CHUNK в свой буфер
+typedef struct {
+    const Table *t;
+    RowFmt  fmt;
+    OutBuf *out;
+    int     base;
+} EmitJob;
+
+
+static void emit_part(void *ctx, int part) {
+    EmitJob *j = ctx;
+    long from = (long)(j->base + part) * TM_PAR_CHUNK;
+    j->out[part].len = 0;
+    j->out[part].err = 0;
+    if (from >= j->t->capacity) return;
+    long to = from + TM_PAR_CHUNK;
+    emit_range(&j->out[part], j->t, j->fmt, (int)from,
+               (int)(to < j->t->capacity ? to : j->t->capacity));
+}
+
+
+// Вывод строк всех занятых слотов в o в порядке номеров слотов.
+// Участки форматируются пулом раундами по pool_size и дописываются по порядку;
+// участок, которому не хватило буфера, форматируется повторно прямо в o
+static void emit_rows(const Table *t, OutBuf *o, RowFmt fmt) {
+    int parts = parallel(t) ? pool_size(t->pool) : 0;
+    OutBuf *out = parts ? calloc(parts, sizeof(OutBuf)) : NULL;
+    if (out) STAT(t, allocs, 1);
+    if (!out) {
+        emit_range(o, t, fmt, 0, t->capacity);
+        return;
+    }
+    int chunks = (t->capacity + TM_PAR_CHUNK - 1) / TM_PAR_CHUNK;
+    for (int base = 0; base < chunks; base += parts) {
+        EmitJob j = { t, fmt, out, base };
+        pool_run(t->pool, emit_part, &j, parts);
+        for (int p = 0; p < parts && base + p < chunks; p++) {
+            if (!out[p].err) {
+                ob_str(o, out[p].buf, out[p].len);
+                continue;
+            }
+            long to = (long)(base + p + 1) * TM_PAR_CHUNK;
+            emit_range(o, t, fmt, (base + p) * TM_PAR_CHUNK,
+                       (int)(to < t->capacity ? to : t->capacity));
+        }
+    }
+    for (int p = 0; p < parts; p++) ob_free(&out[p]);
+    free(out);
+}
+
+
+static void print_row(OutBuf *o, const Table *t, int i) {
+    ob_cstr(o, " key=");
+    ob_int(o, t->keys[i]);
+    ob_cstr(o, " par=");
+    ob_int(o, t->pars[i]);
+    ob_cstr(o, " info='");
+    ob_cstr(o, item_info(&t->items[i]));
+    ob_cstr(o, "'\n");
+}
+
+
+// Вывод таблицы в stdout: sorted = 1 — по возрастанию ключей
+static void print_table(const Table *t, int sorted) {
+    OutBuf o;
+    ST_BEGIN(t0);
+    ob_init(&o, stdout, OB_CAP);
+    rd_lock(t);
+    ob_cstr(&o, "Table (count=");
+    ob_int(&o, t->count);
+    ob_cstr(&o, "):\n");
+    // без памяти на индекс строки выводятся в порядке слотов
+    if (!sorted || emit_sorted(t, &o, print_row) != TM_OK) emit_rows(t, &o, print_row);
+    unlock(t);
+    ob_flush(&o);
+    ob_free(&o);
+    ST_END(&t->stats, ST_PRINT, t0);
+}
+
+
+void tm_print(const Table *t) {
+    print_table(t, 0);
+}
+
+
+void tm_print_sorted(const Table *t) {
+    print_table(t, 1);
+}
+
+
+void tm_free(Table *t) {
+    // строки освобождаются вместе с ареной, без обхода слотов
+    arena_free_all(&t->arena);
+    free(t->keys);
+    free(t->pars);
+    free(t->busy);
     free(t->items);
+    free(t->links);
+    jump_free(&t->jumps);
+    free_info_index(t);
+    hi_free(&t->idx);
+    oi_free(&t->order);
+    t->order_ok = 0;
+    pthread_mutex_destroy(&t->order_lock);
+    pool_free(t->pool);
+    t->pool = NULL;
+    pthread_rwlock_destroy(&t->lock);
+    t->concurrent = 0;
+    t->keys     = NULL;
+    t->pars     = NULL;
+    t->busy     = NULL;
     t->items    = NULL;
+    t->links    = NULL;
+    link_reset(&t->roots, 0);
+    t->free_head = -1;
     t->capacity = 0;
     t->count    = 0;
 }
@@ -118,8 +1087,11 @@ void tm_free(Table *t) {
 const char* tm_errstr(int code) {
     switch (code) {
         case TM_OK:                 return "OK!";
+        case TM_ERR_EXISTS:         return "Record with this key already exists";
         case TM_ERR_FULL:           return "Table is full";
         case TM_ERR_NOT_FOUND:      return "No record with this key was found";
+        case TM_ERR_WRITE:          return "Output write error";
+        case TM_ERR_READ:           return "Input read error";
         case TM_ERR_INVALID:        return "Parent key should be >= 0\n"
                                            "Key should be unique and > 0\n"
                                            "Info should not be NULL and must be a C-string only";
@@ -128,20 +1100,248 @@ const char* tm_errstr(int code) {
 }
 
 
+static void dot_node(OutBuf *o, const Table *t, int i) {
+    ob_cstr(o, "    \"");
+    ob_int(o, t->keys[i]);
+    ob_cstr(o, "\" [label=\"");
+    ob_int(o, t->keys[i]);
+    ob_cstr(o, ": ");
+    ob_quoted(o, item_info(&t->items[i]));
+    ob_cstr(o, "\"];\n");
+}
+
+
+static void dot_edge(OutBuf *o, int par, int key) {
+    ob_cstr(o, "    \"");
+    ob_int(o, par);
+    ob_cstr(o, "\" -> \"");
+    ob_int(o, key);
+    ob_cstr(o, "\";\n");
+}
+
+
+static void dot_row(OutBuf *o, const Table *t, int i) {
+    dot_node(o, t, i);
+    if (t->pars[i] != 0) dot_edge(o, t->pars[i], t->keys[i]);
+}
+
+
+// Экспорт с фильтром: обход в ширину от корня поддерева (или от корней
+// таблицы) с учётом глубины и числа узлов; в очередь попадает не больше
+// max_nodes слотов. Возвращает TM_OK, TM_ERR_NOT_FOUND или TM_ERR_FULL
+static int dot_filtered_rows(const Table *t, OutBuf *o, const DotFilter *flt) {
+    long limit = flt->max_nodes > 0 ? flt->max_nodes : (long)t->count;
+    SlotList l = { malloc(1024 * sizeof(int)), 0, 1024 };
+    STAT(t, allocs, 1);
+    if (!l.slot) return TM_ERR_FULL;
+    int res = TM_OK;
+    if (flt->root != 0) {
+        int i = hi_find(&t->idx, flt->root);
+        if (i < 0) res = TM_ERR_NOT_FOUND;
+        else l.slot[l.len++] = i;
+    } else {
+        for (int c = t->roots.child; c >= 0 && l.len < limit && res == TM_OK; c = t->links[c].next)
+            if (push_slot(&l, c) != 0) res = TM_ERR_FULL;
+    }
+    int depth = 1, level_end = l.len;
+    for (int q = 0; q < l.len && res == TM_OK; q++) {
+        if (q == level_end) {
+            depth++;
+            level_end = l.len;
+        }
+        int s = l.slot[q];
+        STAT(t, slots, 1);
+        dot_node(o, t, s);
+        // у корня выводимого поддерева родителя в выводе нет
+        if (t->pars[s] != 0 && t->keys[s] != flt->root) dot_edge(o, t->pars[s], t->keys[s]);
+        if (flt->max_depth > 0 && depth >= flt->max_depth) continue;
+        for (int c = t->links[s].child; c >= 0 && l.len < limit; c = t->links[c].next) {
+            if (push_slot(&l, c) != 0) {
+                res = TM_ERR_FULL;
+                break;
+            }
+        }
+    }
+    free(l.slot);
+    return res;
+}
+
+
+int tm_export_dot_ex(const Table *t, FILE *f, const DotFilter *flt) {
+    OutBuf o;
+    int res = TM_OK;
+    ST_BEGIN(t0);
+    ob_init(&o, f, OB_CAP);
+    ob_cstr(&o, "digraph G {\n");
+    rd_lock(t);
+    if (dot_filtered(flt)) res = dot_filtered_rows(t, &o, flt);
+    else if (flt && flt->sorted) res = emit_sorted(t, &o, dot_row);
+    else emit_rows(t, &o, dot_row);
+    unlock(t);
+    ob_cstr(&o, "}\n");
+    if (ob_flush(&o) != 0 && res == TM_OK) res = o.buf ? TM_ERR_WRITE : TM_ERR_FULL;
+    ob_free(&o);
+    ST_END(&t->stats, ST_EXPORT, t0);
+    return res;
+}
+
+
 void tm_export_dot(const Table *t, const char *filename) {
     FILE *f = fopen(filename, "w");
     if (!f) return;
-    fprintf(f, "digraph G {\n");
-    for (int i = 0; i < t->capacity; i++) {
-        if (!t->items[i].busy) continue;
-        int k = t->items[i].key;
-        fprintf(f, "    \"%d\" [label=\"%d: %s\"];\n",
-                k, k, t->items[i].info);
-        if (t->items[i].par != 0) {
-            fprintf(f, "    \"%d\" -> \"%d\";\n",
-                    t->items[i].par, k);
-        }
-    }
-    fprintf(f, "}\n");
+    tm_export_dot_ex(t, f, NULL);
     fclose(f);
 }
+
+
+#define SNAP_MAGIC   "TMSN"
+#define SNAP_VERSION 1
+
+// Заголовок снимка; за ним — keys[count], pars[count], lens[count]
+// и blob_len байт строк info
+typedef struct {
+    char magic[4];  // SNAP_MAGIC
+    int  version;   // SNAP_VERSION
+    int  count;     // число элементов
+    int  reserved;
+    long blob_len;  // байт строк info вместе с '\0'
+} SnapHeader;
+
+
+// Слоты в прямом порядке обхода всего леса: родители раньше потомков
+static int *preorder_slots(const Table *t) {
+    int *order = malloc(((size_t)t->count + 1) * sizeof(int));
+    if (!order) return NULL;
+    int n = 0;
+    for (int s = t->roots.child; s >= 0; s = jump_next(&t->jumps, t->links, -1, s)) order[n++] = s;
+    return order;
+}
+
+
+static int write_snapshot(const Table *t, FILE *f) {
+    int *order = preorder_slots(t);
+    STAT(t, allocs, 1);
+    if (!order) return TM_ERR_WRITE;
+    SnapHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, SNAP_MAGIC, 4);
+    h.version = SNAP_VERSION;
+    h.count   = t->count;
+    for (int q = 0; q < t->count; q++) h.blob_len += t->items[order[q]].len + 1;
+    OutBuf o;
+    ob_init(&o, f, OB_CAP);
+    ob_str(&o, (const char *)&h, sizeof(h));
+    // столбцы идут подряд, каждый — в порядке обхода
+    for (int q = 0; q < t->count; q++) ob_str(&o, (const char *)&t->keys[order[q]], sizeof(int));
+    for (int q = 0; q < t->count; q++) ob_str(&o, (const char *)&t->pars[order[q]], sizeof(int));
+    for (int q = 0; q < t->count; q++) ob_str(&o, (const char *)&t->items[order[q]].len, sizeof(int));
+    for (int q = 0; q < t->count; q++) {
+        const Item *it = &t->items[order[q]];
+        ob_str(&o, item_info(it), (size_t)it->len + 1);
+    }
+    int res = ob_flush(&o) == 0 ? TM_OK : TM_ERR_WRITE;
+    ob_free(&o);
+    free(order);
+    return res;
+}
+
+
+int tm_save_snapshot(const Table *t, const char *filename) {
+    size_t n = strlen(filename);
+    char *tmp = malloc(n + 5);
+    if (!tmp) return TM_ERR_WRITE;
+    memcpy(tmp, filename, n);
+    memcpy(tmp + n, ".tmp", 5);
+    FILE *f = fopen(tmp, "wb");
+    int res = f ? TM_OK : TM_ERR_WRITE;
+    if (f) {
+        rd_lock(t);
+        res = write_snapshot(t, f);
+        unlock(t);
+        if (res == TM_OK && fsync(fileno(f)) != 0) res = TM_ERR_WRITE;
+        if (fclose(f) != 0) res = TM_ERR_WRITE;
+        // старый снимок заменяется только полностью записанным новым
+        if (res == TM_OK && rename(tmp, filename) != 0) res = TM_ERR_WRITE;
+        if (res != TM_OK) remove(tmp);
+    }
+    free(tmp);
+    return res;
+}
+
+
+// Размещение элементов снимка по порядку: родитель каждого уже на месте.
+// Проверки не дают повреждённому файлу вывести чтение за пределы образа
+static int load_rows(Table *t, const SnapHeader *h, const char *img) {
+    const int  *keys = (const int *)(img + sizeof(*h));
+    const int  *pars = keys + h->count;
+    const int  *lens = pars + h->count;
+    const char *blob = (const char *)(lens + h->count);
+    long off = 0;
+    for (int q = 0; q < h->count; q++) {
+        if (keys[q] <= 0 || lens[q] < 0 || lens[q] >= h->blob_len - off || blob[off + lens[q]] != '\0')
+            return TM_ERR_INVALID;
+        if (hi_find(&t->idx, keys[q]) >= 0 || !children_head(t, pars[q])) return TM_ERR_INVALID;
+        if (place(t, keys[q], pars[q], blob + off) != TM_OK) return TM_ERR_FULL;
+        off += lens[q] + 1;
+    }
+    return TM_OK;
+}
+
+
+int tm_load_snapshot(Table *t, const char *filename) {
+    int fd = open(filename, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        if (fd >= 0) close(fd);
+        return TM_ERR_READ;
+    }
+    if (st.st_size < (off_t)sizeof(SnapHeader)) {
+        close(fd);
+        return TM_ERR_INVALID;
+    }
+    size_t len = (size_t)st.st_size;
+    char *img = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // отображение остаётся и без дескриптора
+    if (img == MAP_FAILED) return TM_ERR_READ;
+    madvise(img, len, MADV_SEQUENTIAL);
+    SnapHeader h;
+    memcpy(&h, img, sizeof(h));
+    int res = TM_OK;
+    if (memcmp(h.magic, SNAP_MAGIC, 4) != 0 || h.version != SNAP_VERSION || h.count < 0 ||
+        h.blob_len < 0 || h.blob_len > (long)len ||
+        sizeof(h) + (size_t)h.count * 3 * sizeof(int) + (size_t)h.blob_len != len) {
+        res = TM_ERR_INVALID;
+    }
+    if (res == TM_OK) {
+        tm_init(t, h.count);
+        res = t->capacity >= h.count ? load_rows(t, &h, img) : TM_ERR_FULL;
+        if (res != TM_OK) tm_free(t);
+    }
+    munmap(img, len);
+    return res;
+}
+
+
+int tm_stats(const Table *t, TableStats *out) {
+    memset(out, 0, sizeof(*out));
+#ifdef TABLE_STATS
+    rd_lock(t);
+    st_copy(out, &t->stats);
+    out->allocs += t->arena.mallocs;
+    unlock(t);
+    return TM_OK;
+#else
+    (void)t;
+    return TM_ERR_INVALID;
+#endif
+}
+
+
+void tm_stats_reset(Table *t) {
+    wr_lock(t);
+#ifdef TABLE_STATS
+    memset(&t->stats, 0, sizeof(t->stats));
+#endif
+    t->arena.mallocs = 0;
+    unlock(t);
+}
@@ -2,33 +2,94 @@
 #define TABLE_MEM_H
 
 #include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "hash_index.h"
+#include "tree_links.h"
+#include "tree_jump.h"
+#include "info_index.h"
+#include "ord_index.h"
+#include "arena.h"
+#include "batch.h"
+#include "pool.h"
+#include "stats.h"
+#include "outbuf.h"
 
 // Коды ошибок
 #define TM_OK            0  // успешно
 #define TM_ERR_EXISTS    1  // элемент с таким ключом уже существует
-#define TM_ERR_FULL      2  // таблица заполнена
+#define TM_ERR_FULL      2  // не удалось расширить таблицу (нет памяти)
 #define TM_ERR_NOT_FOUND 3  // элемент не найден
 #define TM_ERR_INVALID   4  // неверные параметры
+#define TM_ERR_WRITE     5  // ошибка записи вывода (экспорт, снимок)
+#define TM_ERR_READ      6  // ошибка чтения файла (снимок, преобразование)
 
-// Структура элемента в памяти
+// Строки короче TM_SSO_LEN хранятся прямо в Item
+#define TM_SSO_LEN 16
+
+// Данные элемента, которые не участвуют в сканированиях
 typedef struct {
-    int   busy;    // признак занятости: 0 (свободно) / 1 (занято)
-    int   key;     // ключ элемента, != 0
-    int   par;     // ключ родителя: 0 или существующий ключ
-    char *info;    // строка с информацией
+    int len;       // длина строки info (без '\0')
+    union {
+        char  buf[TM_SSO_LEN]; // короткая строка (len < TM_SSO_LEN)
+        char *ptr;             // иначе — блок из арены таблицы
+    } info;        // строка с информацией
 } Item;
 
-// Структура самой таблицы
+// Структура самой таблицы.
+// Хранение по столбцам: ключи, родители и признак занятости лежат
+// в отдельных непрерывных массивах, поэтому сканирование по родителю
+// читает только нужные байты и выполняется SIMD-ядрами (scan.h).
+// Ёмкость всегда кратна 64 — размеру блока битовой карты.
 typedef struct {
-    Item *items;   // массив элементов
-    int   capacity;// максимальное число элементов
+    int      *keys;    // ключ элемента слота, != 0
+    int      *pars;    // ключ родителя: 0 или существующий ключ
+    uint64_t *busy;    // битовая карта занятых слотов
+    Item     *items;   // строки info по слотам
+    int   capacity;// текущий размер массива (растёт автоматически)
     int   count;   // текущее число занятых элементов
+    HashIndex idx; // индекс "ключ -> слот" для проверок за O(1)
+    OrdIndex order;// ключ -> слот по возрастанию ключей (см. tm_range)
+    int   order_ok;// 1 — order построен (первым запросом по порядку ключей)
+    pthread_mutex_t order_lock; // построение order читателями
+    Link *links;   // связи потомков по слотам (параллельно items)
+    Link  roots;   // список корней (par == 0): общий невидимый родитель
+    Jumps jumps;   // родители, глубины и прыжки к предкам по слотам
+    InfoIndex *info_idx; // индекс по info или NULL (см. tm_set_info_index)
+    int   free_head;// первый свободный слот (цепочка через links[].next)
+    Arena arena;   // память под длинные строки info
+    pthread_rwlock_t lock; // читатели/писатель в параллельном режиме
+    int   concurrent;// 1 — функции таблицы берут lock (см. tm_set_concurrent)
+    Pool *pool;    // потоки параллельных обходов или NULL (см. tm_set_threads)
+#ifdef TABLE_STATS
+    TableStats stats; // счётчики операций (см. stats.h)
+#endif
 } Table;
 
 // Инициализация таблицы (выделение памяти)
-// SIZE - максимальное число элементов
+// SIZE - начальное число слотов; при заполнении таблица
+// увеличивается вдвое, поэтому SIZE — лишь подсказка
 void tm_init(Table *t, int SIZE);
 
+// Параллельный режим (on = 1): поиск, вывод и экспорт берут блокировку
+// на чтение и выполняются из многих потоков одновременно, вставки
+// и удаления — монопольную блокировку. Вызывать до запуска потоков.
+// Курсоры блокировку не берут: на время обхода их владелец держит
+// tm_read_lock. tm_free вызывается, когда других потоков уже нет
+void tm_set_concurrent(Table *t, int on);
+
+// Число потоков для обходов всей таблицы: 1 — один поток (по умолчанию),
+// <= 0 — по числу процессоров. В больших таблицах tm_print,
+// tm_export_dot, поиск со сканированием столбца родителей и удаление
+// больших поддеревьев делят диапазон слотов между потоками; результаты
+// собираются в порядке номеров слотов, как и при одном потоке.
+// Возвращает TM_OK или TM_ERR_FULL, если потоки не удалось создать
+int tm_set_threads(Table *t, int n);
+
+// Блокировка таблицы на чтение для обхода курсором (в параллельном режиме)
+void tm_read_lock(const Table *t);
+void tm_read_unlock(const Table *t);
+
 // Вставка нового элемента
 // key   - ключ (> 0 и уникален)
 // par   - ключ родителя (0 или существующий key)
@@ -40,13 +101,123 @@ int tm_insert(Table *t, int key, int par, const char *info);
 // Возвращает TM_OK или TM_ERR_NOT_FOUND
 int tm_remove(Table *t, int key);
 
+// Пакетная вставка n элементов rows.
+// Пакет проверяется целиком: родителем может быть элемент того же пакета,
+// даже расположенный дальше по списку (см. batch.h).
+// errs (может быть NULL) — код TM_* для каждого элемента.
+// Возвращает число вставленных элементов
+int tm_insert_batch(Table *t, const BatchRow *rows, int n, int *errs);
+
+// Пакетное удаление n ключей keys вместе с потомками.
+// errs (может быть NULL) — TM_OK или TM_ERR_NOT_FOUND для каждого ключа;
+// ключ, удалённый вместе с предком из того же пакета, считается найденным.
+// Возвращает число найденных ключей
+int tm_remove_batch(Table *t, const int *keys, int n, int *errs);
+
 // Поиск всех элементов с заданным ключом родителя;
 // Возвращает новый объект Table* с копиями найденных элементов
+// (обёртка над курсором; для чтения без копирования см. tm_cursor_open).
+// При небольшом числе потомков обходится их список, при большом —
+// столбец родителей сканируется целиком, поэтому порядок
+// элементов результата не гарантируется.
 Table* tm_search(const Table *t, int par);
 
+// Строка результата поиска. info не копируется: указатель
+// заимствован у таблицы и действителен до её следующего изменения
+typedef struct {
+    int         key;   // ключ элемента
+    int         par;   // ключ родителя
+    const char *info;  // строка с информацией (только чтение)
+} TmRow;
+
+// Курсор поиска по ключу родителя (см. tm_cursor_open)
+typedef struct {
+    const Table *t;
+    int      par;    // искомый ключ родителя
+    int      total;  // общее число найденных элементов
+    int      scan;   // 1 — сканирование столбца, 0 — обход списка потомков
+    int      slot;   // следующий слот списка потомков или -1
+    int      word;   // текущее слово битовой карты
+    uint64_t mask;   // ещё не выданные совпадения текущего слова
+} TmCursor;
+
+// Обработчик строки для tm_search_each;
+// ненулевой результат прекращает обход
+typedef int (*TmRowFn)(const TmRow *row, void *ctx);
+
+// Начать обход элементов с ключом родителя par без выделения памяти.
+// Таблицу нельзя изменять, пока курсор используется
+void tm_cursor_open(TmCursor *c, const Table *t, int par);
+
+// Получить следующую строку. Возвращает 1 или 0, если строк больше нет
+int tm_cursor_next(TmCursor *c, TmRow *row);
+
+// Вызвать fn для каждого элемента с ключом родителя par.
+// Возвращает число обработанных строк
+int tm_search_each(const Table *t, int par, TmRowFn fn, void *ctx);
+
+// Записать в rows не более cap найденных строк.
+// Возвращает общее число найденных элементов (может быть > cap)
+int tm_search_fill(const Table *t, int par, TmRow *rows, int cap);
+
+// Вызвать fn для каждого потомка key (всех уровней, без самого key)
+// в прямом порядке обхода: за элементом идёт его поддерево, братья —
+// в порядке вставки. Время пропорционально числу потомков.
+// key = 0 — все элементы таблицы (каждый родитель раньше потомков).
+// Ненулевой результат fn прекращает обход.
+// Возвращает TM_OK или TM_ERR_NOT_FOUND
+int tm_descendants(const Table *t, int key, TmRowFn fn, void *ctx);
+
+// Записать в keys не более cap ключей предков key: родитель, его
+// родитель и так далее до корня. Возвращает число предков (глубину key,
+// может быть > cap) или -1, если ключа нет
+int tm_ancestors(const Table *t, int key, int *keys, int cap);
+
+// 1, если anc — предок key (родитель, его родитель, ...), 0 — нет,
+// -1 — одного из ключей нет. Проверка за O(log n) по прыжкам (tree_jump.h)
+int tm_is_ancestor(const Table *t, int anc, int key);
+
+// Вторичный индекс по info (on = 1 — построить, 0 — удалить), см.
+// info_index.h: копии строк, дерево для префиксов и списки триграмм для
+// подстрок. Индекс живёт в памяти и поддерживается вставками и
+// удалениями; если на него не хватает памяти, вставка не выполняется
+// (TM_ERR_FULL). Возвращает TM_OK или TM_ERR_FULL
+int tm_set_info_index(Table *t, int on);
+
+// Вызвать fn для каждого элемента, info которого начинается с prefix.
+// С индексом — по возрастанию info (равные — по ключу) за O(log n) плюс
+// найденные, без индекса — сканированием всех элементов в порядке слотов.
+// Ненулевой результат fn прекращает обход.
+// Возвращает TM_OK или TM_ERR_INVALID (prefix == NULL)
+int tm_find_prefix(const Table *t, const char *prefix, TmRowFn fn, void *ctx);
+
+// Вызвать fn для каждого элемента, info которого содержит s. С индексом
+// проверяются только элементы из самого короткого списка триграмм s
+// (для s короче 3 байт — все элементы индекса) в порядке их добавления
+// в индекс, без индекса — все элементы в порядке слотов.
+// Возвращает TM_OK или TM_ERR_INVALID (s == NULL)
+int tm_find_substr(const Table *t, const char *s, TmRowFn fn, void *ctx);
+
+// Вызвать fn для каждого элемента с ключом из [lo, hi] по возрастанию
+// ключей: спуск по упорядоченному индексу (ord_index.h) за O(log n) плюс
+// найденные. Индекс строится первым запросом по порядку ключей (за
+// O(n log n)) и дальше поддерживается вставками и удалениями.
+// Ненулевой результат fn прекращает обход.
+// Возвращает TM_OK или TM_ERR_FULL (нет памяти на индекс)
+int tm_range(const Table *t, int lo, int hi, TmRowFn fn, void *ctx);
+
+// Элемент с наименьшим (tm_min) или наибольшим (tm_max) ключом.
+// Возвращает TM_OK, TM_ERR_NOT_FOUND (таблица пуста) или TM_ERR_FULL
+int tm_min(const Table *t, TmRow *row);
+int tm_max(const Table *t, TmRow *row);
+
 // Вывод всей таблицы в stdout
 void tm_print(const Table *t);
 
+// Вывод всей таблицы в stdout по возрастанию ключей (см. tm_range;
+// без памяти на упорядоченный индекс — в порядке слотов)
+void tm_print_sorted(const Table *t);
+
 // Освобождение всех ресурсов таблицы
 void tm_free(Table *t);
 
@@ -57,4 +228,39 @@ const char *tm_errstr(int code);
 
 void tm_export_dot(const Table *t, const char *filename);
 
+// Экспорт в Graphviz DOT в открытый файл f (в том числе в канал popen:
+// вывод идёт через буфер OB_CAP байт и сбрасывается по мере заполнения).
+// flt (может быть NULL) ограничивает вывод поддеревом flt->root, глубиной
+// и числом узлов; с ограничениями узлы выводятся по уровням от корня,
+// без них — по возрастанию ключей (flt->sorted) или в порядке слотов,
+// как tm_export_dot.
+// Возвращает TM_OK, TM_ERR_NOT_FOUND (нет ключа flt->root),
+// TM_ERR_FULL (нет памяти) или TM_ERR_WRITE
+int tm_export_dot_ex(const Table *t, FILE *f, const DotFilter *flt);
+
+// Снимок таблицы: один непрерывный двоичный образ — заголовок, столбцы
+// ключей, родителей и длин info в прямом порядке обхода (родители
+// раньше потомков) и упакованные подряд строки info с '\0'.
+// Образ пишется через буфер во временный файл <filename>.tmp, который
+// после fsync атомарно заменяет filename (rename).
+// Возвращает TM_OK или TM_ERR_WRITE
+int tm_save_snapshot(const Table *t, const char *filename);
+
+// Загрузка снимка: файл отображается в память (mmap) целиком, и t
+// инициализируется (как tm_init) с ёмкостью под все элементы, которые
+// размещаются по порядку без повторных проверок порядка и расширений.
+// t не должна быть инициализирована (или освобождена tm_free); при
+// ошибке она остаётся неинициализированной.
+// Возвращает TM_OK, TM_ERR_READ (нет файла, ошибка чтения),
+// TM_ERR_INVALID (не снимок или файл повреждён) или TM_ERR_FULL
+int tm_load_snapshot(Table *t, const char *filename);
+
+// Статистика таблицы с момента tm_init или tm_stats_reset: просмотренные
+// слоты, выделения памяти (вместе с кусками арены) и задержки операций.
+// Возвращает TM_OK или TM_ERR_INVALID (сборка без TABLE_STATS, out обнулён)
+int tm_stats(const Table *t, TableStats *out);
+
+// Обнуление статистики
+void tm_stats_reset(Table *t);
+
 #endif // TABLE_MEM_H
\ No newline at end of file
@@ -0,0 +1,94 @@
+#include "tree_jump.h"
+#include <stdlib.h>
+
+void jump_init(Jumps *j) {
+    j->up    = NULL;
+    j->depth = NULL;
+    j->jump  = NULL;
+    j->cap   = 0;
+}
+
+int jump_resize(Jumps *j, int cap) {
+    int *up = realloc(j->up, (size_t)cap * sizeof(int));
+    if (!up) return -1;
+    j->up = up;
+    int *depth = realloc(j->depth, (size_t)cap * sizeof(int));
+    if (!depth) return -1;
+    j->depth = depth;
+    int *jump = realloc(j->jump, (size_t)cap * sizeof(int));
+    if (!jump) return -1;
+    j->jump = jump;
+    j->cap = cap;
+    return 0;
+}
+
+void jump_free(Jumps *j) {
+    free(j->up);
+    free(j->depth);
+    free(j->jump);
+    jump_init(j);
+}
+
+void jump_attach(Jumps *j, int slot, int up) {
+    j->up[slot] = up;
+    if (up < 0) {
+        j->depth[slot] = 0;
+        j->jump[slot]  = slot;
+        return;
+    }
+    j->depth[slot] = j->depth[up] + 1;
+    // when the parent's jump and the jump after it span equal distances,
+    // the new leaf jumps over both; otherwise it jumps to its parent
+    int a = j->jump[up], b = j->jump[a];
+    if (j->depth[up] - j->depth[a] == j->depth[a] - j->depth[b]) j->jump[slot] = b;
+    else j->jump[slot] = up;
+}
+
+int jump_build(Jumps *j, const Link *links, const Link *roots) {
+    int n = 0;
+    for (int r = roots->child; r >= 0; r = links[r].next) {
+        // preorder, so every parent is labelled before its children
+        jump_attach(j, r, -1);
+        n++;
+        int s = r;
+        for (;;) {
+            int c = links[s].child;
+            if (c >= 0) {
+                jump_attach(j, c, s);
+                n++;
+                s = c;
+                continue;
+            }
+            while (s != r && links[s].next < 0) s = j->up[s];
+            if (s == r) break;
+            c = links[s].next;
+            jump_attach(j, c, j->up[s]);
+            n++;
+            s = c;
+        }
+    }
+    return n;
+}
+
+int jump_level(const Jumps *j, int slot, int depth) {
+    while (j->depth[slot] > depth) {
+        int a = j->jump[slot];
+        slot = j->depth[a] >= depth ? a : j->up[slot];
+    }
+    return slot;
+}
+
+int jump_is_ancestor(const Jumps *j, int anc, int slot) {
+    if (j->depth[anc] >= j->depth[slot]) return 0;
+    return jump_level(j, slot, j->depth[anc]) == anc;
+}
+
+int jump_next(const Jumps *j, const Link *links, int root, int s) {
+    if (links[s].child >= 0) return links[s].child;
+    // no children: the next sibling of the nearest ancestor that has one
+    while (s != root) {
+        if (links[s].next >= 0) return links[s].next;
+        s = j->up[s];
+    }
+    return -1;
+}
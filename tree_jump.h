@@ -0,0 +1,67 @@
+#ifndef TREE_JUMP_H
+#define TREE_JUMP_H
+
+#include "tree_links.h"
+
+// Разметка иерархии по слотам для запросов о предках:
+// слот родителя, глубина и один указатель-прыжок на предка.
+// Прыжки строятся по скошенной двоичной схеме (Myers): прыжок нового
+// листа зависит только от прыжков его родителя, поэтому вставка
+// листа стоит O(1), а подъём к предку заданной глубины — O(log n) шагов.
+// Таблицы удаляют только целые поддеревья, и предки оставшихся
+// элементов остаются на месте: при удалении разметку менять не нужно,
+// слот заново размечается, когда его занимает новый элемент.
+
+typedef struct {
+    int *up;    // слот родителя, -1 — корень
+    int *depth; // глубина: у корней 0
+    int *jump;  // слот предка для прыжка (у корня — сам корень)
+    int  cap;   // число слотов
+} Jumps;
+
+/*
+ * Инициализация пустой разметки (без памяти).
+ */
+void jump_init(Jumps *j);
+
+/*
+ * Расширение массивов до cap слотов.
+ * Возвращает 0 или -1 при нехватке памяти (разметка не изменена).
+ */
+int jump_resize(Jumps *j, int cap);
+
+/*
+ * Освобождение памяти.
+ */
+void jump_free(Jumps *j);
+
+/*
+ * Разметить слот slot как нового потомка слота up (-1 — корень).
+ */
+void jump_attach(Jumps *j, int slot, int up);
+
+/*
+ * Разметить лес по спискам потомков links (корни — в списке roots)
+ * обходом в прямом порядке. Возвращает число размеченных слотов.
+ */
+int jump_build(Jumps *j, const Link *links, const Link *roots);
+
+/*
+ * Предок слота slot на глубине depth (<= глубины slot).
+ */
+int jump_level(const Jumps *j, int slot, int depth);
+
+/*
+ * 1, если anc — собственный предок slot (не сам slot), иначе 0.
+ */
+int jump_is_ancestor(const Jumps *j, int anc, int slot);
+
+/*
+ * Следующий за s слот поддерева root в прямом порядке или -1.
+ * Обход поддерева от jump_next(j, links, root, root) без стека:
+ * каждая связь проходится не больше двух раз. root = -1 — обход
+ * всего леса, начиная с первого корня (roots.child).
+ */
+int jump_next(const Jumps *j, const Link *links, int root, int s);
+
+#endif // TREE_JUMP_H
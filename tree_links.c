@@ -0,0 +1,69 @@
+#include "tree_links.h"
+
+void link_reset(Link *links, int slot) {
+    links[slot].child = -1;
+    links[slot].next  = -1;
+    links[slot].prev  = -1;
+    links[slot].count = 0;
+}
+
+void link_attach(Link *links, Link *parent, int slot) {
+    int head = parent->child;
+    links[slot].next = -1;
+    parent->count++;
+    if (head < 0) {
+        links[slot].prev = slot; // single element is its own tail
+        parent->child = slot;
+        return;
+    }
+    int last = links[head].prev;
+    links[last].next  = slot;
+    links[slot].prev  = last;
+    links[head].prev  = slot;
+}
+
+void link_detach(Link *links, Link *parent, int slot) {
+    int next = links[slot].next;
+    int prev = links[slot].prev;
+    if (parent->child == slot) {
+        parent->child = next;
+        if (next >= 0) links[next].prev = prev; // keep tail pointer
+    } else {
+        links[prev].next = next;
+        if (next >= 0) links[next].prev = prev;
+        else links[parent->child].prev = prev; // removed the tail
+    }
+    parent->count--;
+    links[slot].next = -1;
+    links[slot].prev = -1;
+}
+
+int link_pop_subtree(Link *links, int *work) {
+    int s = *work;
+    if (s < 0) return -1;
+    int rest  = links[s].next;
+    int first = links[s].child;
+    if (first >= 0) {
+        // splice the children in front of the remaining work
+        int last = links[first].prev;
+        links[last].next = rest;
+        *work = first;
+    } else {
+        *work = rest;
+    }
+    return s;
+}
+
+void link_push_free(Link *links, int *head, int slot) {
+    links[slot].child = -1;
+    links[slot].prev  = -1;
+    links[slot].count = 0;
+    links[slot].next  = *head;
+    *head = slot;
+}
+
+int link_pop_free(Link *links, int *head) {
+    int s = *head;
+    if (s >= 0) *head = links[s].next;
+    return s;
+}
@@ -0,0 +1,53 @@
+#ifndef TREE_LINKS_H
+#define TREE_LINKS_H
+
+// Связи "родитель -> потомки" для слотов таблицы:
+// первый потомок + двусвязный список братьев.
+// Список потомков хранится по индексам слотов, -1 — нет элемента.
+// У первого потомка поле prev указывает на последнего брата,
+// что даёт добавление в конец списка за O(1).
+// Корни (par == 0) висят на отдельном Link таблицы, который
+// играет роль общего невидимого родителя.
+
+typedef struct {
+    int child; // первый потомок или -1
+    int next;  // следующий брат или -1
+    int prev;  // предыдущий брат (у первого — последний брат)
+    int count; // число прямых потомков
+} Link;
+
+/*
+ * Сбросить связи слота (нет потомков, не в списке).
+ */
+void link_reset(Link *links, int slot);
+
+/*
+ * Добавить слот в конец списка потомков parent
+ * (Link родителя или Link корней таблицы).
+ */
+void link_attach(Link *links, Link *parent, int slot);
+
+/*
+ * Исключить слот из списка потомков parent.
+ */
+void link_detach(Link *links, Link *parent, int slot);
+
+/*
+ * Обход поддерева без рекурсии и дополнительной памяти.
+ * *work — голова рабочего списка (в начале — корень поддерева
+ * с next == -1). Возвращает очередной слот (в прямом порядке),
+ * подставляя его потомков в начало рабочего списка, или -1.
+ * Связи посещённых слотов портятся: функция предназначена
+ * для удаления поддерева.
+ */
+int link_pop_subtree(Link *links, int *work);
+
+/*
+ * Список свободных слотов хранится в поле next свободных слотов.
+ * link_push_free кладёт слот в начало списка *head,
+ * link_pop_free извлекает первый слот (или -1, если список пуст).
+ */
+void link_push_free(Link *links, int *head, int slot);
+int  link_pop_free(Link *links, int *head);
+
+#endif // TREE_LINKS_H
@@ -0,0 +1,125 @@
+#include "wal.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define WAL_MAGIC "TFWL"
+
+typedef struct {
+    char magic[4];
+    int  version;
+    long gen;
+} WalHeader;
+
+static long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// FNV-1a over the payload fields, enough to catch a torn tail
+static unsigned rec_sum(const WalRec *r) {
+    const unsigned char *p = (const unsigned char *)r;
+    unsigned h = 2166136261u;
+    for (size_t i = 0; i < offsetof(WalRec, sum); i++) {
+        h ^= p[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+int wal_open(Wal *w, const char *path, int group_ops, int group_ms) {
+    memset(w, 0, sizeof(*w));
+    w->group_ops = group_ops > 0 ? group_ops : 1;
+    w->group_ms  = group_ms;
+    w->f = fopen(path, "r+b");
+    if (!w->f) w->f = fopen(path, "w+b");
+    return w->f ? 0 : -1;
+}
+
+int wal_replay(Wal *w, long gen, WalApplyFn fn, void *ctx) {
+    WalHeader h;
+    rewind(w->f);
+    if (fread(&h, sizeof(h), 1, w->f) != 1 || memcmp(h.magic, WAL_MAGIC, 4) != 0 || h.gen != gen) {
+        // empty, foreign or already folded into a checkpoint
+        return wal_reset(w, gen) == 0 ? 0 : -1;
+    }
+    w->gen = gen;
+    int n = 0;
+    WalRec r;
+    while (fread(&r, sizeof(r), 1, w->f) == 1 && r.sum == rec_sum(&r)) {
+        if (fn(&r, ctx) != 0) return -1;
+        n++;
+    }
+    // cut off whatever follows the last whole record
+    long end = (long)sizeof(h) + (long)n * (long)sizeof(r);
+    if (fflush(w->f) != 0 || ftruncate(fileno(w->f), end) != 0) return -1;
+    fseek(w->f, end, SEEK_SET);
+    w->logged = n;
+    return n;
+}
+
+int wal_append(Wal *w, int op, int key, int par, long offset, int length) {
+    if (w->pending == w->bufcap) {
+        int cap = w->bufcap ? w->bufcap * 2 : 64;
+        WalRec *p = realloc(w->buf, cap * sizeof(WalRec));
+        if (!p) return -1;
+        w->buf = p;
+        w->bufcap = cap;
+    }
+    WalRec *r = &w->buf[w->pending];
+    memset(r, 0, sizeof(*r));
+    r->op     = op;
+    r->key    = key;
+    r->par    = par;
+    r->offset = offset;
+    r->length = length;
+    r->sum    = rec_sum(r);
+    if (w->pending++ == 0) w->first_ms = now_ms();
+    w->logged++;
+    return 0;
+}
+
+int wal_due(const Wal *w) {
+    if (w->pending == 0) return 0;
+    return w->pending >= w->group_ops || now_ms() - w->first_ms >= w->group_ms;
+}
+
+long wal_wait_ms(const Wal *w) {
+    if (w->pending == 0) return -1;
+    long left = w->first_ms + w->group_ms - now_ms();
+    return left > 0 ? left : 0;
+}
+
+int wal_commit(Wal *w) {
+    if (w->pending == 0) return 0;
+    if (fseek(w->f, 0, SEEK_END) != 0 ||
+        fwrite(w->buf, sizeof(WalRec), w->pending, w->f) != (size_t)w->pending ||
+        fflush(w->f) != 0 || fsync(fileno(w->f)) != 0) {
+        return -1;
+    }
+    w->pending = 0;
+    return 0;
+}
+
+int wal_reset(Wal *w, long gen) {
+    WalHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, WAL_MAGIC, 4);
+    h.version = 1;
+    h.gen     = gen;
+    w->gen     = gen;
+    w->pending = 0;
+    w->logged  = 0;
+    if (fflush(w->f) != 0 || ftruncate(fileno(w->f), 0) != 0) return -1;
+    rewind(w->f);
+    if (fwrite(&h, sizeof(h), 1, w->f) != 1 || fflush(w->f) != 0 || fsync(fileno(w->f)) != 0) return -1;
+    return 0;
+}
+
+void wal_close(Wal *w) {
+    if (w->f) fclose(w->f);
+    free(w->buf);
+    memset(w, 0, sizeof(*w));
+}
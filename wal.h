@@ -0,0 +1,90 @@
+#ifndef WAL_H
+#define WAL_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+// Журнал предзаписи (WAL) для файловой таблицы.
+// Записи журнала фиксированного размера дописываются в буфер и
+// сбрасываются на диск группой (wal_commit: fwrite + fflush + fsync).
+// Файл журнала начинается с заголовка с номером поколения: после
+// контрольной точки поколение увеличивается, и журнал старого
+// поколения при открытии считается уже учтённым и отбрасывается.
+
+#define WAL_OP_INSERT 1 // вставка: key, par, offset, length
+#define WAL_OP_REMOVE 2 // удаление поддерева: key
+
+// Запись журнала (32 байта)
+typedef struct {
+    int      op;      // WAL_OP_*
+    int      key;     // ключ элемента
+    int      par;     // ключ родителя (для вставки)
+    int      length;  // длина info (для вставки)
+    long     offset;  // смещение info в файле таблицы (для вставки)
+    unsigned sum;     // контрольная сумма полей выше
+    int      reserved;
+} WalRec;
+
+typedef struct {
+    FILE   *f;          // файл журнала или NULL (журнал выключен)
+    long    gen;        // текущее поколение
+    WalRec *buf;        // записи, ещё не сброшенные на диск
+    int     pending;    // число записей в buf
+    int     bufcap;     // ёмкость buf
+    int     logged;     // записей с последней контрольной точки
+    long    first_ms;   // время первой несброшенной записи
+    int     group_ops;  // сбрасывать после стольких записей
+    int     group_ms;   // ... или через столько миллисекунд
+} Wal;
+
+// Обработчик записи при воспроизведении; ненулевой результат — ошибка
+typedef int (*WalApplyFn)(const WalRec *r, void *ctx);
+
+/*
+ * Открыть (или создать) журнал path. group_ops и group_ms задают
+ * группу сброса (см. wal_due). Возвращает 0 или -1.
+ */
+int wal_open(Wal *w, const char *path, int group_ops, int group_ms);
+
+/*
+ * Воспроизвести журнал поколения gen: вызвать fn для каждой целой
+ * записи по порядку. Оборванный хвост (сбой во время записи)
+ * отбрасывается. Журнал другого поколения не воспроизводится.
+ * Возвращает число записей или -1 при ошибке.
+ */
+int wal_replay(Wal *w, long gen, WalApplyFn fn, void *ctx);
+
+/*
+ * Добавить запись в буфер. Возвращает 0 или -1 при нехватке памяти.
+ */
+int wal_append(Wal *w, int op, int key, int par, long offset, int length);
+
+/*
+ * Пора ли сбрасывать группу (набралось group_ops записей
+ * или прошло group_ms с первой несброшенной записи).
+ */
+int wal_due(const Wal *w);
+
+/*
+ * Сколько миллисекунд осталось до сброса группы по времени:
+ * 0 — пора, -1 — несброшенных записей нет.
+ */
+long wal_wait_ms(const Wal *w);
+
+/*
+ * Записать буфер в журнал и дождаться fsync. Возвращает 0 или -1.
+ */
+int wal_commit(Wal *w);
+
+/*
+ * Очистить журнал и начать поколение gen (после контрольной точки).
+ * Несброшенные записи отбрасываются. Возвращает 0 или -1.
+ */
+int wal_reset(Wal *w, long gen);
+
+/*
+ * Закрыть журнал (без сброса буфера).
+ */
+void wal_close(Wal *w);
+
+#endif // WAL_H
@@ -0,0 +1,184 @@
+#include "zheap.h"
+#include "lz.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define POS_MASK ((1L << ZH_SHIFT) - 1)
+
+void zh_init(ZHeap *z, ZhAllocFn alloc, ZhReleaseFn release, ZhIoFn read, ZhIoFn write, void *ctx) {
+    memset(z, 0, sizeof(*z));
+    for (int i = 0; i < ZH_CACHE; i++) z->cache[i].block = -1;
+    z->alloc = alloc;
+    z->release = release;
+    z->read = read;
+    z->write = write;
+    z->ctx = ctx;
+}
+
+static int grow(char **p, int *cap, int need) {
+    if (*cap >= need) return 0;
+    int c = *cap ? *cap : ZH_BLOCK;
+    while (c < need) c *= 2;
+    char *q = realloc(*p, (size_t)c);
+    if (!q) return -1;
+    *p = q;
+    *cap = c;
+    return 0;
+}
+
+static int grow_dir(ZHeap *z, int need) {
+    if (z->cap >= need) return 0;
+    int c = z->cap ? z->cap * 2 : 64;
+    while (c < need) c *= 2;
+    ZBlock *d = realloc(z->dir, (size_t)c * sizeof(ZBlock));
+    if (!d) return -1;
+    z->dir = d;
+    z->cap = c;
+    return 0;
+}
+
+// reads block b into dst (at least dir[b].raw bytes)
+static int load_block(ZHeap *z, int b, char *dst) {
+    const ZBlock *d = &z->dir[b];
+    if (d->off <= 0) return -1;
+    if (d->zlen == d->raw) return z->read(z->ctx, d->off, dst, (size_t)d->raw);
+    if (grow(&z->zbuf, &z->zcap, d->zlen) != 0 ||
+        z->read(z->ctx, d->off, z->zbuf, (size_t)d->zlen) != 0) {
+        return -1;
+    }
+    return lz_decompress(z->zbuf, d->zlen, dst, d->raw);
+}
+
+// keeps room for one more stale block copy
+static int grow_stale(ZHeap *z) {
+    if (z->nstale < z->stale_cap) return 0;
+    int c = z->stale_cap ? z->stale_cap * 2 : 4;
+    ZBlock *s = realloc(z->stale, (size_t)c * sizeof(ZBlock));
+    if (!s) return -1;
+    z->stale = s;
+    z->stale_cap = c;
+    return 0;
+}
+
+static void drop_frame(ZHeap *z, int b) {
+    for (int i = 0; i < ZH_CACHE; i++) {
+        if (z->cache[i].block == b) z->cache[i].block = -1;
+    }
+}
+
+int zh_load(ZHeap *z, const ZBlock *dir, int n) {
+    if (n > 0 && grow_dir(z, n) != 0) return -1;
+    if (n > 0) memcpy(z->dir, dir, (size_t)n * sizeof(ZBlock));
+    z->n = n;
+    z->open = 0;
+    z->dirty = 0;
+    for (int i = 0; i < ZH_CACHE; i++) z->cache[i].block = -1;
+    if (n == 0) return 0;
+    ZBlock *last = &z->dir[n - 1];
+    if (last->off <= 0 || last->raw >= ZH_BLOCK) return 0;
+    if (grow(&z->tail, &z->tcap, last->raw) != 0 || load_block(z, n - 1, z->tail) != 0) return -1;
+    z->open = 1;
+    return 0;
+}
+
+int zh_flush(ZHeap *z) {
+    if (!z->open || !z->dirty) return 0;
+    ZBlock *d = &z->dir[z->n - 1];
+    const char *src = z->tail;
+    int zlen = d->raw;
+    if (grow(&z->zbuf, &z->zcap, lz_bound(d->raw)) != 0) return -1;
+    int c = lz_compress(z->tail, d->raw, z->zbuf);
+    if (c < d->raw) {
+        src = z->zbuf;
+        zlen = c;
+    }
+    // the block goes to a new place and the old copy is released only by
+    // zh_dir_saved, so the directory on disk stays valid until it is rewritten
+    if (d->off > 0 && grow_stale(z) != 0) return -1;
+    long off = z->alloc(z->ctx, (size_t)zlen);
+    if (off < 0 || z->write(z->ctx, off, (void *)src, (size_t)zlen) != 0) return -1;
+    if (d->off > 0) z->stale[z->nstale++] = *d;
+    d->off = off;
+    d->zlen = zlen;
+    z->dirty = 0;
+    return 0;
+}
+
+long zh_append(ZHeap *z, const char *s, int n) {
+    if (z->open && z->dir[z->n - 1].raw + n > ZH_BLOCK) {
+        if (zh_flush(z) != 0) return -1;
+        z->open = 0;
+    }
+    if (!z->open) {
+        if (grow_dir(z, z->n + 1) != 0) return -1;
+        memset(&z->dir[z->n], 0, sizeof(ZBlock));
+        z->n++;
+        z->open = 1;
+    }
+    ZBlock *d = &z->dir[z->n - 1];
+    if (grow(&z->tail, &z->tcap, d->raw + n) != 0) return -1;
+    long off = (long)(z->n - 1) << ZH_SHIFT | d->raw;
+    memcpy(z->tail + d->raw, s, (size_t)n);
+    d->raw += n;
+    d->live += n;
+    z->dirty = 1;
+    if (d->raw >= ZH_BLOCK) {
+        // a full block (or one long string) takes nothing more
+        if (zh_flush(z) != 0) return -1;
+        z->open = 0;
+    }
+    return off;
+}
+
+void zh_release(ZHeap *z, long off, int n) {
+    int b = (int)(off >> ZH_SHIFT);
+    if (b < 0 || b >= z->n) return;
+    ZBlock *d = &z->dir[b];
+    d->live -= n;
+    if (d->live > 0 || (z->open && b == z->n - 1)) return;
+    if (d->off > 0) z->release(z->ctx, d->off, d->zlen);
+    d->off = 0;
+    d->zlen = 0;
+    d->live = 0;
+    drop_frame(z, b);
+}
+
+void zh_dir_saved(ZHeap *z) {
+    for (int i = 0; i < z->nstale; i++) {
+        if (z->release) z->release(z->ctx, z->stale[i].off, z->stale[i].zlen);
+    }
+    z->nstale = 0;
+}
+
+int zh_read(ZHeap *z, long off, char *dst, int n) {
+    int b = (int)(off >> ZH_SHIFT);
+    long pos = off & POS_MASK;
+    if (off < 0 || b >= z->n || pos + n > z->dir[b].raw) return -1;
+    if (z->open && b == z->n - 1) {
+        memcpy(dst, z->tail + pos, (size_t)n);
+        return 0;
+    }
+    ZhFrame *f = NULL, *old = &z->cache[0];
+    for (int i = 0; i < ZH_CACHE && !f; i++) {
+        if (z->cache[i].block == b) f = &z->cache[i];
+        else if (z->cache[i].used < old->used) old = &z->cache[i];
+    }
+    if (!f) {
+        f = old;
+        f->block = -1;
+        if (grow(&f->buf, &f->cap, z->dir[b].raw) != 0 || load_block(z, b, f->buf) != 0) return -1;
+        f->block = b;
+    }
+    f->used = ++z->tick;
+    memcpy(dst, f->buf + pos, (size_t)n);
+    return 0;
+}
+
+void zh_free(ZHeap *z) {
+    free(z->dir);
+    free(z->tail);
+    free(z->zbuf);
+    free(z->stale);
+    for (int i = 0; i < ZH_CACHE; i++) free(z->cache[i].buf);
+    zh_init(z, z->alloc, z->release, z->read, z->write, z->ctx);
+}
@@ -0,0 +1,119 @@
+#ifndef ZHEAP_H
+#define ZHEAP_H
+
+#include <stddef.h>
+
+// Сжатая куча строк info внутри файла таблицы.
+// Строки (вместе с завершающим '\0') дописываются подряд в открытый
+// блок до ZH_BLOCK байт; заполненный блок сжимается (lz.h) и
+// записывается в файл одним участком. Блок невелик (страница), потому
+// что случайное чтение строки распаковывает весь её блок; степень
+// сжатия от размера блока почти не зависит. Строка адресуется виртуальным
+// смещением (номер блока << ZH_SHIFT | позиция в блоке) — его и хранит
+// FItem.offset. Строка длиннее блока получает отдельный блок.
+// Каталог блоков (ZBlock) хранится в файле отдельным участком.
+// Чтение распаковывает блок целиком в небольшой LRU-кэш из ZH_CACHE
+// блоков, поэтому соседние строки читаются без повторной распаковки.
+// Удалённые строки лишь уменьшают счётчик живых байт блока; участок
+// блока освобождается, когда живых строк в нём не осталось, а место
+// удалённых строк в частично живых блоках возвращает только сжатие
+// таблицы (tf_compact).
+// Кэш блоков меняется и при чтении: параллельные читатели должны
+// вызывать zh_read под общим мьютексом.
+
+#define ZH_BLOCK 4096 // размер блока до сжатия
+#define ZH_SHIFT 12   // сдвиг номера блока в виртуальном смещении (2^ZH_SHIFT = ZH_BLOCK)
+#define ZH_CACHE 32   // распакованных блоков в кэше
+
+typedef struct {
+    long off;  // участок блока в файле, 0 — не записан или освобождён
+    int  zlen; // размер участка; zlen == raw — блок записан без сжатия
+    int  raw;  // размер блока до сжатия
+    int  live; // байт в живых строках
+    int  pad;
+} ZBlock;
+
+// Выделение участка в файле: смещение или -1
+typedef long (*ZhAllocFn)(void *ctx, size_t n);
+// Освобождение участка
+typedef void (*ZhReleaseFn)(void *ctx, long off, long n);
+// Чтение или запись участка: 0 или -1
+typedef int (*ZhIoFn)(void *ctx, long off, void *p, size_t n);
+
+typedef struct {
+    int   block; // номер блока, -1 — кадр пуст
+    long  used;  // время последнего обращения
+    char *buf;
+    int   cap;
+} ZhFrame;
+
+typedef struct {
+    ZBlock     *dir;     // каталог блоков
+    int         n;       // число блоков
+    int         cap;
+    char       *tail;    // открытый (последний) блок, в который дописываются строки
+    int         tcap;
+    int         open;    // 1 — последний блок открыт
+    int         dirty;   // открытый блок изменён после записи
+    ZhFrame     cache[ZH_CACHE];
+    long        tick;
+    char       *zbuf;    // сжатые данные блока
+    int         zcap;
+    ZBlock     *stale;   // старые участки перезаписанных блоков (до записи каталога)
+    int         nstale;
+    int         stale_cap;
+    ZhAllocFn   alloc;
+    ZhReleaseFn release;
+    ZhIoFn      read;
+    ZhIoFn      write;
+    void       *ctx;
+} ZHeap;
+
+/*
+ * Инициализация пустой кучи (без памяти) с функциями доступа к файлу.
+ */
+void zh_init(ZHeap *z, ZhAllocFn alloc, ZhReleaseFn release, ZhIoFn read, ZhIoFn write, void *ctx);
+
+/*
+ * Загрузить каталог из n блоков (копируется). Неполный последний
+ * блок читается и снова открывается для дописывания.
+ * Возвращает 0 или -1 (ошибка чтения, повреждённый блок, нехватка памяти).
+ */
+int zh_load(ZHeap *z, const ZBlock *dir, int n);
+
+/*
+ * Дописать строку s из n байт (вместе с '\0').
+ * Возвращает виртуальное смещение или -1 при ошибке.
+ */
+long zh_append(ZHeap *z, const char *s, int n);
+
+/*
+ * Пометить удалённой строку из n байт по смещению off.
+ */
+void zh_release(ZHeap *z, long off, int n);
+
+/*
+ * Прочитать n байт по виртуальному смещению off в dst.
+ * Возвращает 0 или -1 (ошибка чтения или повреждённый блок).
+ */
+int zh_read(ZHeap *z, long off, char *dst, int n);
+
+/*
+ * Записать изменённый открытый блок в файл (на новое место).
+ * Старый участок блока освобождается только zh_dir_saved.
+ * Возвращает 0 или -1 при ошибке записи.
+ */
+int zh_flush(ZHeap *z);
+
+/*
+ * Каталог записан в файл: освободить старые участки блоков,
+ * перезаписанных zh_flush.
+ */
+void zh_dir_saved(ZHeap *z);
+
+/*
+ * Освобождение памяти (файл не меняется).
+ */
+void zh_free(ZHeap *z);
+
+#endif // ZHEAP_H